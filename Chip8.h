@@ -1,46 +1,32 @@
 #ifndef CHIP8_H
 #define CHIP8_H
 
-#include <stdio.h>
-#include <stdint.h>
-#include <stdlib.h>
-#include <string.h>
-#include <stdbool.h>
-#include <math.h>
-
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 
-static const uint32_t CHIP8_TIMER_PERIOD       = 1000 / 60; // 60hz to decrement delay timer and sound timer
-static const uint32_t CHIP8_SCREEN_WIDTH       = 64;
-static const uint32_t CHIP8_SCREEN_HEIGHT      = 32;
-static const uint32_t CHIP8_SCREEN_SCALE       = 15;
+#include <stdatomic.h>
+
+#include "Chip8_Core.h"
+
+static const uint32_t CHIP8_SCREEN_SCALE       = 15;        // default -scale, the debug panel is laid out for it
 static const uint32_t CHIP8_INFO_REGION_HEIGHT = 300;
+static const uint32_t CHIP8_DEFAULT_PANEL_HZ   = 20;
+static const uint32_t CHIP8_DEFAULT_REWIND     = 30;        // seconds
+static const size_t   CHIP8_REWIND_BYTES       = 1 << 20;
+static const uint32_t CHIP8_REWIND_KEYFRAME    = 60;        // one keyframe per second of states
+static const int      CHIP8_AUDIO_RATE         = 48000;
+static const uint16_t CHIP8_AUDIO_SAMPLES      = 256;       // device buffer, 5.3ms at 48khz
+static const uint32_t CHIP8_TONE_HZ            = 440;
+static const uint32_t CHIP8_FRAME_FRESH        = 4;         // Flag on the triple buffer's middle index
+static const uint32_t CHIP8_PACER_SPIN_US      = 1500;      // the last stretch before a deadline is spun, not slept
+
+// Debug panel capacity, every line owns a fixed range of glyph quads
+#define CHIP8_PANEL_MAX_LINES 64
+#define CHIP8_PANEL_LINE_LEN  40
 
-typedef struct CHIP8MEMORY {
-    union {
-        uint8_t*  ptr_8;
-        uint16_t* ptr_16;
-    };
-    uint8_t* screen_buffer;
-
-    uint16_t key_states;    // Each bit represents 1 - down, 0 - up for keys 0-9, A-F/a-f
-
-    size_t   memory_size;
-    size_t   stack_size;
-    size_t   screen_w;
-    size_t   screen_h;
-} Chip8_Memory;
-
-typedef struct CHIP8CPU {
-    uint8_t   VX[16];       // General purpose, V0 - VF;
-    uint16_t  PC;           // Program counter
-    uint16_t  CIR;          // current instruction register
-    uint16_t  I;            // Memory operand/pointer, referred to as 'I' in Chip8 docs
-    uint8_t   delay_timer;  
-    uint8_t   sound_timer; 
-    uint16_t  stack_ptr;
-} Chip8_CPU;
+#define CHIP8_AUDIO_EVENTS 1024 // tone events in flight, a power of two
+
+#define CHIP8_LATENCY_BUCKETS 16 // bucket N counts latencies of [2^N, 2^(N + 1)) microseconds
 
 // Used for diplaying information
 #define NUM_GLYPHS ('~' - ' ')
@@ -53,28 +39,185 @@ typedef struct CHIP8FONTATLAS {
     size_t       atlas_h;
 } Chip8_FontAtlas;
 
+// Retained text of the debug panel. Lines remember what they last displayed, along with the
+// value it was formatted from, so only lines whose value changed are formatted and laid out
+// again. The quads of every line are kept in one vertex buffer drawn with a single call
+typedef struct CHIP8PANELLINE {
+    uint64_t key;           // Value the text was formatted from, UINT64_MAX when not yet set
+    char     text[CHIP8_PANEL_LINE_LEN];
+} Chip8_PanelLine;
+
+typedef struct CHIP8DEBUGPANEL {
+    Chip8_FontAtlas* atlas;
+    Chip8_PanelLine  lines[CHIP8_PANEL_MAX_LINES];
+    SDL_Vertex*      vertices;      // 4 per glyph quad
+    int*             indices;       // 6 per glyph quad
+    size_t           num_lines;     // One past the highest line index in use
+    bool             dirty;         // Some line changed since the panel was last rendered
+} Chip8_DebugPanel;
+
+// The beeper. The emulation posts tone on/off events (PostTone, the scheduler's tone hook) to a
+// single-producer/single-consumer ring, stamped with the audio sample their emulated cycle maps
+// to, and the SDL audio callback synthesizes a square wave from them. The callback only ever
+// needs the tone state, so it has something to play however irregularly the emulation runs
+typedef struct CHIP8TONEEVENT {
+    uint64_t sample;
+    bool     on;
+} Chip8_ToneEvent;
+
+typedef struct CHIP8AUDIO {
+    SDL_AudioDeviceID    device;
+    int                  rate;
+    uint32_t             buffer;        // Samples per callback
+    Chip8_ToneEvent      events[CHIP8_AUDIO_EVENTS];
+    atomic_uint_fast32_t head;          // Next event the emulation writes
+    atomic_uint_fast32_t tail;          // Next event the callback reads
+    atomic_uint_fast64_t played;        // Samples the callback has produced so far
+
+    // Callback side
+    bool     on;
+    uint32_t phase;                     // Of the square wave, a full period is 2^32
+
+    // Emulation side
+    uint32_t instructions_per_second;
+    int64_t  offset;                    // Sample emulated cycle 0 maps to
+    uint64_t last_sample;
+    bool     anchored;
+} Chip8_Audio;
+
+bool OpenAudio (Chip8_Audio* audio, uint32_t instructions_per_second);
+void CloseAudio(Chip8_Audio* audio);
+void PostTone  (void* audio, bool on, uint64_t cycle);
+
+// Histograms of times on the CHIP8_LATENCY_BUCKETS log scale, filled from any thread
+void     NoteMicros        (atomic_uint_fast64_t histogram[CHIP8_LATENCY_BUCKETS], uint64_t micros);
+uint32_t HistogramPercentile(const atomic_uint_fast64_t histogram[CHIP8_LATENCY_BUCKETS], uint32_t percent);
+void     LogHistogram      (const char* name, const atomic_uint_fast64_t histogram[CHIP8_LATENCY_BUCKETS]);
+
+// Input. An SDL event watch applies key events to the memory's key_states the moment SDL queues
+// them, which happens whenever the frontend pumps events, including while it sleeps waiting for
+// one, instead of when the main loop gets around to handling them. While recording, the keys
+// are latched once per frame instead (LatchKeys). The time from each change to the first
+// instruction that reads it (the memory's key hook) goes into a histogram
+typedef struct CHIP8INPUT {
+    Chip8_Memory*        mem;
+    bool                 live;          // Key events go straight to mem->key_states
+    _Atomic uint16_t     keys;
+    atomic_uint_fast64_t pending;       // Performance counter at the oldest unread change, 0 if none
+    atomic_uint_fast64_t histogram[CHIP8_LATENCY_BUCKETS];
+    uint64_t             frequency;
+    SDL_sem*             wake;          // Posted on keyboard changes that go straight through, NULL
+                                        // outside StartEmulation..StopEmulation
+} Chip8_Input;
+
+void     OpenInput (Chip8_Input* input, Chip8_Memory* mem, bool live);
+void     CloseInput(Chip8_Input* input);
+void     ApplyKeys (Chip8_Input* input, uint16_t pressed, uint16_t released);
+uint16_t LatchKeys (Chip8_Input* input);
+
+// Frame pacing on the high resolution performance counter. Real time is handed to the scheduler
+// in counter units, so nothing is lost to rounding, and the emulation thread sleeps until the
+// exact moment the next timer tick is due. The deadline is worked out from the scheduler's
+// leftover real time each time rather than by adding up frame periods, so oversleeping one frame
+// shortens the wait for the next instead of drifting. How late every tick is published goes
+// into a histogram, the frame time jitter
+typedef struct CHIP8PACER {
+    uint64_t             frequency;     // Counter units per second
+    uint64_t             last;          // Counter when real time was last handed to the scheduler
+    uint64_t             deadline;      // Counter when the next tick is due, 0 when not emulating in real time
+    bool                 slept;         // The last wait did not spin, how late its tick was is not measured
+    atomic_uint_fast64_t histogram[CHIP8_LATENCY_BUCKETS];
+} Chip8_Pacer;
+
+void     OpenPacer      (Chip8_Pacer* pacer);
+uint64_t PaceRealTime   (Chip8_Pacer* pacer, Chip8_Scheduler* sched);
+void     PaceSkip       (Chip8_Pacer* pacer);
+void     PaceFrame      (Chip8_Pacer* pacer, const Chip8_Scheduler* sched, uint64_t backlog);
+void     WaitForDeadline(Chip8_Pacer* pacer, SDL_sem* wake, uint64_t deadline, bool spin);
+
 typedef struct CHIP8DISPLAYCONTEXT {
     SDL_Renderer* renderer;
     TTF_Font*     font;
     SDL_Rect      dimensions;
     Chip8_FontAtlas* atlas;
+    Chip8_DebugPanel* panel;
+    size_t        first_line;       // First panel line owned by this part of the panel
 } Chip8_DisplayContext;
 
-// Only Chip8_Execute0xF for now returns a possible value (signal) if execution needs to
-// be interrupted to wait for a key press, all others return 0, but only for uniformity
-uint8_t Execute0xE(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t nn, uint8_t reg_x);
-uint8_t Execute0xD(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t reg_x, uint8_t reg_y, uint8_t height);
-uint8_t Execute0x0(Chip8_CPU* cpu, Chip8_Memory* mem, uint16_t nnn);
-uint8_t Execute0x8(Chip8_CPU* cpu, uint8_t reg_x, uint8_t reg_y, uint8_t type);
-uint8_t Execute0xF(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t reg_x, uint8_t nn);
-uint8_t ExecInstruction(Chip8_CPU* cpu, Chip8_Memory* mem);
-uint8_t min(uint8_t val, uint8_t min);
-size_t  max(size_t  val, size_t max);
-
-void Initialize(const uint8_t* program, const size_t size, Chip8_CPU* cpu, Chip8_Memory* mem);
-void RunProgram(Chip8_CPU* cpu, Chip8_Memory* mem, SDL_Renderer* renderer);
-
-uint16_t LittleToBigEndianU16(const uint16_t val);
+// Edge smoothing applied when scaling up the screen (ScaleScreen)
+typedef enum CHIP8FILTER {
+    CHIP8_FILTER_NONE,      // pixels are repeated
+    CHIP8_FILTER_SCALE2X,
+    CHIP8_FILTER_SCALE3X,
+} Chip8_Filter;
+
+// Frontend settings chosen on the command line
+typedef struct CHIP8OPTIONS {
+    uint32_t scale;         // Window pixels per 64x32 screen pixel, half that in 128x64 mode
+    Chip8_Filter filter;
+    uint32_t panel_hz;      // Debug panel refreshes per second, 0 refreshes it every frame
+    uint32_t rewind;        // Seconds of history kept for rewinding, 0 disables it
+    Chip8_Recording* recording; // Keys of every frame are appended to it when not NULL
+    Chip8_Export*    exporter;  // Every frame published is exported to it when not NULL
+    bool     turbo;         // Start fast-forwarding, holding Tab then runs at normal speed
+} Chip8_Options;
+
+void RunProgram(Chip8_CPU* cpu, Chip8_Memory* mem, Chip8_Scheduler* sched, SDL_Renderer* renderer,
+                const Chip8_Options* options);
+
+// A finished frame as the emulation thread hands it over: the screen and what the panel shows
+typedef struct CHIP8FRAME {
+    Chip8_CPU cpu;
+    uint8_t*  memory;
+    uint64_t* screen;
+    uint64_t  timer_ticks;
+} Chip8_Frame;
+
+// The emulation thread. It owns the CPU, memory and scheduler while it runs, keeps emulated time
+// in step with real time on its own, and publishes a frame after every batch through a triple
+// buffer: it fills its back frame and swaps it for the middle one, the render thread swaps the
+// middle one for its front frame whenever that is newer. Each side always has a frame to itself,
+// so neither ever waits on the other and the render thread always gets the newest frame
+typedef struct CHIP8EMULATION {
+    Chip8_CPU*           cpu;
+    Chip8_Memory*        mem;
+    Chip8_Scheduler*     sched;
+    const Chip8_Options* options;
+    Chip8_Rewind*        rewind;        // NULL when rewinding is disabled
+    Chip8_Input*         input;
+    Chip8_Pacer*         pacer;
+    Chip8_Audio*         audio;         // NULL without sound
+
+    Chip8_Frame frames[3];
+    atomic_uint middle;                 // Frame between the threads, | CHIP8_FRAME_FRESH until taken
+    uint32_t    back;                   // Frame the emulation thread fills
+    uint32_t    front;                  // Frame the render thread reads
+
+    atomic_bool running;
+    atomic_bool rewinding;              // Set by the render thread while Backspace is held
+    atomic_bool turbo_held;             // and while Tab is
+    atomic_bool frame_wanted;           // The render thread waits for frame_event
+    uint32_t    frame_event;
+    SDL_sem*    wake;                   // Cuts the emulation thread's wait short
+    SDL_Thread* thread;
+} Chip8_Emulation;
+
+bool               StartEmulation(Chip8_Emulation* emu);
+void               StopEmulation (Chip8_Emulation* emu);
+const Chip8_Frame* TakeFrame     (Chip8_Emulation* emu, bool* fresh);
+
+// Upscaling of the screen into 32-bit pixels
+uint32_t FilterFactor   (Chip8_Filter filter);
+bool     ParseFilterName(const char* name, Chip8_Filter* filter);
+void     ScaleScreen    (const Chip8_Memory* mem, Chip8_Filter filter, uint32_t scale, int first, int last,
+                         const uint32_t palette[4], uint32_t* pixels, int pitch);
+
+// Debug panel
+bool InitializePanel(Chip8_DebugPanel* panel, Chip8_FontAtlas* atlas);
+void FreePanel      (Chip8_DebugPanel* panel);
+bool PanelLineChanged(Chip8_DebugPanel* panel, size_t line, uint64_t key);
+void PanelSetLine   (Chip8_DebugPanel* panel, size_t line, int x, int y, const char* text);
+void PanelRender    (Chip8_DebugPanel* panel, SDL_Renderer* renderer);
 
 // Display Related functions
 void DisplayCPUAndMemoryContents   (Chip8_DisplayContext*, Chip8_CPU*, Chip8_Memory*);
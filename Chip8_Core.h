@@ -0,0 +1,477 @@
+#ifndef CHIP8_CORE_H
+#define CHIP8_CORE_H
+
+// The interpreter core: CPU and memory state, instruction execution and scheduling.
+// Nothing in here depends on SDL, so it can be built and linked on its own (libchip8core.a)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <math.h>
+
+static const uint32_t CHIP8_TIMER_HZ           = 60;   // rate at which the delay and sound timers decrement
+static const uint32_t CHIP8_DEFAULT_IPS        = 700;  // instructions per second of emulated time
+static const uint32_t CHIP8_DEFAULT_SEED       = 1;    // seed Initialize gives the Cxkk generator
+static const uint32_t CHIP8_MAX_CATCHUP_MS     = 250;  // longest real time stall the scheduler will catch up on
+static const uint32_t CHIP8_SCREEN_WIDTH       = 64;
+static const uint32_t CHIP8_SCREEN_HEIGHT      = 32;
+static const uint32_t CHIP8_HIRES_WIDTH        = 128;  // SUPER-CHIP and XO-CHIP high resolution mode
+static const uint32_t CHIP8_HIRES_HEIGHT       = 64;
+static const uint16_t CHIP8_BIG_FONT           = 0x50; // 8x10 digits of Fx30, right after the 4x5 ones
+
+#define CHIP8_DISASM_LEN   24   // fixed width of a cached mnemonic, including the terminator
+#define CHIP8_DECODE_SLOTS 4096 // one pre-decoded slot per byte address of the 4KB memory
+#define CHIP8_LOCKSTEP_LANES 32 // instances a lockstep group can hold
+#define CHIP8_LOCKSTEP_ROWS  32 // screen rows of a lockstep lane, CHIP8_SCREEN_HEIGHT
+#define CHIP8_STACK_DEPTH    16 // return addresses 2nnn can push, a power of two
+#define CHIP8_PLANES         2  // bitplanes of XO-CHIP, the other variants only use the first
+#define CHIP8_RPL_FLAGS      16 // Fx75/Fx85 registers
+#define CHIP8_STATIC_BLOCK   64 // longest block chip8_aot translates, in instructions
+
+// The instruction set a program was written for. SUPER-CHIP adds the 128x64 mode, scrolling and
+// the big font, XO-CHIP adds 64KB of memory and a second bitplane on top of that
+typedef enum CHIP8VARIANT {
+    CHIP8_VARIANT_CHIP8,
+    CHIP8_VARIANT_SCHIP,
+    CHIP8_VARIANT_XOCHIP,
+} Chip8_Variant;
+
+// Called by the first instruction that reads the keys after the frontend changed them
+typedef void (*Chip8_KeyHook)(void* arg);
+
+typedef struct CHIP8MEMORY {
+    union {
+        uint8_t*  ptr_8;
+        uint16_t* ptr_16;
+    };
+    // Each plane holds screen_h rows of row_words words, the most significant bit of a row's
+    // first word is its leftmost pixel. Planes are plane_words apart, room for the largest
+    // resolution of the variant, and the buffer holds screen_words words in all
+    uint64_t* screen_buffer;
+    uint64_t  dirty_rows;    // Bit N is set when row N changed since the frontend last displayed it
+
+    // Each bit represents 1 - down, 0 - up for keys 0-9, A-F/a-f. The frontend may change them
+    // from another thread while the program runs, and sets key_fresh after doing so
+    _Atomic uint16_t key_states;
+    atomic_bool      key_fresh;
+    Chip8_KeyHook    key_hook;      // NULL when nobody listens
+    void*            key_arg;
+
+    Chip8_Variant variant;   // Chosen before Initialize, which sizes everything below from it
+    size_t   memory_size;
+    size_t   screen_w;       // Resolution of the current mode, see ApplyScreenMode
+    size_t   screen_h;
+    size_t   row_words;
+    size_t   plane_words;
+    size_t   screen_words;
+
+#ifdef CHIP8_PROFILE
+    struct CHIP8PROFILE* profile; // Counters the engines update, NULL when not collecting
+#endif
+} Chip8_Memory;
+
+// Keys as the program sees them, every engine reads them through here
+static inline uint16_t ReadKeys(Chip8_Memory* mem)
+{
+    if(atomic_load_explicit(&mem->key_fresh, memory_order_relaxed) &&
+       atomic_exchange_explicit(&mem->key_fresh, false, memory_order_acquire) && mem->key_hook != NULL)
+        mem->key_hook(mem->key_arg);
+    return atomic_load_explicit(&mem->key_states, memory_order_relaxed);
+}
+
+typedef struct CHIP8CPU {
+    uint8_t   VX[16];       // General purpose, V0 - VF;
+    uint16_t  PC;           // Program counter
+    uint16_t  CIR;          // current instruction register
+    uint16_t  I;            // Memory operand/pointer, referred to as 'I' in Chip8 docs
+    uint8_t   delay_timer;  
+    uint8_t   sound_timer; 
+    uint16_t  stack_ptr;     // Next free entry of stack, wraps around after CHIP8_STACK_DEPTH calls
+    uint8_t   wait_key_reg;  // Register Fx0A stores the next key press into, 0xFF if not waiting
+    uint16_t  wait_key_prev; // Keys already held down when the wait began (or since released)
+    uint32_t  rng_state;     // Per-instance generator behind Cxkk, never 0
+    uint16_t  stack[CHIP8_STACK_DEPTH];  // Return addresses, outside of guest memory
+    uint8_t   hires;         // 128x64 mode (00FF) rather than 64x32 (00FE)
+    uint8_t   planes;        // Bitplanes Dxyn, 00E0 and scrolling act on, one bit each (Fn01)
+    uint8_t   rpl[CHIP8_RPL_FLAGS];
+} Chip8_CPU;
+
+// A pre-decoded instruction: index of its handler in the dispatch table of ExecCyclesCached
+// plus the operands already extracted from the opcode. handler == 0 means not decoded yet
+typedef struct CHIP8DECODEDOP {
+    uint8_t  handler;
+    uint8_t  x;
+    uint8_t  y;
+    uint8_t  nn;
+    uint16_t nnn;
+    uint16_t instr;         // the raw opcode, for CIR and the debugger
+} Chip8_DecodedOp;
+
+typedef struct CHIP8DECODECACHE {
+    Chip8_DecodedOp ops[CHIP8_DECODE_SLOTS];
+} Chip8_DecodeCache;
+
+// Translated code and lookup tables of the x86-64 recompiler, private to chip8_jit.c
+typedef struct CHIP8JIT Chip8_Jit;
+
+// Which blocks of an ahead-of-time translation still match memory, private to chip8_static.c
+typedef struct CHIP8STATIC Chip8_Static;
+
+// A basic block of a ROM recompiled to C by chip8_aot. It runs the instructions from its
+// address on, leaves PC at the next one and returns how many it executed, fewer than its
+// length when it stopped early to wait for a key or because it wrote over translated code
+typedef uint32_t (*Chip8_StaticBlock)(Chip8_Static* st, Chip8_CPU* cpu, Chip8_Memory* mem);
+
+typedef struct CHIP8STATICPROGRAM {
+    Chip8_Variant            variant;
+    uint64_t                 rom_hash;  // HashROM of the ROM translated
+    size_t                   rom_size;
+    const uint8_t*           rom;       // As translated, it loads at 0x200
+    const Chip8_StaticBlock* blocks;    // CHIP8_DECODE_SLOTS entries, NULL where no block starts
+    const uint8_t*           lengths;   // Instructions in the block starting at each address
+} Chip8_StaticProgram;
+
+typedef enum CHIP8ENGINE {
+    CHIP8_ENGINE_INTERPRETER,   // fetch, decode and switch on every instruction (ExecCycles)
+    CHIP8_ENGINE_CACHED,        // threaded dispatch over pre-decoded instructions (ExecCyclesCached)
+    CHIP8_ENGINE_JIT,           // basic blocks recompiled to x86-64 (ExecCyclesJit)
+    CHIP8_ENGINE_STATIC,        // a ROM recompiled to C ahead of time (ExecCyclesStatic)
+} Chip8_Engine;
+
+// Called when the tone the sound timer drives starts or stops, with the emulated cycle it did.
+// Stops happen on timer ticks and are exact, starts are reported at the end of the batch
+// (at most a frame) the Fx18 that caused them ran in
+typedef void (*Chip8_ToneHook)(void* arg, bool on, uint64_t cycle);
+
+// Drives execution in terms of emulated time: instructions run at a fixed rate and the
+// 60hz timers tick every (instructions_per_second / 60) instructions, independent of how
+// often, or how irregularly, the host gets around to calling RunCycles
+typedef struct CHIP8SCHEDULER {
+    uint32_t instructions_per_second;
+    uint32_t timer_accumulator;    // Advances by CHIP8_TIMER_HZ per cycle, ticks at instructions_per_second
+    uint64_t realtime_remainder;   // Sub-cycle leftover of real time, in (counter units * instructions_per_second)
+    uint64_t cycle_count;          // Emulated cycles elapsed, including those spent waiting for a key
+    uint64_t instruction_count;    // Instructions actually executed
+    uint64_t timer_ticks;
+    uint64_t idle_count;           // Instructions of idle loops skipped over, part of instruction_count
+    bool     idle;                 // The last RunCycles ended waiting on a key or in an idle loop
+
+    Chip8_ToneHook tone_hook;      // NULL when nobody listens
+    void*          tone_arg;
+    bool           tone_on;        // Last state reported to tone_hook
+
+    Chip8_Engine       engine;
+    Chip8_DecodeCache* decode_cache;
+    Chip8_Jit*         jit;
+    Chip8_Static*      static_code;
+} Chip8_Scheduler;
+
+// Only Chip8_Execute0xF for now returns a possible value (signal) if execution needs to
+// be interrupted to wait for a key press, all others return 0, but only for uniformity
+uint8_t Execute0xE(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t nn, uint8_t reg_x);
+uint8_t Execute0xD(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t reg_x, uint8_t reg_y, uint8_t height);
+uint8_t Execute0x0(Chip8_CPU* cpu, Chip8_Memory* mem, uint16_t nnn);
+uint8_t Execute0x8(Chip8_CPU* cpu, uint8_t reg_x, uint8_t reg_y, uint8_t type);
+uint8_t Execute0xF(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t reg_x, uint8_t nn);
+uint8_t ExecInstruction(Chip8_CPU* cpu, Chip8_Memory* mem);
+void    FetchInstruction(Chip8_CPU* cpu, Chip8_Memory* mem);
+uint32_t ExecCycles(Chip8_CPU* cpu, Chip8_Memory* mem, uint32_t cycles);
+uint8_t min(uint8_t val, uint8_t min);
+size_t  max(size_t  val, size_t max);
+
+uint8_t  GetPixel(const Chip8_Memory* mem, size_t x, size_t y);
+uint64_t HashScreen(const Chip8_Memory* mem);
+
+// Bytes of memory and words of screen buffer an instance of the variant needs
+size_t   VariantMemorySize(Chip8_Variant variant);
+size_t   VariantScreenWords(Chip8_Variant variant);
+bool     ParseVariantName(const char* name, Chip8_Variant* variant);
+
+// Derives the resolution fields of mem from the CPU's mode, after anything changed it
+void     ApplyScreenMode(const Chip8_CPU* cpu, Chip8_Memory* mem);
+
+// Every instance draws Cxkk's random numbers from its own generator, so instances running
+// side by side stay independent and a run is reproducible from its seed
+void     SeedRandom(Chip8_CPU* cpu, uint32_t seed);
+uint32_t NextRandom(Chip8_CPU* cpu);
+
+// mem->ptr_8 and mem->screen_buffer must hold what VariantMemorySize and VariantScreenWords
+// ask for mem->variant
+void Initialize(const uint8_t* program, const size_t size, Chip8_CPU* cpu, Chip8_Memory* mem);
+uint8_t* LoadROM(const char* path, size_t* size);
+uint16_t LittleToBigEndianU16(const uint16_t val);
+
+// Pre-decoded execution. Any write to guest memory made outside of ExecCyclesCached itself
+// (loading a ROM, restoring a state...) must be followed by a FlushDecodeCache
+void     FlushDecodeCache(Chip8_DecodeCache* cache);
+void     InvalidateDecodeCache(Chip8_DecodeCache* cache, uint16_t addr, uint16_t len);
+uint32_t ExecCyclesCached(Chip8_DecodeCache* cache, Chip8_CPU* cpu, Chip8_Memory* mem, uint32_t cycles);
+
+// Dynamic recompilation, only available on x86-64 hosts (CreateJit returns NULL elsewhere).
+// Memory written from outside the engine needs a FlushJit, just like the decode cache
+Chip8_Jit* CreateJit(void);
+void       DestroyJit(Chip8_Jit* jit);
+void       FlushJit(Chip8_Jit* jit);
+void       InvalidateJit(Chip8_Jit* jit, uint16_t addr, uint16_t len);
+void       UnlinkJit(Chip8_Jit* jit);       // The CPU was loaded from outside the engine
+uint32_t   ExecCyclesJit(Chip8_Jit* jit, Chip8_CPU* cpu, Chip8_Memory* mem, uint32_t cycles);
+
+// Ahead-of-time recompiled code. Blocks only run while memory still holds the bytes they were
+// translated from, InvalidateStatic returns whether a write made any of them stale
+Chip8_Static* CreateStatic(const Chip8_StaticProgram* program);
+void          DestroyStatic(Chip8_Static* st);
+void          FlushStatic(Chip8_Static* st);
+bool          InvalidateStatic(Chip8_Static* st, uint16_t addr, uint16_t len);
+uint32_t      ExecCyclesStatic(Chip8_Static* st, Chip8_CPU* cpu, Chip8_Memory* mem, uint32_t cycles);
+
+// Many instances of the same ROM executed in lockstep. The state of every instance (lane) is
+// stored struct-of-arrays, VX[r][lane] etc, so lanes that sit at the same PC execute an
+// instruction together with one vector operation per register row. Lanes whose control flow
+// diverges are split into groups by PC and the group with the lowest PC always runs next,
+// which lets lanes that took different paths merge again once they reach the same address.
+// Lanes run the original CHIP-8 instruction set only
+typedef struct CHIP8LOCKSTEP {
+    uint8_t  VX[16][CHIP8_LOCKSTEP_LANES]           __attribute__((aligned(64)));
+    uint16_t PC[CHIP8_LOCKSTEP_LANES]               __attribute__((aligned(64)));
+    uint16_t I[CHIP8_LOCKSTEP_LANES]                __attribute__((aligned(64)));
+    uint16_t stack_ptr[CHIP8_LOCKSTEP_LANES]        __attribute__((aligned(64)));
+    uint16_t stack[CHIP8_STACK_DEPTH][CHIP8_LOCKSTEP_LANES] __attribute__((aligned(64)));
+    uint16_t key_states[CHIP8_LOCKSTEP_LANES]       __attribute__((aligned(64)));
+    uint16_t wait_key_prev[CHIP8_LOCKSTEP_LANES]    __attribute__((aligned(64)));
+    uint8_t  delay_timer[CHIP8_LOCKSTEP_LANES]      __attribute__((aligned(64)));
+    uint8_t  sound_timer[CHIP8_LOCKSTEP_LANES]      __attribute__((aligned(64)));
+    uint8_t  wait_key_reg[CHIP8_LOCKSTEP_LANES]     __attribute__((aligned(64)));
+    uint32_t rng_state[CHIP8_LOCKSTEP_LANES]        __attribute__((aligned(64)));
+    uint64_t instruction_count[CHIP8_LOCKSTEP_LANES];
+
+    uint8_t  memory[CHIP8_LOCKSTEP_LANES][4096]     __attribute__((aligned(64)));
+    uint64_t screen[CHIP8_LOCKSTEP_LANES][CHIP8_LOCKSTEP_ROWS];
+    uint64_t written[4096 / 64];    // Addresses any lane wrote to, where lanes' code may differ
+
+    uint32_t num_lanes;
+    uint32_t instructions_per_second;
+    uint32_t timer_accumulator;
+    uint64_t cycle_count;
+    uint64_t timer_ticks;
+    uint64_t group_steps;           // Instructions issued, each for a whole group of lanes
+} Chip8_Lockstep;
+
+Chip8_Lockstep* CreateLockstep(const uint8_t* program, size_t size, uint32_t num_lanes,
+                               uint32_t instructions_per_second);
+void     DestroyLockstep(Chip8_Lockstep* ls);
+void     RunLockstepCycles(Chip8_Lockstep* ls, uint64_t cycles);
+void     RunLockstepFrames(Chip8_Lockstep* ls, uint64_t frames);
+void     ExtractLane(const Chip8_Lockstep* ls, uint32_t lane, Chip8_CPU* cpu, Chip8_Memory* mem);
+uint64_t HashLaneScreen(const Chip8_Lockstep* ls, uint32_t lane);
+
+// Rewind history of recent states, stored as run-length encoded XOR deltas against periodic
+// keyframes. Push after every emulated frame, pop to step backwards
+typedef struct CHIP8REWINDENTRY Chip8_RewindEntry;
+
+typedef struct CHIP8REWIND {
+    size_t   state_size;
+    uint32_t keyframe_interval;
+    size_t   max_frames;
+    Chip8_RewindEntry* entries;     // Ring of max_frames descriptors, indexed by sequence number
+    uint64_t first;                 // Sequence number of the oldest state kept
+    uint64_t count;                 // States kept
+    uint8_t* data;                  // Circular buffer of encoded states
+    size_t   data_size;
+    size_t   head;                  // Where the next encoded state goes
+    size_t   bytes;                 // Bytes of data in use
+    uint8_t* key_state;             // Decoded image of keyframe key_seq
+    uint64_t key_seq;               // UINT64_MAX when none is decoded
+    uint8_t* state;                 // Scratch image
+    uint8_t* encoded;               // Scratch encoding, room for the worst case
+} Chip8_Rewind;
+
+Chip8_Rewind* CreateRewind(const Chip8_Memory* mem, size_t max_frames, size_t max_bytes,
+                           uint32_t keyframe_interval);
+void DestroyRewind(Chip8_Rewind* rw);
+void PushRewind(Chip8_Rewind* rw, const Chip8_CPU* cpu, const Chip8_Memory* mem, const Chip8_Scheduler* sched);
+bool PopRewind (Chip8_Rewind* rw, Chip8_CPU* cpu, Chip8_Memory* mem, Chip8_Scheduler* sched);
+
+// Forks of an instance for searching over its possible futures. A fork holds a copy of the
+// CPU and shares its memory and screen with other forks in refcounted pages, which are only
+// duplicated for the pages that differ. Cloning a fork is a CPU copy plus reference counts,
+// capturing or restoring an instance copies just the pages that changed. Forks and pages are
+// recycled by their pool, a search that frees what it no longer needs stops allocating
+#define CHIP8_FORK_PAGE 256
+
+typedef struct CHIP8FORKPAGE Chip8_ForkPage;
+
+typedef struct CHIP8FORK {
+    Chip8_CPU         cpu;
+    uint32_t          timer_accumulator;
+    struct CHIP8FORK* next_free;
+    Chip8_ForkPage*   pages[];          // Memory pages, then the screen
+} Chip8_Fork;
+
+typedef struct CHIP8FORKPOOL {
+    size_t          memory_pages;
+    size_t          num_pages;          // Per fork, memory_pages plus one for the screen
+    size_t          screen_size;
+    size_t          fork_size;
+    Chip8_Fork*     free_forks;
+    Chip8_ForkPage* free_pages;
+    void*           slabs;              // Every block allocated, linked through their first word
+    size_t          live_forks;
+    size_t          live_pages;
+} Chip8_ForkPool;
+
+Chip8_ForkPool* CreateForkPool(const Chip8_Memory* mem);
+void            DestroyForkPool(Chip8_ForkPool* pool);
+Chip8_Fork*     CaptureFork(Chip8_ForkPool* pool, const Chip8_Fork* parent, const Chip8_CPU* cpu,
+                            const Chip8_Memory* mem, const Chip8_Scheduler* sched);
+Chip8_Fork*     CloneFork  (Chip8_ForkPool* pool, const Chip8_Fork* fork);
+void            RestoreFork(const Chip8_ForkPool* pool, const Chip8_Fork* fork, Chip8_CPU* cpu,
+                            Chip8_Memory* mem, Chip8_Scheduler* sched);
+void            FreeFork   (Chip8_ForkPool* pool, Chip8_Fork* fork);
+
+// Profiling, compiled in only with -DCHIP8_PROFILE so that regular builds carry no counters at
+// all. The interpreter and the cached engine count every instruction they execute in the
+// Chip8_Profile attached to the memory (the JIT is not instrumented and is unavailable in
+// profiling builds), Execute0xD keeps statistics on every sprite drawn. Times are in
+// ProfileClock ticks: TSC cycles on x86, nanoseconds elsewhere
+#ifdef CHIP8_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t ProfileClock(void) { return __rdtsc(); }
+#else
+#include <time.h>
+static inline uint64_t ProfileClock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+typedef struct CHIP8PROFILE {
+    uint64_t class_count[16];   // Instructions executed by leading nibble, 0nnn - Fxnn
+    uint64_t class_time[16];
+    uint64_t pc_count[4096];    // Instructions executed at each address
+
+    uint64_t draw_count;        // Dxyn
+    uint64_t draw_rows;         // Sprite rows actually drawn, after clipping
+    uint64_t draw_clipped;      // Sprites cut short by the bottom edge
+    uint64_t draw_collisions;
+    uint64_t draw_time;
+    uint64_t draw_height[16];   // Sprites drawn by n
+} Chip8_Profile;
+
+static inline void ProfileInstruction(Chip8_Profile* profile, uint16_t pc, uint16_t instr, uint64_t ticks)
+{
+    profile->pc_count[pc & 0xFFF]++;
+    profile->class_count[instr >> 12]++;
+    profile->class_time[instr >> 12] += ticks;
+}
+
+void WriteProfile(FILE* out, const Chip8_Profile* profile, const Chip8_Memory* mem);
+#endif
+
+// Input recordings: the keys held during every frame of a run plus what it started from, enough
+// to replay the run exactly. The keys must only change between whole frames while recording
+typedef struct CHIP8RECORDING {
+    Chip8_Variant variant;
+    uint32_t  seed;                     // Cxkk generator seed the run started with
+    uint32_t  instructions_per_second;
+    uint64_t  rom_hash;                 // HashROM of the program
+    uint64_t  final_hash;               // HashState after the last frame
+    size_t    num_frames;
+    size_t    capacity;
+    uint16_t* keys;                     // key_states during each frame
+} Chip8_Recording;
+
+uint64_t HashROM(const uint8_t* program, size_t size);
+uint64_t HashState(const Chip8_CPU* cpu, const Chip8_Memory* mem, const Chip8_Scheduler* sched);
+bool     RecordFrame(Chip8_Recording* rec, uint16_t keys);
+void     FreeRecording(Chip8_Recording* rec);
+bool     SaveRecording(const char* path, const Chip8_Recording* rec);
+bool     LoadRecording(const char* path, Chip8_Recording* rec);
+uint64_t ReplayRecording(const Chip8_Recording* rec, Chip8_Scheduler* sched, Chip8_CPU* cpu, Chip8_Memory* mem);
+
+// Frames exported to shared memory for other processes to watch. The ring is one mapping: a
+// header, then CHIP8_EXPORT_SLOTS slots written round robin, each holding a whole frame with
+// its sequence number. Readers map it by name and read slots in place:
+//
+//   sequence = ring->latest (acquire), slot = &ring->slots[sequence % CHIP8_EXPORT_SLOTS]
+//   slot->sequence (acquire) == sequence, or the slot is being rewritten and the frame is gone
+//   ... use the slot ...
+//   slot->sequence still == sequence after an acquire fence, or what was read may be torn
+//
+// which leaves a reader CHIP8_EXPORT_SLOTS - 1 frames of time before its slot is reused. Keys
+// go the other way: readers set and clear their bits of ring->keys with atomic or/and, and the
+// emulator applies whatever changed at its next frame
+#define CHIP8_EXPORT_SLOTS        8
+#define CHIP8_EXPORT_SCREEN_WORDS 256   // the largest screen, XO-CHIP's two 128x64 planes
+
+static const uint32_t CHIP8_EXPORT_VERSION = 1;
+
+typedef struct CHIP8EXPORTSLOT {
+    _Atomic uint64_t sequence;          // Frame held, counting from 1, 0 while it is written
+    uint64_t         timer_ticks;       // Emulated frames the frame was taken after
+    Chip8_CPU        cpu;
+    uint16_t         key_states;
+    uint16_t         screen_w;
+    uint16_t         screen_h;
+    uint16_t         row_words;
+    uint32_t         plane_words;
+    uint32_t         screen_words;      // Of screen used, laid out as in Chip8_Memory
+    uint64_t         screen[CHIP8_EXPORT_SCREEN_WORDS];
+} __attribute__((aligned(64))) Chip8_ExportSlot;
+
+typedef struct CHIP8EXPORTRING {
+    char             magic[4];          // "C8FB"
+    uint32_t         version;           // CHIP8_EXPORT_VERSION
+    uint32_t         slot_size;         // sizeof(Chip8_ExportSlot), for readers not built from this header
+    uint32_t         num_slots;
+    uint32_t         variant;           // Chip8_Variant
+    _Atomic uint16_t keys;              // Held by readers
+    _Atomic uint64_t latest;            // Newest complete frame, 0 before the first
+    Chip8_ExportSlot slots[CHIP8_EXPORT_SLOTS];
+} Chip8_ExportRing;
+
+// The exporting side, owns the name
+typedef struct CHIP8EXPORT Chip8_Export;
+
+Chip8_Export*           OpenExport   (const char* name, Chip8_Variant variant);
+void                    CloseExport  (Chip8_Export* exp);
+void                    ExportFrame  (Chip8_Export* exp, const Chip8_CPU* cpu, const Chip8_Memory* mem,
+                                      uint64_t timer_ticks);
+uint16_t                ExportedKeys (Chip8_Export* exp, uint16_t* pressed, uint16_t* released);
+Chip8_ExportRing*       AttachExport (const char* name);
+void                    DetachExport (Chip8_ExportRing* ring);
+const Chip8_ExportSlot* LatestExport (const Chip8_ExportRing* ring, uint64_t* sequence);
+bool                    ExportIntact (const Chip8_ExportSlot* slot, uint64_t sequence);
+void                    SetExportKey (Chip8_ExportRing* ring, uint8_t key, bool down);
+
+// Disassembly, mnemonics are cached per opcode so looking one up is a table access
+const char* DisassembleInstruction(uint16_t instr);
+void        DisassembleListing(FILE* out, const uint8_t* code, size_t size, uint16_t base);
+
+// Scheduling
+void     InitializeScheduler(Chip8_Scheduler* sched, uint32_t instructions_per_second);
+bool     SetEngine(Chip8_Scheduler* sched, Chip8_Engine engine);
+bool     UseStaticProgram(Chip8_Scheduler* sched, const Chip8_StaticProgram* program);
+bool     ParseEngineName(const char* name, Chip8_Engine* engine);
+void     FreeScheduler(Chip8_Scheduler* sched);
+uint64_t ScheduleRealTime(Chip8_Scheduler* sched, uint64_t elapsed, uint64_t frequency);
+uint64_t RealTimeUntilTick(const Chip8_Scheduler* sched, uint64_t backlog, uint64_t frequency);
+void     RunCycles(Chip8_Scheduler* sched, Chip8_CPU* cpu, Chip8_Memory* mem, uint64_t cycles);
+void     RunFrames(Chip8_Scheduler* sched, Chip8_CPU* cpu, Chip8_Memory* mem, uint64_t frames);
+uint32_t CyclesUntilTick(const Chip8_Scheduler* sched);
+void     TickTimers(Chip8_CPU* cpu);
+void     FlushEngine(Chip8_Scheduler* sched);
+void     InvalidateEngine(Chip8_Scheduler* sched, uint16_t addr, uint16_t len);
+
+// Save states, a flat image of StateSize bytes. LoadState flushes the engine's caches
+size_t   StateSize(const Chip8_Memory* mem);
+void     SaveState(const Chip8_CPU* cpu, const Chip8_Memory* mem, const Chip8_Scheduler* sched, uint8_t* out);
+void     LoadState(Chip8_CPU* cpu, Chip8_Memory* mem, Chip8_Scheduler* sched, const uint8_t* in);
+void     ResolveKeyWait(Chip8_CPU* cpu, Chip8_Memory* mem);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef CHIP8_ENV_H
+#define CHIP8_ENV_H
+
+// Batched environment for agents: N instances of one ROM advanced together, one emulated frame
+// per step. Observations and rewards are written into arrays the caller owns, laid out so that a
+// NumPy array can be handed over as is (ctypes, arr.ctypes.data) and read back without copying:
+//
+//   observations  uint8  [num_envs][planes][height][width / 8], pixels packed 8 to a byte with
+//                        the leftmost pixel in the top bit (np.unpackbits(..., axis=-1) gives
+//                        one byte per pixel). height x width is 32x64 for CHIP-8 ROMs and
+//                        64x128 for SUPER-CHIP and XO-CHIP, whose 64x32 mode is doubled up;
+//                        planes is 2 for XO-CHIP, 1 otherwise
+//   rewards       float32[num_envs]
+//   actions       uint16 [num_envs], the keys held during the frame as a key_states mask
+//                        (key K is bit 0x8000 >> K)
+//
+// Stepping allocates nothing. Batches larger than CHIP8_ENV_CHUNK instances are spread over a
+// work-stealing thread pool (Chip8_Pool), every instance belongs to one worker for the whole
+// step and they share nothing, so results do not depend on the number of threads.
+
+#include "Chip8_Core.h"
+
+#define CHIP8_ENV_CHUNK 16  // instances a worker steps at a time
+
+// Where the reward of a step comes from: how much a byte of the program's state changed over
+// the step, as a signed 8-bit difference so that a score wrapping around still counts up
+typedef enum CHIP8SCORESOURCE {
+    CHIP8_SCORE_NONE,       // Every reward is 0
+    CHIP8_SCORE_REGISTER,   // VX[location]
+    CHIP8_SCORE_MEMORY,     // The byte at address location
+} Chip8_ScoreSource;
+
+// Computes the reward of instance 'index' instead, from the state it ended the step in. Runs on
+// whichever worker stepped the instance
+typedef float (*Chip8_EnvReward)(void* arg, size_t index, const Chip8_CPU* cpu, const Chip8_Memory* mem);
+
+typedef struct CHIP8ENV Chip8_Env;
+
+// num_threads 0 uses every core. NULL if out of memory
+Chip8_Env* CreateEnv (const uint8_t* program, size_t size, Chip8_Variant variant, size_t num_envs,
+                      uint32_t instructions_per_second, Chip8_Engine engine, size_t num_threads);
+void       DestroyEnv(Chip8_Env* env);
+
+size_t EnvCount          (const Chip8_Env* env);
+size_t EnvObservationSize(const Chip8_Env* env);  // Bytes per instance, planes * height * width / 8
+void   EnvObservationShape(const Chip8_Env* env, size_t* planes, size_t* height, size_t* width);
+void   SetEnvScore       (Chip8_Env* env, Chip8_ScoreSource source, uint16_t location);
+void   SetEnvReward      (Chip8_Env* env, Chip8_EnvReward reward, void* arg);
+
+// Restarts every instance, or just one, from the ROM. Instance i draws its Cxkk numbers from
+// a generator seeded with 'seed' and i, and its observation is written to observations (which
+// may be NULL) at i * EnvObservationSize
+void ResetEnv     (Chip8_Env* env, uint32_t seed, uint8_t* observations);
+void ResetEnvIndex(Chip8_Env* env, size_t index, uint32_t seed, uint8_t* observations);
+
+// Advances the first num_envs instances by one frame each, holding actions[i] on instance i
+void StepEnv(Chip8_Env* env, const uint16_t* actions, size_t num_envs, uint8_t* observations, float* rewards);
+
+#endif
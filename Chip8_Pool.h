@@ -0,0 +1,29 @@
+#ifndef CHIP8_POOL_H
+#define CHIP8_POOL_H
+
+// Work-stealing thread pool for running many independent interpreter instances at once.
+// A batch of tasks is numbered 0..count-1 and split evenly between the workers up front, each
+// worker then takes tasks from the front of its own range and, once that runs dry, steals the
+// back half of another worker's range. The thread calling RunPool works as worker 0
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct CHIP8POOL Chip8_Pool;
+
+// Runs task 'index' of a batch on worker 'worker' (0 <= worker < PoolSize)
+typedef void (*Chip8_PoolTask)(void* arg, size_t index, size_t worker);
+
+Chip8_Pool* CreatePool(size_t num_workers);
+void        DestroyPool(Chip8_Pool* pool);
+size_t      PoolSize(const Chip8_Pool* pool);
+uint64_t    PoolSteals(const Chip8_Pool* pool);
+
+// Runs every task of the batch and returns once all of them finished
+void        RunPool(Chip8_Pool* pool, size_t count, Chip8_PoolTask task, void* arg);
+
+// Number of hardware threads, at least 1
+size_t      CountCores(void);
+
+#endif
@@ -1,132 +1,94 @@
 #include "Chip8.h"
 
-uint8_t Execute0xF(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t reg_x, uint8_t nn)
-{
-    switch(nn) {
-        case 0x07: cpu->VX[reg_x] = cpu->delay_timer; break;
-        case 0x0a: return reg_x; break;
-        case 0x15: cpu->delay_timer = cpu->VX[reg_x]; break;
-        case 0x18: cpu->sound_timer = cpu->VX[reg_x]; break;
-        case 0x1e: cpu->I += cpu->VX[reg_x]; break;
-        case 0x29: cpu->I = (cpu->VX[reg_x] * 5); break;
-        case 0x33: {
-            mem->ptr_8[cpu->I + 0] = cpu->VX[reg_x] / 100;
-            mem->ptr_8[cpu->I + 1] = cpu->VX[reg_x] / 10 % 10;
-            mem->ptr_8[cpu->I + 2] = cpu->VX[reg_x] % 10;
-        } break;
-        case 0x55: memcpy(mem->ptr_8 + cpu->I, cpu->VX, reg_x + 1); break;
-        case 0x65: memcpy(cpu->VX, mem->ptr_8 + cpu->I, reg_x + 1); break;
-    }
-    return 0xFF;
-}
+// Colors of the XO-CHIP plane combinations, the other variants only ever use the first two
+static const uint32_t screen_palette[4] = { 0x000000FF, 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF };
 
-uint8_t Execute0xE(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t nn, uint8_t reg_x)
+// Scales the dirty rows of the packed screen buffer into the streaming screen texture, rows
+// that did not change since the last upload keep their previous contents. The texture is as
+// large as the screen area of the window, the current mode fills its top left corner
+static void UploadScreen(SDL_Texture* texture, Chip8_Memory* mem, Chip8_Filter filter, uint32_t scale)
 {
-    switch(nn) {
-        case 0x9e: { if(mem->key_states & (0x8000 >> reg_x)) cpu->PC += 2; } break;
-        case 0xa1: { if((mem->key_states & (0x8000 >> reg_x)) == 0) cpu->PC += 2; } break;
-    }
-    return 0;
-}
+    if(mem->dirty_rows == 0)
+        return;
 
-uint8_t Execute0xD(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t reg_x, uint8_t reg_y, uint8_t height)
-{
-    uint16_t pixel_offset = (cpu->VX[reg_y] % 32) * mem->screen_w + (cpu->VX[reg_x] % 64);
-    uint8_t* sprite_addr  = mem->ptr_8 + cpu->I;
-    uint8_t* screen_addr  = mem->screen_buffer + pixel_offset;
-
-    uint8_t collision = 0x00;
-    for(uint8_t row_idx = 0; row_idx < height; row_idx++) {
-        for(uint8_t bit_idx = 0; bit_idx < 8; bit_idx++) {
-            uint8_t sprite_pixel = ((*sprite_addr) & (0x80 >> bit_idx)) != 0;
-
-            collision = (*screen_addr && sprite_pixel) | collision;
-            *screen_addr ^= sprite_pixel;
-            screen_addr++;
-        }
-        screen_addr += mem->screen_w - 8;
-        sprite_addr++;
+    int first = __builtin_ctzll(mem->dirty_rows);
+    int last  = 63 - __builtin_clzll(mem->dirty_rows);
+    if(last >= (int) mem->screen_h)
+        last = mem->screen_h - 1;
+
+    // Smoothing looks at the rows above and below, which are scaled again along with them
+    if(filter != CHIP8_FILTER_NONE) {
+        first = first > 0 ? first - 1 : 0;
+        last  = last + 1 < (int) mem->screen_h ? last + 1 : last;
     }
-    cpu->VX[0x0F] = collision;
-    return 0;
+
+    SDL_Rect rows = { 0, first * (int) scale, (int)(mem->screen_w * scale), (last - first + 1) * (int) scale };
+    void*    pixels;
+    int      pitch;
+    if(SDL_LockTexture(texture, &rows, &pixels, &pitch) != 0)
+        return;
+
+    ScaleScreen(mem, filter, scale, first, last, screen_palette, (uint32_t*) pixels, pitch);
+    SDL_UnlockTexture(texture);
+    mem->dirty_rows = 0;
 }
 
-uint8_t Execute0x8(Chip8_CPU* cpu, uint8_t reg_x, uint8_t reg_y, uint8_t type) 
+#ifdef CHIP8_PROFILE
+// Colors every address by how often it was executed, one texel per address of the 64x64 map.
+// The scale is logarithmic and relative to the hottest address: black, red, yellow, white
+static void UpdateHeatMap(SDL_Texture* texture, const Chip8_Profile* profile)
 {
-    switch(type) {
-        case 0x00: cpu->VX[reg_x]  = cpu->VX[reg_y]; break;
-        case 0x01: cpu->VX[reg_x] |= cpu->VX[reg_y]; break;
-        case 0x02: cpu->VX[reg_x] &= cpu->VX[reg_y]; break;
-        case 0x03: cpu->VX[reg_x] ^= cpu->VX[reg_y]; break;
-        case 0x04: {
-            cpu->VX[0x0F] = (cpu->VX[reg_y] > (255 - cpu->VX[reg_x]));
-            cpu->VX[reg_x] += cpu->VX[reg_y]; 
-        } break;
-        case 0x05: {
-            cpu->VX[0x0F]  = (cpu->VX[reg_x] > cpu->VX[reg_y]);
-            cpu->VX[reg_x] -= cpu->VX[reg_y]; 
-        } break;
-        case 0x06: {
-            cpu->VX[0x0F]  = (cpu->VX[reg_x] & 1);
-            cpu->VX[reg_x] = (cpu->VX[reg_x] >> 1);
-        } break;
-        case 0x07: {
-            cpu->VX[0x0F]  = (cpu->VX[reg_y] > cpu->VX[reg_x]);
-            cpu->VX[reg_x] = (cpu->VX[reg_y] - cpu->VX[reg_x]);
-        } break;
-        case 0x0E: {
-            cpu->VX[0x0F]  = (cpu->VX[reg_x] & 0x80) >> 7;
-            cpu->VX[reg_x] = (cpu->VX[reg_x] << 1);
-        } break;
+    uint64_t hottest = 1;
+    for(size_t addr = 0; addr < 4096; addr++)
+        if(profile->pc_count[addr] > hottest)
+            hottest = profile->pc_count[addr];
+
+    void* pixels;
+    int   pitch;
+    if(SDL_LockTexture(texture, NULL, &pixels, &pitch) != 0)
+        return;
+
+    double scale = 767.0 / log2((double) hottest + 1.0);
+    for(size_t addr = 0; addr < 4096; addr++) {
+        uint32_t  level = (uint32_t)(log2((double) profile->pc_count[addr] + 1.0) * scale);
+        uint32_t  r     = level > 255 ? 255 : level;
+        uint32_t  g     = level > 511 ? 255 : level > 255 ? level - 256 : 0;
+        uint32_t  b     = level > 511 ? level - 512 : 0;
+        uint32_t* dest  = (uint32_t*)((uint8_t*) pixels + (addr / 64) * pitch);
+        dest[addr % 64] = r << 24 | g << 16 | b << 8 | 0xFF;
     }
-    return 0;
+    SDL_UnlockTexture(texture);
 }
+#endif
 
-uint8_t Execute0x0(Chip8_CPU* cpu, Chip8_Memory* mem, uint16_t nnn)
+// Event to first read latencies as bars on a log scale of time, the tallest bar fills the region
+static void DrawLatencyHistogram(SDL_Renderer* renderer, const Chip8_Input* input, const SDL_Rect* region)
 {
-    switch(nnn) {
-        case 0x0E0: memset(mem->screen_buffer, 0x00, mem->screen_w * mem->screen_h); break;
-        case 0x0EE: cpu->PC = mem->ptr_16[cpu->stack_ptr++]; break;
+    uint64_t counts[CHIP8_LATENCY_BUCKETS], most = 1;
+    for(int b = 0; b < CHIP8_LATENCY_BUCKETS; b++) {
+        counts[b] = atomic_load_explicit(&input->histogram[b], memory_order_relaxed);
+        if(counts[b] > most)
+            most = counts[b];
     }
-    return 0;
-}
 
-uint8_t ExecInstruction(Chip8_CPU* cpu, Chip8_Memory* mem)
-{
-    // 'Decode'
-    uint16_t opcode = (cpu->CIR & 0xF000) >> 12; 
-    uint16_t nnn    = (cpu->CIR & 0x0FFF);       // Lower 3 nibbles, typically an address operand
-    uint8_t  nn     = (cpu->CIR & 0x00FF);       // Lower byte, typically a byte literal
-    uint8_t  reg_x  = (cpu->CIR & 0x0F00) >> 8;  // typically a register index
-    uint8_t  reg_y  = (cpu->CIR & 0x00F0) >> 4;  // typically a register index
-    uint8_t  optype = (cpu->CIR & 0x000F);       // nibble which differentiates inst's with same opcode
-
-    uint8_t wait_key = 0xFF;
-
-    // Execute
-    switch(opcode) {
-        case 0x0: Execute0x0(cpu, mem, nnn); break; 
-        case 0x1: cpu->PC = nnn; break;
-        case 0x2: mem->ptr_16[--cpu->stack_ptr] = cpu->PC; cpu->PC = nnn; break;
-        case 0x3: cpu->PC += (2 * (cpu->VX[reg_x] == nn)); break;
-        case 0x4: cpu->PC += (2 * (cpu->VX[reg_x] != nn)); break;
-        case 0x5: cpu->PC += (2 * (cpu->VX[reg_x] == cpu->VX[reg_y])); break;
-        case 0x6: cpu->VX[reg_x]  = nn; break;
-        case 0x7: cpu->VX[reg_x] += nn; break;
-        case 0x8: Execute0x8(cpu, reg_x, reg_y, optype); break;
-        case 0x9: cpu->PC += (2 * (cpu->VX[reg_x] != cpu->VX[reg_y])); break;
-        case 0xa: cpu->I = nnn; break;
-        case 0xb: cpu->PC = nnn + cpu->VX[0]; break;
-        case 0xc: cpu->VX[reg_x] = (rand() % 255) & nn; break;
-        case 0xd: Execute0xD(cpu, mem, reg_x, reg_y, optype); break;
-        case 0xe: Execute0xE(cpu, mem, nn, reg_x); break;
-        case 0xf: wait_key = Execute0xF(cpu, mem, reg_x, nn); break;
-        default: break;
+    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xff);
+    SDL_RenderFillRect(renderer, region);
+    SDL_SetRenderDrawColor(renderer, 0xff, 0xff, 0xff, 0xff);
+    SDL_RenderDrawRect(renderer, region);
+
+    int width = region->w / CHIP8_LATENCY_BUCKETS;
+    for(int b = 0; b < CHIP8_LATENCY_BUCKETS; b++) {
+        SDL_Rect bar;
+        bar.h = (int)((uint64_t)(region->h - 8) * counts[b] / most);
+        bar.w = width - 2;
+        bar.x = region->x + b * width + 1;
+        bar.y = region->y + region->h - 4 - bar.h;
+        SDL_RenderFillRect(renderer, &bar);
     }
-    return wait_key;
 }
 
-void RunProgram(Chip8_CPU* cpu, Chip8_Memory* mem, SDL_Renderer* renderer)
+void RunProgram(Chip8_CPU* cpu, Chip8_Memory* mem, Chip8_Scheduler* sched, SDL_Renderer* renderer,
+                const Chip8_Options* options)
 {
     TTF_Font* display_font = TTF_OpenFont("data/Consolas.ttf", 20);
     Chip8_FontAtlas font_atlas = {};
@@ -140,8 +102,9 @@ void RunProgram(Chip8_CPU* cpu, Chip8_Memory* mem, SDL_Renderer* renderer)
 
     SDL_Texture* screen_texture = SDL_CreateTexture(renderer,
                                                     SDL_PIXELFORMAT_RGBA8888,
-                                                    SDL_TEXTUREACCESS_TARGET,
-                                                    mem->screen_w, mem->screen_h);
+                                                    SDL_TEXTUREACCESS_STREAMING,
+                                                    CHIP8_SCREEN_WIDTH  * options->scale,
+                                                    CHIP8_SCREEN_HEIGHT * options->scale);
     if(screen_texture == NULL) {
         SDL_Log("Error failed to create SDL_Texture: %s\n", SDL_GetError());
         return;
@@ -150,7 +113,7 @@ void RunProgram(Chip8_CPU* cpu, Chip8_Memory* mem, SDL_Renderer* renderer)
     SDL_Texture* info_texture = SDL_CreateTexture(renderer,
                                                   SDL_PIXELFORMAT_RGBA8888,
                                                   SDL_TEXTUREACCESS_TARGET,
-                                                  mem->screen_w * CHIP8_SCREEN_SCALE, 
+                                                  CHIP8_SCREEN_WIDTH * CHIP8_SCREEN_SCALE,
                                                   CHIP8_INFO_REGION_HEIGHT);
     if(info_texture == NULL) {
         SDL_Log("Error failed to create SDL_Texture: %s\n", SDL_GetError());
@@ -160,327 +123,353 @@ void RunProgram(Chip8_CPU* cpu, Chip8_Memory* mem, SDL_Renderer* renderer)
     SDL_Rect display_region;
     display_region.x = 0;
     display_region.y = 0;
-    display_region.w = mem->screen_w * CHIP8_SCREEN_SCALE;
-    display_region.h = mem->screen_h * CHIP8_SCREEN_SCALE;
+    display_region.w = CHIP8_SCREEN_WIDTH  * options->scale;
+    display_region.h = CHIP8_SCREEN_HEIGHT * options->scale;
 
     SDL_Rect info_region, info_region_dest;
     info_region.x = 0;
     info_region.y = 0;
-    info_region.w = display_region.w;
+    info_region.w = CHIP8_SCREEN_WIDTH * CHIP8_SCREEN_SCALE;
     info_region.h = CHIP8_INFO_REGION_HEIGHT;
 
     info_region_dest   = info_region;
     info_region_dest.y = display_region.h;
     info_region_dest.h = CHIP8_INFO_REGION_HEIGHT;
 
+    // The debug panel: surrounding instructions on the left, registers and memory on the right
+    Chip8_DebugPanel panel;
+    if(!InitializePanel(&panel, &font_atlas)) {
+        SDL_Log("Error failed to allocate the debug panel\n");
+        return;
+    }
+
+    SDL_Rect inst_list_region = {};
+    inst_list_region.x = 0;
+    inst_list_region.y = 0;
+    inst_list_region.w = info_region.w >> 1; 
+    inst_list_region.h = info_region.h;
+
+    SDL_Rect data_info_region = {};
+    data_info_region.x = inst_list_region.w;
+    data_info_region.y = 0;
+    data_info_region.w = info_region.w - inst_list_region.w;
+    data_info_region.h = info_region.h;
+
+    Chip8_DisplayContext inst_ctx;
+    inst_ctx.renderer   = renderer;
+    inst_ctx.font       = display_font;
+    inst_ctx.dimensions = inst_list_region;
+    inst_ctx.atlas      = &font_atlas;
+    inst_ctx.panel      = &panel;
+    inst_ctx.first_line = 0;
+
+    Chip8_DisplayContext data_ctx = inst_ctx;
+    data_ctx.dimensions = data_info_region;
+    data_ctx.first_line = 13;   // After the 2 * 6 + 1 instruction lines
+
+#ifdef CHIP8_PROFILE
+    // Execution heat map of the whole memory, H shows it over the right of the data panel
+    SDL_Texture* heat_texture = SDL_CreateTexture(renderer,
+                                                  SDL_PIXELFORMAT_RGBA8888,
+                                                  SDL_TEXTUREACCESS_STREAMING,
+                                                  64, 64);
+    SDL_Rect heat_region;
+    heat_region.w = 256;
+    heat_region.h = 256;
+    heat_region.x = info_region_dest.x + info_region_dest.w - heat_region.w - 8;
+    heat_region.y = info_region_dest.y + (info_region_dest.h - heat_region.h) / 2;
+    bool show_heat = false;
+#endif
+
+    size_t   fps_line       = data_ctx.first_line + 38;
+    uint32_t panel_interval = options->panel_hz ? 1000 / options->panel_hz : 0;
+    uint32_t t_panel        = 0;
+
+    // One state is kept per emulated frame, holding Backspace plays them back in reverse
+    Chip8_Rewind* rewind = NULL;
+    if(options->rewind > 0 && options->recording == NULL) {
+        rewind = CreateRewind(mem, options->rewind * CHIP8_TIMER_HZ, CHIP8_REWIND_BYTES, CHIP8_REWIND_KEYFRAME);
+        if(rewind == NULL)
+            SDL_Log("Error failed to allocate the rewind buffer, rewinding is disabled\n");
+    }
+
+    // While recording, only whole frames are emulated and the keys are latched at the start of
+    // each, the cycles real time is worth beyond the last whole frame wait for the next one.
+    // Otherwise key events reach the program as soon as SDL queues them
+    Chip8_Input input;
+    OpenInput(&input, mem, options->recording == NULL);
+
+    // Input latency, the 99th percentile next to the FPS and the histogram over the instruction
+    // list while L is held down
+    bool     show_latency   = false;
+    size_t   latency_line   = fps_line + 2;
+    SDL_Rect latency_region = { 8, info_region_dest.y + 8, inst_list_region.w - 16, info_region_dest.h - 48 };
+
+    // The emulation thread paces itself on the performance counter, how late its frames were
+    // published (the 99th percentile) is shown next to the input latency
+    Chip8_Pacer pacer;
+    OpenPacer(&pacer);
+    size_t jitter_line = fps_line + 3;
+
+    // The sound timer drives the beeper while emulating in real time, it is muted while
+    // rewinding or fast-forwarding
+    Chip8_Audio audio;
+    bool        has_audio = OpenAudio(&audio, sched->instructions_per_second);
+    if(!has_audio)
+        SDL_Log("Error failed to open the audio device, running without sound: %s\n", SDL_GetError());
+
+    // The screen as last uploaded, only rows that differ from it are uploaded again. Switching
+    // resolutions changes what every row means, so all of them are
+    uint64_t* shown_screen = (uint64_t*) calloc(mem->screen_words, sizeof(uint64_t));
+    uint64_t  shown_dirty  = ~0ULL;
+    uint8_t   shown_hires  = cpu->hires;
+
+    // Emulated time per real time, measured alongside the FPS
+    size_t   speed_line  = fps_line + 1;
+    uint64_t speed_ticks = sched->timer_ticks;
+    uint32_t speed       = 10;     // In tenths
+
+    // From here on the emulation thread owns cpu, mem and sched, this one only reads the frames
+    // it publishes. Frames that come in faster than they can be presented are skipped
+    Chip8_Emulation emulation = {};
+    emulation.cpu     = cpu;
+    emulation.mem     = mem;
+    emulation.sched   = sched;
+    emulation.options = options;
+    emulation.rewind  = rewind;
+    emulation.input   = &input;
+    emulation.pacer   = &pacer;
+    emulation.audio   = has_audio ? &audio : NULL;
+
+    bool is_running = StartEmulation(&emulation);
+    if(!is_running)
+        SDL_Log("Error failed to start the emulation thread: %s\n", SDL_GetError());
+
+    // Fast-forwarded frames come in far faster than the display refreshes, at most one is
+    // presented per refresh period. The period comes from the window's display mode, 60hz if unknown
+    int             refresh_hz = 60;
+    SDL_DisplayMode display_mode;
+    if(SDL_GetWindowDisplayMode(SDL_RenderGetWindow(renderer), &display_mode) == 0 && display_mode.refresh_rate > 0)
+        refresh_hz = display_mode.refresh_rate;
+    uint64_t refresh_period = SDL_GetPerformanceFrequency() / refresh_hz;
+    uint64_t t_present      = 0;
+    bool     unpresented    = false;
+
     SDL_Event event;
-    bool is_running   = true;
-    uint32_t total_elapsed = 0;
 
     uint32_t frames = 0;
     uint32_t total_frames = 0;
     uint32_t start_fps = SDL_GetTicks();
-    while(is_running) {
-        uint32_t t_frame_start = SDL_GetTicks();
+    while(is_running && shown_screen != NULL) {
+        bool               fresh;
+        const Chip8_Frame* frame = TakeFrame(&emulation, &fresh);
 
         if((SDL_GetTicks() - start_fps) >= 1000) {
+            uint32_t elapsed = SDL_GetTicks() - start_fps;
+            speed        = (uint32_t)((frame->timer_ticks - speed_ticks) * 10000 / (CHIP8_TIMER_HZ * elapsed));
+            speed_ticks  = frame->timer_ticks;
             total_frames = frames;
             frames       = 0;
             start_fps    = SDL_GetTicks();
         }
 
-        // Fetch
-        uint8_t* inst_addr = mem->ptr_8 + cpu->PC;
-        uint16_t next_inst = ((uint16_t) inst_addr[0]) << 8 | inst_addr[1];
-        cpu->CIR = next_inst;
-        cpu->PC += 2;
-
-        int16_t signal = ExecInstruction(cpu, mem);
-
-        while(SDL_PollEvent(&event) != 0 || signal != 0xFF) {
+        while(SDL_PollEvent(&event) != 0) {
             if(event.type == SDL_QUIT) { is_running = false; break; }
             if((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)) {
                 int keycode = event.key.keysym.sym;
-                int key_idx = (keycode >= 'a' && keycode <= 'f') ? (keycode - 'a' + 10) :
-                              (keycode >= 'A' && keycode <= 'F') ? (keycode - 'A' + 10) :
-                              (keycode >= '0' && keycode <= '9') ? (keycode - '0') : -1;
-
-                if(key_idx >= 0 && key_idx <= 15) {
-                    if( event.type == SDL_KEYDOWN )
-                        mem->key_states |=  (0x8000 >> key_idx);
-                    else
-                        mem->key_states &= ~(0x8000 >> key_idx);
-                }
-
-                if(signal != 0xFF && key_idx >= 0 && key_idx <= 15) {
-                    cpu->VX[signal] = key_idx;
-                    signal = 0xFF;
-                }
+                if(keycode == SDLK_BACKSPACE)
+                    atomic_store(&emulation.rewinding, event.type == SDL_KEYDOWN);
+                if(keycode == SDLK_TAB)
+                    atomic_store(&emulation.turbo_held, event.type == SDL_KEYDOWN);
+                if(keycode == 'l')
+                    show_latency = (event.type == SDL_KEYDOWN);
+#ifdef CHIP8_PROFILE
+                if(keycode == 'h' && event.type == SDL_KEYDOWN)
+                    show_heat = !show_heat;
+#endif
             }
         }
 
-        // Display the contents of the screen buffer
-        SDL_SetRenderTarget(renderer, screen_texture);
-        SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
-        SDL_RenderClear(renderer);
-
-        for(size_t y = 0; y < mem->screen_h; y++) {
-            for(size_t x = 0; x < mem->screen_w; x++) {
-                uint8_t pixel = mem->screen_buffer[ y * mem->screen_w + x ];
+        // The frame as a memory the display functions can read, dirty where it differs from
+        // what was last uploaded
+        Chip8_CPU    frame_cpu = frame->cpu;
+        Chip8_Memory view      = {};
+        view.ptr_8         = frame->memory;
+        view.screen_buffer = frame->screen;
+        view.memory_size   = mem->memory_size;
+        view.variant       = mem->variant;
+        view.dirty_rows    = shown_dirty | (frame_cpu.hires != shown_hires ? ~0ULL : 0);
+        ApplyScreenMode(&frame_cpu, &view);
+        for(size_t idx = 0; idx < view.screen_words; idx++) {
+            if(frame->screen[idx] != shown_screen[idx]) {
+                shown_screen[idx] = frame->screen[idx];
+                view.dirty_rows  |= 1ULL << ((idx % view.plane_words) / view.row_words & 63);
+            }
+        }
+        shown_dirty = 0;
+        shown_hires = frame_cpu.hires;
+
+        // Display the contents of the screen buffer, only scaled and uploaded when it changed.
+        // 128x64 mode is drawn at half the scale, rounded down, so its pixels stay whole
+        uint32_t scale   = options->scale * CHIP8_SCREEN_WIDTH / view.screen_w;
+        bool     changed = view.dirty_rows != 0 || show_latency;
+        if(scale == 0)
+            scale = 1;
+        UploadScreen(screen_texture, &view, options->filter, scale);
+
+        // Refresh the debug panel at its own rate, it is only drawn again when a line changed
+        uint32_t t_now = SDL_GetTicks();
+        if(panel_interval == 0 || (t_now - t_panel) >= panel_interval) {
+            t_panel = t_now;
+
+            DisplaySurroundingInstructions(&inst_ctx, &frame_cpu, &view, 6);
+            DisplayCPUAndMemoryContents(&data_ctx, &frame_cpu, &view);
+#ifdef CHIP8_PROFILE
+            // The counters are read while the emulation thread updates them, close enough to show
+            if(show_heat && heat_texture != NULL && mem->profile != NULL) {
+                UpdateHeatMap(heat_texture, mem->profile);
+                changed = true;
+            }
+#endif
 
-                if(pixel == 0) continue;
+            if(PanelLineChanged(&panel, fps_line, total_frames)) {
+                char fps_str[16];
+                snprintf(fps_str, 16, "FPS: %d", total_frames);
+                PanelSetLine(&panel, fps_line, info_region.w - 104, info_region.h - 24, fps_str);
+            }
+            if(PanelLineChanged(&panel, speed_line, speed)) {
+                char speed_str[16];
+                snprintf(speed_str, 16, "x%u.%u", speed / 10, speed % 10);
+                PanelSetLine(&panel, speed_line, info_region.w - 200, info_region.h - 24, speed_str);
+            }
 
-                SDL_SetRenderDrawColor(renderer, 0xff, 0xff, 0xff, 0xff);
-                SDL_RenderDrawPoint(renderer, x, y);
+            uint32_t latency = HistogramPercentile(input.histogram, 99);
+            if(PanelLineChanged(&panel, latency_line, latency)) {
+                char latency_str[16] = "";
+                if(latency > 0)
+                    snprintf(latency_str, 16, "in%3u.%ums", latency / 1000, latency % 1000 / 100);
+                PanelSetLine(&panel, latency_line, info_region.w - 330, info_region.h - 24, latency_str);
             }
-        }
 
-        // Display info
-        SDL_SetRenderTarget(renderer, info_texture);
-        SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xff);
-        SDL_RenderClear(renderer);
+            uint32_t jitter = HistogramPercentile(pacer.histogram, 99);
+            if(PanelLineChanged(&panel, jitter_line, jitter)) {
+                char jitter_str[16] = "";
+                if(jitter > 0)
+                    snprintf(jitter_str, 16, "jt%3u.%ums", jitter / 1000, jitter % 1000 / 100);
+                PanelSetLine(&panel, jitter_line, info_region.w - 460, info_region.h - 24, jitter_str);
+            }
 
-        SDL_SetRenderDrawColor(renderer, 0xff, 0xff, 0xff, 0xff);
-        SDL_Rect inst_list_region = {};
-        inst_list_region.x = 0;
-        inst_list_region.y = 0;
-        inst_list_region.w = info_region.w >> 1; 
-        inst_list_region.h = info_region.h;
-
-        {
-            Chip8_DisplayContext ctx;
-            ctx.renderer   = renderer;
-            ctx.font       = display_font;
-            ctx.dimensions = inst_list_region;
-            ctx.atlas      = &font_atlas;
-
-            DisplaySurroundingInstructions(&ctx, cpu, mem, 6);
-        }
+            if(panel.dirty) {
+                SDL_SetRenderTarget(renderer, info_texture);
+                SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xff);
+                SDL_RenderClear(renderer);
 
-        SDL_Rect data_info_region = {};
-        data_info_region.x = inst_list_region.w;
-        data_info_region.y = 0;
-        data_info_region.w = info_region.w - inst_list_region.w;
-        data_info_region.h = info_region.h;
+                PanelRender(&panel, renderer);
 
-        {
-            Chip8_DisplayContext ctx;
-            ctx.renderer   = renderer;
-            ctx.font       = display_font;
-            ctx.dimensions = data_info_region;
-            ctx.atlas      = &font_atlas;
+                SDL_SetRenderDrawColor(renderer, 0xff, 0xff, 0xff, 0xff);
+                SDL_RenderDrawRect(renderer, &inst_list_region);
+                SDL_RenderDrawRect(renderer, &data_info_region);
+                SDL_SetRenderTarget(renderer, NULL);
+                changed = true;
+            }
+        }
 
-            DisplayCPUAndMemoryContents(&ctx, cpu, mem);
+        // While fast-forwarding, a frame that arrives before the next refresh is due is uploaded
+        // but not presented, whichever is newest by then is
+        bool     turbo         = options->turbo != atomic_load(&emulation.turbo_held);
+        uint64_t since_present = SDL_GetPerformanceCounter() - t_present;
+        changed = changed || unpresented;
+        if(changed && turbo && since_present < refresh_period) {
+            unpresented = true;
+            SDL_WaitEventTimeout(NULL, (int)((refresh_period - since_present) * 1000 / SDL_GetPerformanceFrequency()));
+            continue;
         }
 
-        SDL_RenderDrawRect(renderer, &inst_list_region);
-        SDL_RenderDrawRect(renderer, &data_info_region);
-        SDL_SetRenderTarget(renderer, NULL);
+        // Nothing new to show, wait for the next frame, an event or the next panel refresh
+        if(!changed) {
+            uint32_t wait_ms = 1000 / CHIP8_TIMER_HZ;
+            if(panel_interval != 0) {
+                uint32_t since_panel = SDL_GetTicks() - t_panel;
+                wait_ms = since_panel < panel_interval ? panel_interval - since_panel : 1;
+            }
+            atomic_store(&emulation.frame_wanted, true);
+            if((atomic_load(&emulation.middle) & CHIP8_FRAME_FRESH) == 0)
+                SDL_WaitEventTimeout(NULL, (int) wait_ms);
+            continue;
+        }
 
+        SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xff);
+        SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, info_texture, &info_region, &info_region_dest);
-        SDL_RenderCopy(renderer, screen_texture, NULL, &display_region);
-
-        char fps_str[16];
-        snprintf(fps_str, 16, "FPS: %d", total_frames);
-        DrawString(fps_str, info_region.w - 104, display_region.h + info_region.h - 24, &font_atlas, renderer);
+#ifdef CHIP8_PROFILE
+        if(show_heat && heat_texture != NULL)
+            SDL_RenderCopy(renderer, heat_texture, NULL, &heat_region);
+#endif
+        if(show_latency)
+            DrawLatencyHistogram(renderer, &input, &latency_region);
+        // Copied 1:1, centered in the display region when an odd scale leaves 128x64 mode short of it
+        SDL_Rect screen_region = { 0, 0, (int)(view.screen_w * scale), (int)(view.screen_h * scale) };
+        SDL_Rect screen_dest   = screen_region;
+        screen_dest.x = display_region.x + (display_region.w - screen_region.w) / 2;
+        screen_dest.y = display_region.y + (display_region.h - screen_region.h) / 2;
+        SDL_RenderCopy(renderer, screen_texture, &screen_region, &screen_dest);
 
         SDL_RenderPresent(renderer);
-
-        uint32_t t_frame_end = SDL_GetTicks();
-        uint32_t t_frame_dur = t_frame_end - t_frame_start;
-        total_elapsed += t_frame_dur;
-
-        if(total_elapsed >= CHIP8_TIMER_PERIOD) {
-            if(cpu->delay_timer)
-                cpu->delay_timer = min(0, cpu->delay_timer - floor(total_elapsed / CHIP8_TIMER_PERIOD));
-
-            if(cpu->sound_timer) {
-                cpu->sound_timer = min(0, cpu->delay_timer - floor(total_elapsed / CHIP8_TIMER_PERIOD));
-            }
-            total_elapsed = 0;
-        }
+        t_present   = SDL_GetPerformanceCounter();
+        unpresented = false;
         frames++;
     }
+    StopEmulation(&emulation);
+    free(shown_screen);
+
+    CloseInput(&input);
+    LogHistogram("Input latency", input.histogram);
+    LogHistogram("Frame jitter", pacer.histogram);
+
+    if(has_audio)
+        CloseAudio(&audio);
+    DestroyRewind(rewind);
+#ifdef CHIP8_PROFILE
+    if(heat_texture != NULL)
+        SDL_DestroyTexture(heat_texture);
+#endif
+    FreePanel(&panel);
     SDL_DestroyTexture(font_atlas.texture);
     SDL_DestroyTexture(screen_texture);
     SDL_DestroyTexture(info_texture);
     TTF_CloseFont(display_font);
 }
 
-void Initialize(const uint8_t* program, const size_t size, Chip8_CPU* cpu, Chip8_Memory* mem)
-{
-    // Initialize memory
-    mem->memory_size  = 4096;
-    mem->screen_w     = CHIP8_SCREEN_WIDTH;
-    mem->screen_h     = CHIP8_SCREEN_HEIGHT;
-    mem->stack_size   = 24; // 2 bytes per address, means 12 successive function calls
-
-    // Allocate the memory
-    cpu->stack_ptr    = mem->memory_size >> 1;
-
-    memset(mem->ptr_8,   0x00, mem->memory_size);
-    memset(mem->screen_buffer, 0x00, mem->screen_w * mem->screen_h);
-
-    // Write the system font
-    uint8_t system_font[16][5] = {
-        { 0xF0, 0x90, 0x90, 0x90, 0xF0 }, { 0x20, 0x60, 0x20, 0x20, 0x70 }, // 0, 1
-        { 0xF0, 0x10, 0xF0, 0x80, 0xF0 }, { 0xF0, 0x10, 0xF0, 0x10, 0xF0 }, // 2, 3 
-        { 0x90, 0x90, 0xF0, 0x10, 0x10 }, { 0xF0, 0x80, 0xF0, 0x10, 0xF0 }, // 4, 5
-        { 0xF0, 0x80, 0xF0, 0x90, 0xF0 }, { 0xF0, 0x10, 0x20, 0x40, 0x40 }, // 6, 7
-        { 0xF0, 0x90, 0xF0, 0x90, 0xF0 }, { 0xF0, 0x90, 0xF0, 0x10, 0xF0 }, // 8, 9
-        { 0xF0, 0x90, 0xF0, 0x90, 0x90 }, { 0xE0, 0x90, 0xE0, 0x90, 0xE0 }, // A, B
-        { 0xF0, 0x80, 0x80, 0x80, 0xF0 }, { 0xE0, 0x90, 0x90, 0x90, 0xE0 }, // C, D
-        { 0xF0, 0x80, 0xF0, 0x80, 0xF0 }, { 0xF0, 0x80, 0xF0, 0x80, 0x80 }, // E, F
-    };
-    memcpy(mem->ptr_8, system_font, 16 * 5);
-
-    // Chip-8 Programs are specified to start at 0x200
-    memcpy(mem->ptr_8 + 0x200, program, size);
-
-    // Initialize the CPU
-    memset(cpu->VX, 0x00, 16);   // zero-initialize the registers
-    cpu->PC = 0x200;
-    cpu->I  = 0x00;
-    cpu->delay_timer = 0x00;
-}
-
-inline uint16_t LittleToBigEndianU16(const uint16_t val)
-{
-    return ((val & 0xFF) << 8) | ((val & 0xFF00) >> 8);
-}
-
-uint8_t min(uint8_t val, uint8_t val2)
-{
-    return val < val2 ? val : val2;
-}
-
-// TODO: Cleanup
+// Appends the disassembly to 'buffer', which has room for n more characters including the NUL
 void Chip8_Concat_Disassembly(char* buffer, size_t n, uint16_t instr)
 {
-    char instr_disassembly[1024] = {};
-
-    uint16_t opcode = (instr & 0xF000) >> 12; 
-    uint16_t nnn    = (instr & 0x0FFF);       // Lower 3 nibbles, typically an address operand
-    uint8_t  nn     = (instr & 0x00FF);       // Lower byte, typically a byte literal
-    uint8_t  reg_x  = (instr & 0x0F00) >> 8;  // typically a register index
-    uint8_t  reg_y  = (instr & 0x00F0) >> 4;  // typically a register index
-    uint8_t  optype = (instr & 0x000F);       // nibble which differentiates inst's with same opcode
-
-    switch(opcode) {
-        case 0x0: {
-            switch(nnn) {
-                case 0x0E0: snprintf(instr_disassembly, n, "cls"); break;
-                case 0x0EE: snprintf(instr_disassembly, n, "ret"); break;
-            }
-        } break; 
-        case 0x1: snprintf(instr_disassembly, n, "jmp 0x%03x", nnn);                 break;
-        case 0x2: snprintf(instr_disassembly, n, "call 0x%03x", nnn);                break;
-        case 0x3: snprintf(instr_disassembly, n, "skipeq v%x, 0x%02x", reg_x, nn);   break;
-        case 0x4: snprintf(instr_disassembly, n, "skipneq v%x, 0x%02x", reg_x, nn);  break;
-        case 0x5: snprintf(instr_disassembly, n, "skipeq v%x, v%x", reg_x, reg_y); break;
-        case 0x6: snprintf(instr_disassembly, n, "mov v%x, 0x%02x", reg_x, nn);        break;
-        case 0x7: snprintf(instr_disassembly, n, "add v%x, v%x", reg_x, reg_y);    break;
-        case 0x8: {
-            switch(optype) {
-                case 0x00: snprintf(instr_disassembly, n, "mov v%x, v%x", reg_x, reg_y); break;
-                case 0x01: snprintf(instr_disassembly, n, "or v%x, v%x", reg_x, reg_y); break;
-                case 0x02: snprintf(instr_disassembly, n, "and v%x, v%x", reg_x, reg_y); break;
-                case 0x03: snprintf(instr_disassembly, n, "xor v%x, v%x", reg_x, reg_y); break;
-                case 0x04: snprintf(instr_disassembly, n, "addsc v%x, v%x", reg_x, reg_y); break;
-                case 0x05: snprintf(instr_disassembly, n, "subsc v%x, v%x", reg_x, reg_y); break;
-                case 0x06: snprintf(instr_disassembly, n, "shr v%x", reg_x); break;
-                case 0x07: snprintf(instr_disassembly, n, "subn v%x, v%x", reg_x, reg_y); break;
-                case 0x0E: snprintf(instr_disassembly, n, "shl v%x", reg_x); break;
-            }
-        } break;
-        case 0x9: snprintf(instr_disassembly, n, "skipneq v%x, v%x", reg_x, reg_y);  break;
-        case 0xa: snprintf(instr_disassembly, n, "mov I, 0x%03x", nnn);  break;
-        case 0xb: snprintf(instr_disassembly, n, "jmp v0, 0x%03x", nnn);  break;
-        case 0xc: snprintf(instr_disassembly, n, "rnd v%x, 0x%02x", reg_x, nn);  break;
-        case 0xd: snprintf(instr_disassembly, n, "drw v%x, v%x, 0x%02x", reg_x, reg_y, optype);  break;
-        case 0xe: {
-            switch(nn) {
-                case 0x9e: snprintf(instr_disassembly, n, "skp v%x", reg_x);  break;
-                case 0xa1: snprintf(instr_disassembly, n, "sknp v%x", reg_x); break;
-            }
-        }  break;
-        case 0xf: {
-            switch(nn) {
-                case 0x07: snprintf(instr_disassembly, n, "mov dt, v%02x", reg_x); break;
-                case 0x0a: snprintf(instr_disassembly, n, "intk v%x", reg_x); break;
-                case 0x15: snprintf(instr_disassembly, n, "mov dt, v%x", reg_x); break;
-                case 0x18: snprintf(instr_disassembly, n, "mov st, v%x", reg_x); break;
-                case 0x1e: snprintf(instr_disassembly, n, "add I, v%x", reg_x); break;
-                case 0x29: snprintf(instr_disassembly, n, "lds v%x", reg_x); break;
-                case 0x33: snprintf(instr_disassembly, n, "bcd v%x", reg_x); break;
-                case 0x55: snprintf(instr_disassembly, n, "mov [I], v%x", reg_x); break;
-                case 0x65: snprintf(instr_disassembly, n, "mov v%x, [I]", reg_x); break;
-            }
-        } break;
-        default: break;
-    }
-    strncat (buffer, instr_disassembly, n);
+    if(n > 0)
+        snprintf(buffer + strlen(buffer), n, "%s", DisassembleInstruction(instr));
 }
 
 void DisplaySurroundingInstructions(Chip8_DisplayContext* ctx, Chip8_CPU *cpu, 
                                     Chip8_Memory *mem, int N) 
 {
-    //SDL_Color c = { 0xff, 0xff, 0xff, 0xff };
-    char output_line[1024];
-
-    SDL_SetRenderDrawColor(ctx->renderer, 0x00, 0x00, 0x00, 0xff);
-    SDL_RenderClear(ctx->renderer);
+    char output_line[CHIP8_PANEL_LINE_LEN];
 
-    SDL_SetRenderDrawColor(ctx->renderer, 0xff, 0xff, 0xff, 0xff);
     for(int idx = -N; idx < N + 1; idx++) {
+        size_t    line      = ctx->first_line + idx + N;
+        uint16_t  addr      = cpu->PC + ((idx + 1) * 2);
         uint16_t* inst_addr = (uint16_t*)(mem->ptr_8 + cpu->PC) + idx + 1;
         uint16_t  instr     = LittleToBigEndianU16(*inst_addr);
 
-        int n = snprintf(output_line, 1024, 
-                         "%s 0x%0x 0x%04x ", idx == -2 ? ">" : " ", cpu->PC + ((idx + 1) * 2), instr);
-
-        Chip8_Concat_Disassembly(output_line, 1024 - n, instr);
-        
-        int running_x = 10;
-
-        for(char* c = output_line; *c != '\0'; c++) { 
-            SDL_Rect* glyph_source = &ctx->atlas->glyph_rects[*c - ' '];
-            SDL_Rect  glyph_dest   = *glyph_source;
-
-            glyph_dest.x = running_x;
-            glyph_dest.w = glyph_source->w;
-            glyph_dest.h = glyph_source->h;
-            glyph_dest.y = 10 + (idx + N) * 19;
+        // The marker only ever sits on the same line, so the address and instruction are the key
+        if(!PanelLineChanged(ctx->panel, line, ((uint64_t) addr << 16) | instr))
+            continue;
 
-            running_x += glyph_source->w;
-            SDL_RenderCopy(ctx->renderer, ctx->atlas->texture, glyph_source, &glyph_dest);            
-        }
+        int n = snprintf(output_line, sizeof(output_line),
+                         "%s 0x%0x 0x%04x ", idx == -1 ? ">" : " ", addr, instr);
 
-        // TODO: keep this for now for future testing
-        //SDL_Surface* text_surface = TTF_RenderText_Solid(ctx->font, output_line, c);
-        //if(text_surface != NULL) {
-        //    SDL_Texture* text_texture = SDL_CreateTextureFromSurface(ctx->renderer, text_surface);
-
-        //    SDL_Rect text_rect;
-        //    text_rect.x = 10;
-        //    text_rect.y = 10 + ((idx + N) * 19);
-        //    text_rect.w = text_surface->w;
-        //    text_rect.h = text_surface->h;
-
-        //    if(text_texture != NULL) {
-        //        SDL_RenderCopy(ctx->renderer, text_texture, NULL, &text_rect);
-        //        SDL_DestroyTexture(text_texture);
-        //    }
-        //    SDL_FreeSurface(text_surface);
-        //}
+        Chip8_Concat_Disassembly(output_line, sizeof(output_line) - n, instr);
+        PanelSetLine(ctx->panel, line, 10, 10 + (idx + N) * 19, output_line);
     }
 }
 
-size_t max(size_t val, size_t val2)
-{
-    return val > val2 ? val : val2;
-}
-
 // TODO: Assume monospaced fonts for now...
 void ConstructFontAtlas(Chip8_FontAtlas* atlas, TTF_Font* font, SDL_Renderer* renderer)
 {
@@ -553,44 +542,136 @@ void DrawString(const char* str, const int x, const int y, Chip8_FontAtlas* atla
 
 }
 
+// Formats and lays out a single panel line, only when the value it displays changed
+#define PANEL_LINE(ctx, line, x, y, key, ...) do {                                \
+        if(PanelLineChanged((ctx)->panel, (line), (key))) {                      \
+            char line_str[CHIP8_PANEL_LINE_LEN];                                 \
+            snprintf(line_str, sizeof(line_str), __VA_ARGS__);                  \
+            PanelSetLine((ctx)->panel, (line), (x), (y), line_str);             \
+        }                                                                        \
+    } while(0)
+
 void DisplayCPUAndMemoryContents(Chip8_DisplayContext* ctx, Chip8_CPU* cpu, Chip8_Memory* mem)
 {
-    char register_str[16];
-    for(int i = 0; i < 16; i++) {
+    size_t line = ctx->first_line;
+    int    left = ctx->dimensions.x + 12;
+    int    col  = ctx->dimensions.w / 4;
 
-        int x = ctx->dimensions.x + ((i % 4) * ctx->dimensions.w / 4) + 12;
+    for(int i = 0; i < 16; i++, line++) {
+        int x = ctx->dimensions.x + ((i % 4) * col) + 12;
         int y = ctx->dimensions.y + ((i / 4) * 20) + 8;
 
-        snprintf(register_str, 16, "v%x: 0x%02x", i, cpu->VX[i]);
-        DrawString(register_str, x, y, ctx->atlas, ctx->renderer);
+        PANEL_LINE(ctx, line, x, y, cpu->VX[i], "v%x: 0x%02x", i, cpu->VX[i]);
     }
 
-    // TODO: cleanup
-    snprintf(register_str, 16, "dt: 0x%02x", cpu->delay_timer);
-    DrawString(register_str, ctx->dimensions.x + 12, 88, ctx->atlas, ctx->renderer);
+    PANEL_LINE(ctx, line++, left,           88,  cpu->delay_timer, "dt: 0x%02x", cpu->delay_timer);
+    PANEL_LINE(ctx, line++, left + col,     88,  cpu->sound_timer, "st: 0x%02x", cpu->sound_timer);
+    PANEL_LINE(ctx, line++, left + 2 * col, 88,  cpu->I,           "I : 0x%02x", cpu->I);
+    PANEL_LINE(ctx, line++, left + 3 * col, 88,  cpu->PC,          "PC: 0x%02x", cpu->PC);
+    PANEL_LINE(ctx, line++, left,           108, cpu->CIR,         "IR: 0x%04x", cpu->CIR);
+    PANEL_LINE(ctx, line++, left + col,     108, cpu->stack_ptr,   "SP: 0x%02x", cpu->stack_ptr);
 
-    snprintf(register_str, 16, "st: 0x%02x", cpu->sound_timer);
-    DrawString(register_str, ctx->dimensions.x + (ctx->dimensions.w / 4) + 12, 88, ctx->atlas, ctx->renderer);
+    for(int i = 0; i < 16; i++, line++) {
+        int x = ctx->dimensions.x + ((i % 4) * col) + 8;
+        int y = ctx->dimensions.y + 148 + ((i / 4) * 20) + 8;
 
-    snprintf(register_str, 16, "I : 0x%02x", cpu->I);
-    DrawString(register_str, ctx->dimensions.x + (2 * ctx->dimensions.w / 4) + 12, 88, ctx->atlas, ctx->renderer);
+        if((size_t)(cpu->I + i) >= mem->memory_size) {
+            PANEL_LINE(ctx, line, x, y, UINT64_MAX - 1, "%s", "");
+            continue;
+        }
+        PANEL_LINE(ctx, line, x, y, mem->ptr_8[cpu->I + i], "[%2d]:0x%02x", i, mem->ptr_8[cpu->I + i]);
+    }
+}
 
-    snprintf(register_str, 16, "PC: 0x%02x", cpu->PC);
-    DrawString(register_str, ctx->dimensions.x + (3 * ctx->dimensions.w / 4) + 12, 88, ctx->atlas, ctx->renderer);
+#undef PANEL_LINE
 
-    snprintf(register_str, 16, "IR: 0x%04x", cpu->CIR);
-    DrawString(register_str, ctx->dimensions.x + 12, 108, ctx->atlas, ctx->renderer);
+bool InitializePanel(Chip8_DebugPanel* panel, Chip8_FontAtlas* atlas)
+{
+    size_t quads = CHIP8_PANEL_MAX_LINES * CHIP8_PANEL_LINE_LEN;
 
-    snprintf(register_str, 16, "SP: 0x%04x", cpu->stack_ptr << 1);
-    DrawString(register_str, ctx->dimensions.x + (ctx->dimensions.w / 4) + 12, 108, ctx->atlas, ctx->renderer);
+    memset(panel, 0x00, sizeof(Chip8_DebugPanel));
+    panel->atlas    = atlas;
+    panel->vertices = (SDL_Vertex*) calloc(quads * 4, sizeof(SDL_Vertex));
+    panel->indices  = (int*) malloc(quads * 6 * sizeof(int));
 
-    for(int i = 0; i < 16; i++) {
-        if(mem->ptr_8 + cpu->I + i > mem->ptr_8 + mem->memory_size)
-            break;
-        int x = ctx->dimensions.x + ((i % 4) * ctx->dimensions.w / 4) + 8;
-        int y = ctx->dimensions.y + 148 + ((i / 4) * 20) + 8;
+    if(panel->vertices == NULL || panel->indices == NULL) {
+        FreePanel(panel);
+        return false;
+    }
+
+    // Two triangles per quad, the vertices of unused quads stay collapsed at the origin
+    for(size_t q = 0; q < quads; q++) {
+        int* idx = panel->indices + q * 6;
+        int  v   = q * 4;
+        idx[0] = v + 0; idx[1] = v + 1; idx[2] = v + 2;
+        idx[3] = v + 2; idx[4] = v + 1; idx[5] = v + 3;
+    }
+    for(size_t line = 0; line < CHIP8_PANEL_MAX_LINES; line++)
+        panel->lines[line].key = UINT64_MAX;
+    return true;
+}
+
+void FreePanel(Chip8_DebugPanel* panel)
+{
+    free(panel->vertices);
+    free(panel->indices);
+    panel->vertices = NULL;
+    panel->indices  = NULL;
+}
 
-        snprintf(register_str, 16, "[%2d]:0x%02x", i, mem->ptr_8[cpu->I + i]);
-        DrawString(register_str, x, y, ctx->atlas, ctx->renderer);
+// Returns whether the line needs to be formatted again, remembering key for the next call
+bool PanelLineChanged(Chip8_DebugPanel* panel, size_t line, uint64_t key)
+{
+    if(line >= CHIP8_PANEL_MAX_LINES || panel->lines[line].key == key)
+        return false;
+    panel->lines[line].key = key;
+    return true;
+}
+
+// Lays out the glyph quads of a line, nothing is touched when the text did not change
+void PanelSetLine(Chip8_DebugPanel* panel, size_t line, int x, int y, const char* text)
+{
+    if(line >= CHIP8_PANEL_MAX_LINES)
+        return;
+
+    Chip8_PanelLine* pl = &panel->lines[line];
+    if(strncmp(pl->text, text, CHIP8_PANEL_LINE_LEN - 1) == 0)
+        return;
+
+    strncpy(pl->text, text, CHIP8_PANEL_LINE_LEN - 1);
+    pl->text[CHIP8_PANEL_LINE_LEN - 1] = '\0';
+
+    Chip8_FontAtlas* atlas    = panel->atlas;
+    SDL_Vertex*      quad     = panel->vertices + line * CHIP8_PANEL_LINE_LEN * 4;
+    SDL_Color        white    = { 0xff, 0xff, 0xff, 0xff };
+    float            inv_w    = 1.0f / atlas->atlas_w;
+    float            inv_h    = 1.0f / atlas->atlas_h;
+    float            running_x = x;
+
+    memset(quad, 0x00, CHIP8_PANEL_LINE_LEN * 4 * sizeof(SDL_Vertex));
+    for(const char* c = pl->text; *c != '\0'; c++, quad += 4) {
+        if((unsigned char)(*c - ' ') >= NUM_GLYPHS)
+            continue;
+
+        SDL_Rect* glyph = &atlas->glyph_rects[*c - ' '];
+        float u0 = glyph->x * inv_w, u1 = (glyph->x + glyph->w) * inv_w;
+        float v0 = glyph->y * inv_h, v1 = (glyph->y + glyph->h) * inv_h;
+
+        quad[0] = (SDL_Vertex) { { running_x,            y            }, white, { u0, v0 } };
+        quad[1] = (SDL_Vertex) { { running_x + glyph->w, y            }, white, { u1, v0 } };
+        quad[2] = (SDL_Vertex) { { running_x,            y + glyph->h }, white, { u0, v1 } };
+        quad[3] = (SDL_Vertex) { { running_x + glyph->w, y + glyph->h }, white, { u1, v1 } };
+        running_x += glyph->w;
     }
+    panel->num_lines = max(panel->num_lines, line + 1);
+    panel->dirty     = true;
+}
+
+// Draws every line of the panel with a single SDL_RenderGeometry call
+void PanelRender(Chip8_DebugPanel* panel, SDL_Renderer* renderer)
+{
+    int quads = panel->num_lines * CHIP8_PANEL_LINE_LEN;
+
+    SDL_RenderGeometry(renderer, panel->atlas->texture, panel->vertices, quads * 4, panel->indices, quads * 6);
+    panel->dirty = false;
 }
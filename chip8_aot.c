@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Chip8_Core.h"
+
+// Ahead-of-time recompiler: translates a ROM into C for the static engine (chip8_static.c).
+//
+//   chip8_aot <rom> [-variant chip8|schip] [-o FILE]
+//
+// Code is found by following control flow from 0x200, decoding instructions the way
+// ExecInstruction does. Every address reached becomes the start of a basic block, which ends
+// at the first instruction that can change the PC (or after CHIP8_STATIC_BLOCK instructions)
+// and is emitted as one C function. The target of a Bnnn jump depends on V0, so a block is
+// started at every even offset from nnn within the ROM and the jump goes through the dispatch
+// table. Whatever the walk does not reach, and anything the program writes over at run time,
+// is left to the interpreter.
+//
+// The output (stdout unless -o is given) defines chip8_static_program. Compiled and linked
+// together with chip8_headless.c and libchip8core.a it gives a runner for which -engine static
+// executes the ROM natively. XO-CHIP's 64KB of memory is always interpreted, it has no
+// translation
+
+typedef struct {
+    uint16_t length;        // Instructions in the block, 0 where none starts
+    bool     uses_st;
+    bool     uses_mem;
+} Aot_Block;
+
+typedef struct {
+    const uint8_t* rom;
+    size_t         rom_size;
+    Chip8_Variant  variant;
+    Aot_Block      blocks[CHIP8_DECODE_SLOTS];
+    uint16_t       queue[CHIP8_DECODE_SLOTS];
+    size_t         num_queued;
+    bool           queued[CHIP8_DECODE_SLOTS];
+} Aot_Program;
+
+static bool InROM(const Aot_Program* prog, uint32_t addr)
+{
+    return addr >= 0x200 && addr + 2 <= 0x200 + prog->rom_size && addr + 2 <= CHIP8_DECODE_SLOTS;
+}
+
+static uint16_t InstructionOf(const Aot_Program* prog, uint32_t addr)
+{
+    return (uint16_t)(prog->rom[addr - 0x200] << 8 | prog->rom[addr - 0x200 + 1]);
+}
+
+static void Enqueue(Aot_Program* prog, uint32_t addr)
+{
+    if(!InROM(prog, addr) || prog->queued[addr])
+        return;
+    prog->queued[addr]                 = true;
+    prog->queue[prog->num_queued++] = (uint16_t) addr;
+}
+
+// True for instructions after which the next one is not necessarily the next to run
+static bool EndsBlock(const Aot_Program* prog, uint16_t instr)
+{
+    switch(instr >> 12) {
+        case 0x0: return instr == 0x00EE || (instr == 0x00FD && prog->variant != CHIP8_VARIANT_CHIP8);
+        case 0x1: case 0x2: case 0x3: case 0x4: case 0x5: case 0x9: case 0xb: return true;
+        case 0xe: return (instr & 0xFF) == 0x9e || (instr & 0xFF) == 0xa1;
+        case 0xf: return (instr & 0xFF) == 0x0a;
+    }
+    return false;
+}
+
+// Finds the extent of the block at addr and queues the addresses it can continue at
+static void WalkBlock(Aot_Program* prog, uint16_t start)
+{
+    uint16_t addr   = start;
+    uint16_t length = 0;
+
+    while(InROM(prog, addr) && length < CHIP8_STATIC_BLOCK) {
+        uint16_t instr = InstructionOf(prog, addr);
+        uint16_t nnn   = instr & 0x0FFF;
+        length++;
+
+        if(!EndsBlock(prog, instr)) {
+            addr += 2;
+            continue;
+        }
+        switch(instr >> 12) {
+            case 0x1: Enqueue(prog, nnn); break;
+            case 0x2: Enqueue(prog, nnn); Enqueue(prog, addr + 2); break;    // 00EE comes back to addr + 2
+            case 0xb: {
+                for(uint32_t offset = 0; offset < 256; offset += 2)
+                    Enqueue(prog, nnn + offset);
+            } break;
+            case 0x3: case 0x4: case 0x5: case 0x9: case 0xe:
+                Enqueue(prog, addr + 2);
+                Enqueue(prog, addr + 4);
+                break;
+            case 0xf: Enqueue(prog, addr + 2); break;
+        }
+        prog->blocks[start].length = length;
+        return;
+    }
+
+    prog->blocks[start].length = length;
+    Enqueue(prog, addr);
+}
+
+// Writes the statements of one instruction, the ones that end the block return from it
+static void EmitInstruction(FILE* out, const Aot_Program* prog, Aot_Block* block, uint16_t addr,
+                            uint16_t instr, uint32_t count, bool last)
+{
+    uint16_t nnn  = instr & 0x0FFF;
+    uint8_t  nn   = instr & 0x00FF;
+    uint8_t  x    = (instr & 0x0F00) >> 8;
+    uint8_t  y    = (instr & 0x00F0) >> 4;
+    uint8_t  n    = instr & 0x000F;
+    uint16_t next = addr + 2;
+    bool     ends = true;
+
+    fprintf(out, "    // 0x%03x  %s\n", addr, DisassembleInstruction(instr));
+    switch(instr >> 12) {
+        case 0x0: {
+            if(instr == 0x00EE) {
+                fprintf(out, "    cpu->stack_ptr = (cpu->stack_ptr - 1) & (CHIP8_STACK_DEPTH - 1);\n");
+                fprintf(out, "    cpu->PC = cpu->stack[cpu->stack_ptr];\n");
+                break;
+            }
+            fprintf(out, "    cpu->PC = 0x%03x;\n", next);
+            fprintf(out, "    Execute0x0(cpu, mem, 0x%03x);\n", nnn);
+            block->uses_mem = true;
+            ends = EndsBlock(prog, instr);
+        } break;
+        case 0x1: fprintf(out, "    cpu->PC = 0x%03x;\n", nnn); break;
+        case 0x2: {
+            fprintf(out, "    cpu->stack[cpu->stack_ptr] = 0x%03x;\n", next);
+            fprintf(out, "    cpu->stack_ptr = (cpu->stack_ptr + 1) & (CHIP8_STACK_DEPTH - 1);\n");
+            fprintf(out, "    cpu->PC = 0x%03x;\n", nnn);
+        } break;
+        case 0x3: fprintf(out, "    cpu->PC = V[%d] == 0x%02x ? 0x%03x : 0x%03x;\n", x, nn, next + 2, next); break;
+        case 0x4: fprintf(out, "    cpu->PC = V[%d] != 0x%02x ? 0x%03x : 0x%03x;\n", x, nn, next + 2, next); break;
+        // A register compared with itself always skips (5xx0) or never does (9xx0)
+        case 0x5: {
+            if(x == y) fprintf(out, "    cpu->PC = 0x%03x;\n", next + 2);
+            else       fprintf(out, "    cpu->PC = V[%d] == V[%d] ? 0x%03x : 0x%03x;\n", x, y, next + 2, next);
+        } break;
+        case 0x9: {
+            if(x == y) fprintf(out, "    cpu->PC = 0x%03x;\n", next);
+            else       fprintf(out, "    cpu->PC = V[%d] != V[%d] ? 0x%03x : 0x%03x;\n", x, y, next + 2, next);
+        } break;
+        case 0x6: fprintf(out, "    V[%d] = 0x%02x;\n", x, nn); ends = false; break;
+        case 0x7: fprintf(out, "    V[%d] += 0x%02x;\n", x, nn); ends = false; break;
+        case 0x8: {
+            // The same statements, in the same order, as Execute0x8
+            switch(n) {
+                case 0x0: fprintf(out, "    V[%d] = V[%d];\n", x, y); break;
+                case 0x1: fprintf(out, "    V[%d] |= V[%d];\n", x, y); break;
+                case 0x2: fprintf(out, "    V[%d] &= V[%d];\n", x, y); break;
+                case 0x3: fprintf(out, "    V[%d] ^= V[%d];\n", x, y); break;
+                case 0x4: fprintf(out, "    V[15] = V[%d] > (255 - V[%d]);\n    V[%d] += V[%d];\n", y, x, x, y); break;
+                case 0x5: fprintf(out, "    V[15] = V[%d] > V[%d];\n    V[%d] -= V[%d];\n", x, y, x, y); break;
+                case 0x6: fprintf(out, "    V[15] = V[%d] & 1;\n    V[%d] = V[%d] >> 1;\n", x, x, x); break;
+                case 0x7: fprintf(out, "    V[15] = V[%d] > V[%d];\n    V[%d] = V[%d] - V[%d];\n", y, x, x, y, x); break;
+                case 0xe: fprintf(out, "    V[15] = (V[%d] & 0x80) >> 7;\n    V[%d] = V[%d] << 1;\n", x, x, x); break;
+            }
+            ends = false;
+        } break;
+        case 0xa: fprintf(out, "    cpu->I = 0x%03x;\n", nnn); ends = false; break;
+        case 0xb: fprintf(out, "    cpu->PC = 0x%03x + V[0];\n", nnn); break;
+        case 0xc: fprintf(out, "    V[%d] = (NextRandom(cpu) %% 255) & 0x%02x;\n", x, nn); ends = false; break;
+        case 0xd: {
+            fprintf(out, "    Execute0xD(cpu, mem, %d, %d, %d);\n", x, y, n);
+            block->uses_mem = true;
+            ends = false;
+        } break;
+        case 0xe: {
+            if(nn == 0x9e || nn == 0xa1) {
+                fprintf(out, "    cpu->PC = (ReadKeys(mem) & 0x%04x) %s 0 ? 0x%03x : 0x%03x;\n",
+                        0x8000 >> x, nn == 0x9e ? "!=" : "==", next + 2, next);
+                block->uses_mem = true;
+            } else
+                ends = false;
+        } break;
+        case 0xf: {
+            ends = false;
+            switch(nn) {
+                case 0x07: fprintf(out, "    V[%d] = cpu->delay_timer;\n", x); break;
+                case 0x15: fprintf(out, "    cpu->delay_timer = V[%d];\n", x); break;
+                case 0x18: fprintf(out, "    cpu->sound_timer = V[%d];\n", x); break;
+                case 0x1e: fprintf(out, "    cpu->I += V[%d];\n", x); break;
+                case 0x29: fprintf(out, "    cpu->I = V[%d] * 5;\n", x); break;
+                case 0x65: {
+                    fprintf(out, "    for(int k = 0; k <= %d; k++)\n", x);
+                    fprintf(out, "        V[k] = mem->ptr_8[(cpu->I + k) & (CHIP8_DECODE_SLOTS - 1)];\n");
+                    block->uses_mem = true;
+                } break;
+                case 0x0a: {
+                    fprintf(out, "    cpu->PC = 0x%03x;\n", next);
+                    fprintf(out, "    cpu->wait_key_reg  = %d;\n", x);
+                    fprintf(out, "    cpu->wait_key_prev = ReadKeys(mem);\n");
+                    block->uses_mem = true;
+                    ends = true;
+                } break;
+                case 0x33: case 0x55: {
+                    // Writing over translated code makes it stale, including possibly the rest
+                    // of this block
+                    fprintf(out, "    Execute0xF(cpu, mem, %d, 0x%02x);\n", x, nn);
+                    if(!last) {
+                        fprintf(out, "    if(InvalidateStatic(st, cpu->I, %d)) {\n", nn == 0x33 ? 3 : x + 1);
+                        fprintf(out, "        cpu->PC  = 0x%03x;\n", next);
+                        fprintf(out, "        cpu->CIR = 0x%04x;\n", instr);
+                        fprintf(out, "        return %u;\n    }\n", count);
+                    } else
+                        fprintf(out, "    InvalidateStatic(st, cpu->I, %d);\n", nn == 0x33 ? 3 : x + 1);
+                    block->uses_st  = true;
+                    block->uses_mem = true;
+                } break;
+                case 0x30: case 0x75: case 0x85: {
+                    if(prog->variant != CHIP8_VARIANT_CHIP8) {
+                        fprintf(out, "    Execute0xF(cpu, mem, %d, 0x%02x);\n", x, nn);
+                        block->uses_mem = true;
+                    }
+                } break;
+            }
+        } break;
+    }
+
+    if(ends || last) {
+        if(!ends)
+            fprintf(out, "    cpu->PC = 0x%03x;\n", next);
+        fprintf(out, "    cpu->CIR = 0x%04x;\n", instr);
+        fprintf(out, "    return %u;\n", count);
+    }
+}
+
+static bool EmitBlock(FILE* out, const Aot_Program* prog, Aot_Block* block, uint16_t start)
+{
+    char*  body = NULL;
+    size_t size = 0;
+    FILE*  code = open_memstream(&body, &size);
+    if(code == NULL)
+        return false;
+
+    for(uint32_t idx = 0; idx < block->length; idx++) {
+        uint16_t addr = start + 2 * idx;
+        EmitInstruction(code, prog, block, addr, InstructionOf(prog, addr), idx + 1, idx + 1 == block->length);
+    }
+    fclose(code);
+
+    fprintf(out, "static uint32_t Block_%03x(Chip8_Static* st, Chip8_CPU* cpu, Chip8_Memory* mem)\n{\n", start);
+    if(strstr(body, "V[") != NULL || strstr(body, "(V,") != NULL)
+        fprintf(out, "    uint8_t* V = cpu->VX;\n");
+    if(!block->uses_st)
+        fprintf(out, "    (void) st;\n");
+    if(!block->uses_mem)
+        fprintf(out, "    (void) mem;\n");
+    fprintf(out, "\n%s}\n\n", body);
+    free(body);
+    return true;
+}
+
+static bool EmitProgram(FILE* out, Aot_Program* prog, const char* rom_path)
+{
+    fprintf(out, "// Generated by chip8_aot from %s, do not edit\n\n", rom_path);
+    fprintf(out, "#include \"Chip8_Core.h\"\n\n");
+
+    fprintf(out, "static const uint8_t rom[%zu] = {", prog->rom_size);
+    for(size_t idx = 0; idx < prog->rom_size; idx++)
+        fprintf(out, "%s0x%02x,", idx % 16 == 0 ? "\n    " : " ", prog->rom[idx]);
+    fprintf(out, "\n};\n\n");
+
+    for(uint32_t addr = 0; addr < CHIP8_DECODE_SLOTS; addr++) {
+        if(prog->blocks[addr].length > 0 && !EmitBlock(out, prog, &prog->blocks[addr], (uint16_t) addr))
+            return false;
+    }
+
+    fprintf(out, "static const Chip8_StaticBlock blocks[CHIP8_DECODE_SLOTS] = {\n");
+    for(uint32_t addr = 0; addr < CHIP8_DECODE_SLOTS; addr++)
+        if(prog->blocks[addr].length > 0)
+            fprintf(out, "    [0x%03x] = Block_%03x,\n", addr, addr);
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const uint8_t lengths[CHIP8_DECODE_SLOTS] = {\n");
+    for(uint32_t addr = 0; addr < CHIP8_DECODE_SLOTS; addr++)
+        if(prog->blocks[addr].length > 0)
+            fprintf(out, "    [0x%03x] = %u,\n", addr, prog->blocks[addr].length);
+    fprintf(out, "};\n\n");
+
+    static const char* const variant_names[] = { "CHIP8_VARIANT_CHIP8", "CHIP8_VARIANT_SCHIP", "CHIP8_VARIANT_XOCHIP" };
+    fprintf(out, "const Chip8_StaticProgram chip8_static_program = {\n");
+    fprintf(out, "    %s, 0x%016llxull, %zu, rom, blocks, lengths\n};\n", variant_names[prog->variant],
+            (unsigned long long) HashROM(prog->rom, prog->rom_size), prog->rom_size);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const char*   rom_path = NULL;
+    const char*   out_path = NULL;
+    Chip8_Variant variant  = CHIP8_VARIANT_CHIP8;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-variant") == 0 && i + 1 < argc) {
+            if(!ParseVariantName(argv[++i], &variant)) {
+                fprintf(stderr, "Unknown variant: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            out_path = argv[++i];
+        else
+            rom_path = argv[i];
+    }
+
+    if(rom_path == NULL) {
+        fprintf(stderr, "usage: %s <rom> [-variant chip8|schip] [-o FILE]\n", argv[0]);
+        return -1;
+    }
+    if(variant == CHIP8_VARIANT_XOCHIP) {
+        fprintf(stderr, "XO-CHIP programs are always interpreted and cannot be translated\n");
+        return -1;
+    }
+
+    Aot_Program* prog = (Aot_Program*) calloc(1, sizeof(Aot_Program));
+    uint8_t*     rom  = LoadROM(rom_path, &prog->rom_size);
+    if(rom == NULL) {
+        fprintf(stderr, "Failed to open the ROM file: %s\n", rom_path);
+        free(prog);
+        return -1;
+    }
+    prog->rom     = rom;
+    prog->variant = variant;
+
+    Enqueue(prog, 0x200);
+    for(size_t idx = 0; idx < prog->num_queued; idx++)
+        WalkBlock(prog, prog->queue[idx]);
+
+    FILE* out = out_path != NULL ? fopen(out_path, "w") : stdout;
+    bool  ok  = out != NULL && EmitProgram(out, prog, rom_path);
+    if(out != NULL && out != stdout)
+        ok = fclose(out) == 0 && ok;
+    if(!ok)
+        fprintf(stderr, "Failed to write the translation\n");
+    else
+        fprintf(stderr, "%zu blocks translated\n", prog->num_queued);
+
+    free(rom);
+    free(prog);
+    return ok ? 0 : 1;
+}
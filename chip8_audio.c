@@ -0,0 +1,103 @@
+#include "Chip8.h"
+
+// Audio.
+//
+// The emulation thread is the only producer of tone events and the SDL audio callback the only
+// consumer, so the ring needs no lock: the producer publishes an event by advancing head with a
+// release store, the consumer retires it by advancing tail. Events carry the sample at which
+// they take effect, which the callback honours to the sample within whatever buffer it is
+// filling, and the tone state in between is all it needs to keep producing sound.
+//
+// Emulated time is mapped onto the sample clock at a fixed offset, chosen so the first event
+// lands half a buffer after what the callback has already played. Events that would arrive
+// late, or a quarter of a second or more ahead, re-establish that offset. The frontend also
+// drops the anchor whenever it reinstalls the hook after emulated time jumped
+
+static const int16_t TONE_AMPLITUDE = 3000;
+
+static void AudioCallback(void* userdata, Uint8* stream, int len)
+{
+    Chip8_Audio* audio   = (Chip8_Audio*) userdata;
+    int16_t*     samples = (int16_t*) stream;
+    int          count   = len / (int) sizeof(int16_t);
+
+    uint64_t position = atomic_load_explicit(&audio->played, memory_order_relaxed);
+    uint32_t tail     = atomic_load_explicit(&audio->tail, memory_order_relaxed);
+    uint32_t head     = atomic_load_explicit(&audio->head, memory_order_acquire);
+    uint32_t step     = (uint32_t)(((uint64_t) CHIP8_TONE_HZ << 32) / audio->rate);
+
+    for(int idx = 0; idx < count; idx++, position++) {
+        while(tail != head && audio->events[tail & (CHIP8_AUDIO_EVENTS - 1)].sample <= position) {
+            audio->on = audio->events[tail & (CHIP8_AUDIO_EVENTS - 1)].on;
+            tail++;
+        }
+
+        audio->phase += step;
+        samples[idx]  = !audio->on ? 0 : (audio->phase & 0x80000000u) ? -TONE_AMPLITUDE : TONE_AMPLITUDE;
+    }
+
+    atomic_store_explicit(&audio->tail, tail, memory_order_release);
+    atomic_store_explicit(&audio->played, position, memory_order_release);
+}
+
+bool OpenAudio(Chip8_Audio* audio, uint32_t instructions_per_second)
+{
+    memset(audio, 0x00, sizeof(Chip8_Audio));
+    atomic_init(&audio->head, 0);
+    atomic_init(&audio->tail, 0);
+    atomic_init(&audio->played, 0);
+    audio->instructions_per_second = instructions_per_second;
+
+    SDL_AudioSpec want = {}, have;
+    want.freq     = CHIP8_AUDIO_RATE;
+    want.format   = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples  = CHIP8_AUDIO_SAMPLES;
+    want.callback = AudioCallback;
+    want.userdata = audio;
+
+    audio->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if(audio->device == 0)
+        return false;
+
+    audio->rate   = have.freq;
+    audio->buffer = have.samples;
+    SDL_PauseAudioDevice(audio->device, 0);
+    return true;
+}
+
+void CloseAudio(Chip8_Audio* audio)
+{
+    if(audio->device != 0)
+        SDL_CloseAudioDevice(audio->device);
+    audio->device = 0;
+}
+
+// Scheduler tone hook, runs on the emulation thread
+void PostTone(void* arg, bool on, uint64_t cycle)
+{
+    Chip8_Audio* audio = (Chip8_Audio*) arg;
+    uint32_t     head  = atomic_load_explicit(&audio->head, memory_order_relaxed);
+    uint32_t     tail  = atomic_load_explicit(&audio->tail, memory_order_acquire);
+    if(head - tail == CHIP8_AUDIO_EVENTS)
+        return;     // Only if the callback stopped running altogether
+
+    uint64_t ips      = audio->instructions_per_second;
+    uint64_t played   = atomic_load_explicit(&audio->played, memory_order_acquire);
+    int64_t  emulated = (int64_t)((cycle / ips) * audio->rate + (cycle % ips) * audio->rate / ips);
+    int64_t  sample   = emulated + audio->offset;
+
+    if(!audio->anchored || sample < (int64_t) played || sample > (int64_t)(played + audio->rate / 4)) {
+        audio->offset   = (int64_t)(played + audio->buffer / 2) - emulated;
+        audio->anchored = true;
+        sample          = emulated + audio->offset;
+    }
+    if((uint64_t) sample < audio->last_sample)
+        sample = (int64_t) audio->last_sample;
+    audio->last_sample = (uint64_t) sample;
+
+    Chip8_ToneEvent* event = &audio->events[head & (CHIP8_AUDIO_EVENTS - 1)];
+    event->sample = (uint64_t) sample;
+    event->on     = on;
+    atomic_store_explicit(&audio->head, head + 1, memory_order_release);
+}
@@ -0,0 +1,862 @@
+#include "Chip8_Core.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static uint16_t InstructionAt(const Chip8_Memory* mem, uint16_t addr)
+{
+    size_t mask = mem->memory_size - 1;
+    return (uint16_t)(mem->ptr_8[addr & mask] << 8 | mem->ptr_8[(addr + 1) & mask]);
+}
+
+// Skips the next instruction when 'cond' holds, on XO-CHIP that is 4 bytes if it is F000 nnnn
+static inline void SkipIf(Chip8_CPU* cpu, const Chip8_Memory* mem, bool cond)
+{
+    if(!cond) return;
+    cpu->PC += 2;
+    if(mem->variant == CHIP8_VARIANT_XOCHIP && InstructionAt(mem, cpu->PC - 2) == 0xF000)
+        cpu->PC += 2;
+}
+
+// VX to VY, in either direction, to and from memory at I (XO-CHIP's 5xy2 and 5xy3, and Fx55 and
+// Fx65 from V0). I can point anywhere, addresses wrap around the end of memory
+static void TransferRange(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t reg_x, uint8_t reg_y, bool store)
+{
+    int    step  = reg_x <= reg_y ? 1 : -1;
+    size_t count = (size_t)((reg_y - reg_x) * step) + 1;
+    for(size_t idx = 0; idx < count; idx++) {
+        uint8_t* byte = mem->ptr_8 + ((cpu->I + idx) & (mem->memory_size - 1));
+        uint8_t* reg  = cpu->VX + reg_x + (int) idx * step;
+        if(store) *byte = *reg;
+        else      *reg  = *byte;
+    }
+}
+
+uint8_t Execute0xF(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t reg_x, uint8_t nn)
+{
+    switch(nn) {
+        case 0x07: cpu->VX[reg_x] = cpu->delay_timer; break;
+        case 0x0a: return reg_x; break;
+        case 0x15: cpu->delay_timer = cpu->VX[reg_x]; break;
+        case 0x18: cpu->sound_timer = cpu->VX[reg_x]; break;
+        case 0x1e: cpu->I += cpu->VX[reg_x]; break;
+        case 0x29: cpu->I = (cpu->VX[reg_x] * 5); break;
+        case 0x33: {
+            size_t mask = mem->memory_size - 1;
+            mem->ptr_8[(cpu->I + 0) & mask] = cpu->VX[reg_x] / 100;
+            mem->ptr_8[(cpu->I + 1) & mask] = cpu->VX[reg_x] / 10 % 10;
+            mem->ptr_8[(cpu->I + 2) & mask] = cpu->VX[reg_x] % 10;
+        } break;
+        case 0x55: TransferRange(cpu, mem, 0, reg_x, true);  break;
+        case 0x65: TransferRange(cpu, mem, 0, reg_x, false); break;
+    }
+    if(mem->variant == CHIP8_VARIANT_CHIP8)
+        return 0xFF;
+
+    switch(nn) {
+        case 0x30: cpu->I = CHIP8_BIG_FONT + (cpu->VX[reg_x] & 0x0F) * 10; break;
+        case 0x75: memcpy(cpu->rpl, cpu->VX, reg_x + 1); break;
+        case 0x85: memcpy(cpu->VX, cpu->rpl, reg_x + 1); break;
+    }
+    if(mem->variant != CHIP8_VARIANT_XOCHIP)
+        return 0xFF;
+
+    // F002 and Fx3A, the audio pattern and pitch, are not emulated: the beeper stays a beeper
+    switch(nn) {
+        case 0x00: {
+            if(reg_x == 0) {
+                cpu->I   = InstructionAt(mem, cpu->PC);
+                cpu->PC += 2;
+            }
+        } break;
+        case 0x01: cpu->planes = reg_x & ((1 << CHIP8_PLANES) - 1); break;
+    }
+    return 0xFF;
+}
+
+uint8_t Execute0xE(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t nn, uint8_t reg_x)
+{
+    switch(nn) {
+        case 0x9e: SkipIf(cpu, mem, (ReadKeys(mem) & (0x8000 >> reg_x)) != 0); break;
+        case 0xa1: SkipIf(cpu, mem, (ReadKeys(mem) & (0x8000 >> reg_x)) == 0); break;
+    }
+    return 0;
+}
+
+// Sprite data as seen from addr, copied out into 'buffer' when it runs past the end of memory
+static const uint8_t* SpriteData(const Chip8_Memory* mem, uint16_t addr, uint32_t bytes, uint8_t* buffer)
+{
+    if(addr + bytes <= mem->memory_size)
+        return mem->ptr_8 + addr;
+    for(uint32_t idx = 0; idx < bytes; idx++)
+        buffer[idx] = mem->ptr_8[(addr + idx) & (mem->memory_size - 1)];
+    return buffer;
+}
+
+// 8 pixel wide rows onto single word screen rows, the original CHIP-8 case
+static uint64_t DrawRows8(uint64_t* screen, const uint8_t* sprite, uint32_t x, uint32_t rows)
+{
+    uint32_t row       = 0;
+    uint64_t collision = 0;
+
+#if defined(__SSE2__)
+    // Two rows at a time in the 64-bit lanes of an SSE register
+    __m128i shift = _mm_cvtsi32_si128(x);
+    __m128i hits  = _mm_setzero_si128();
+    for(; row + 2 <= rows; row += 2) {
+        __m128i lines  = _mm_set_epi64x((int64_t)((uint64_t) sprite[row + 1] << 56),
+                                        (int64_t)((uint64_t) sprite[row]     << 56));
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(screen + row));
+
+        lines = _mm_srl_epi64(lines, shift);
+        hits  = _mm_or_si128(hits, _mm_and_si128(pixels, lines));
+        _mm_storeu_si128((__m128i*)(screen + row), _mm_xor_si128(pixels, lines));
+    }
+    collision = (uint64_t) _mm_cvtsi128_si64(_mm_or_si128(hits, _mm_unpackhi_epi64(hits, hits)));
+#endif
+
+    for(; row < rows; row++) {
+        uint64_t line = ((uint64_t) sprite[row] << 56) >> x;
+        collision   |= screen[row] & line;
+        screen[row] ^= line;
+    }
+    return collision;
+}
+
+// Any other sprite width and resolution: 16 pixel wide rows, and 128 pixel screen rows shifted
+// as one 128-bit value across their two words
+static uint64_t DrawRowsWide(uint64_t* screen, size_t row_words, const uint8_t* sprite, bool wide,
+                             uint32_t x, uint32_t rows)
+{
+    uint64_t collision = 0;
+    for(uint32_t row = 0; row < rows; row++, screen += row_words) {
+        uint64_t bits = wide ? (uint64_t) sprite[2 * row] << 56 | (uint64_t) sprite[2 * row + 1] << 48
+                             : (uint64_t) sprite[row] << 56;
+        if(row_words == 1) {
+            uint64_t line = bits >> x;
+            collision |= screen[0] & line;
+            screen[0] ^= line;
+        } else {
+            unsigned __int128 line = ((unsigned __int128) bits << 64) >> x;
+            uint64_t          high = (uint64_t)(line >> 64);
+            uint64_t          low  = (uint64_t) line;
+            collision |= (screen[0] & high) | (screen[1] & low);
+            screen[0] ^= high;
+            screen[1] ^= low;
+        }
+    }
+    return collision;
+}
+
+// Sprites start at (VX, VY) wrapped onto the screen and are clipped at the right and bottom
+// edges. Each sprite row is shifted into place as a whole, so drawing it is an XOR into the
+// packed screen row and collision detection an AND, and what a sprite costs depends on its
+// height only, not on the resolution. Dxy0 draws a 16x16 sprite on SUPER-CHIP and XO-CHIP, and
+// on XO-CHIP every selected plane takes the next sprite's worth of data from I on
+uint8_t Execute0xD(Chip8_CPU* cpu, Chip8_Memory* mem, uint8_t reg_x, uint8_t reg_y, uint8_t height)
+{
+    bool      wide   = height == 0 && mem->variant != CHIP8_VARIANT_CHIP8;
+    uint32_t  bytes  = wide ? 32 : height;
+    uint32_t  x      = cpu->VX[reg_x] % mem->screen_w;
+    uint32_t  y      = cpu->VX[reg_y] % mem->screen_h;
+    uint32_t  rows   = min(wide ? 16 : height, mem->screen_h - y);
+    uint16_t  addr   = cpu->I;
+    uint64_t  collision = 0;
+    uint8_t   buffer[32];
+#ifdef CHIP8_PROFILE
+    uint64_t  t_start = ProfileClock();
+#endif
+
+    // The original CHIP-8 case, which every variant draws the most, goes straight to DrawRows8
+    bool plain = cpu->planes == 1 && mem->row_words == 1 && !wide && addr + bytes <= mem->memory_size;
+    if(plain)
+        collision = DrawRows8(mem->screen_buffer + y, mem->ptr_8 + addr, x, rows);
+
+    for(uint32_t plane = 0; plane < CHIP8_PLANES && !plain; plane++) {
+        if((cpu->planes & (1 << plane)) == 0)
+            continue;
+
+        const uint8_t* sprite = SpriteData(mem, addr, bytes, buffer);
+        uint64_t*      screen = mem->screen_buffer + plane * mem->plane_words + y * mem->row_words;
+        if(mem->row_words == 1 && !wide)
+            collision |= DrawRows8(screen, sprite, x, rows);
+        else
+            collision |= DrawRowsWide(screen, mem->row_words, sprite, wide, x, rows);
+        addr += bytes;
+    }
+    if(rows > 0)
+        mem->dirty_rows |= (~0ull >> (64 - rows)) << y;
+    cpu->VX[0x0F] = collision != 0;
+
+#ifdef CHIP8_PROFILE
+    Chip8_Profile* profile = mem->profile;
+    if(profile != NULL) {
+        profile->draw_count++;
+        profile->draw_rows       += rows;
+        profile->draw_clipped    += rows < (wide ? 16u : height);
+        profile->draw_collisions += collision != 0;
+        profile->draw_height[height & 0x0F]++;
+        profile->draw_time       += ProfileClock() - t_start;
+    }
+#endif
+    return 0;
+}
+
+uint8_t Execute0x8(Chip8_CPU* cpu, uint8_t reg_x, uint8_t reg_y, uint8_t type) 
+{
+    switch(type) {
+        case 0x00: cpu->VX[reg_x]  = cpu->VX[reg_y]; break;
+        case 0x01: cpu->VX[reg_x] |= cpu->VX[reg_y]; break;
+        case 0x02: cpu->VX[reg_x] &= cpu->VX[reg_y]; break;
+        case 0x03: cpu->VX[reg_x] ^= cpu->VX[reg_y]; break;
+        case 0x04: {
+            cpu->VX[0x0F] = (cpu->VX[reg_y] > (255 - cpu->VX[reg_x]));
+            cpu->VX[reg_x] += cpu->VX[reg_y]; 
+        } break;
+        case 0x05: {
+            cpu->VX[0x0F]  = (cpu->VX[reg_x] > cpu->VX[reg_y]);
+            cpu->VX[reg_x] -= cpu->VX[reg_y]; 
+        } break;
+        case 0x06: {
+            cpu->VX[0x0F]  = (cpu->VX[reg_x] & 1);
+            cpu->VX[reg_x] = (cpu->VX[reg_x] >> 1);
+        } break;
+        case 0x07: {
+            cpu->VX[0x0F]  = (cpu->VX[reg_y] > cpu->VX[reg_x]);
+            cpu->VX[reg_x] = (cpu->VX[reg_y] - cpu->VX[reg_x]);
+        } break;
+        case 0x0E: {
+            cpu->VX[0x0F]  = (cpu->VX[reg_x] & 0x80) >> 7;
+            cpu->VX[reg_x] = (cpu->VX[reg_x] << 1);
+        } break;
+    }
+    return 0;
+}
+
+// Moves the selected planes 'dx' pixels right and 'dy' rows down (left and up when negative),
+// whatever is shifted in is blank
+static void ScrollScreen(const Chip8_CPU* cpu, Chip8_Memory* mem, int dx, int dy)
+{
+    size_t rows = mem->screen_h;
+    size_t span = mem->row_words;
+    size_t by   = (size_t)(dy < 0 ? -dy : dy) < rows ? (size_t)(dy < 0 ? -dy : dy) : rows;
+
+    for(uint32_t plane = 0; plane < CHIP8_PLANES; plane++) {
+        if((cpu->planes & (1 << plane)) == 0)
+            continue;
+
+        uint64_t* screen = mem->screen_buffer + plane * mem->plane_words;
+        if(dy > 0) {
+            memmove(screen + by * span, screen, (rows - by) * span * sizeof(uint64_t));
+            memset(screen, 0x00, by * span * sizeof(uint64_t));
+        } else if(dy < 0) {
+            memmove(screen, screen + by * span, (rows - by) * span * sizeof(uint64_t));
+            memset(screen + (rows - by) * span, 0x00, by * span * sizeof(uint64_t));
+        }
+
+        for(size_t y = 0; dx != 0 && y < rows; y++) {
+            uint64_t* row = screen + y * span;
+            if(span == 1) {
+                row[0] = dx > 0 ? row[0] >> dx : row[0] << -dx;
+            } else {
+                unsigned __int128 line = (unsigned __int128) row[0] << 64 | row[1];
+                line   = dx > 0 ? line >> dx : line << -dx;
+                row[0] = (uint64_t)(line >> 64);
+                row[1] = (uint64_t) line;
+            }
+        }
+    }
+    mem->dirty_rows = ~0ull;
+}
+
+uint8_t Execute0x0(Chip8_CPU* cpu, Chip8_Memory* mem, uint16_t nnn)
+{
+    switch(nnn) {
+        case 0x0E0:
+            for(uint32_t plane = 0; plane < CHIP8_PLANES; plane++) {
+                if(cpu->planes & (1 << plane))
+                    memset(mem->screen_buffer + plane * mem->plane_words, 0x00,
+                           mem->screen_h * mem->row_words * sizeof(uint64_t));
+            }
+            mem->dirty_rows = ~0ull;
+            return 0;
+        case 0x0EE:
+            cpu->stack_ptr = (cpu->stack_ptr - 1) & (CHIP8_STACK_DEPTH - 1);
+            cpu->PC        = cpu->stack[cpu->stack_ptr];
+            return 0;
+    }
+    if(mem->variant == CHIP8_VARIANT_CHIP8)
+        return 0;
+
+    switch(nnn) {
+        case 0x0FB: ScrollScreen(cpu, mem,  4, 0); break;
+        case 0x0FC: ScrollScreen(cpu, mem, -4, 0); break;
+        case 0x0FD: cpu->PC -= 2; break;    // Exit, the program stays on it from then on
+        case 0x0FE: case 0x0FF: {
+            // The contents would not fit the new layout anyway, switching clears every plane
+            cpu->hires = nnn == 0x0FF;
+            ApplyScreenMode(cpu, mem);
+            memset(mem->screen_buffer, 0x00, mem->screen_words * sizeof(uint64_t));
+            mem->dirty_rows = ~0ull;
+        } break;
+        default:
+            if((nnn & 0xFF0) == 0x0C0)
+                ScrollScreen(cpu, mem, 0, nnn & 0x0F);
+            else if((nnn & 0xFF0) == 0x0D0 && mem->variant == CHIP8_VARIANT_XOCHIP)
+                ScrollScreen(cpu, mem, 0, -(nnn & 0x0F));
+            break;
+    }
+    return 0;
+}
+
+uint8_t ExecInstruction(Chip8_CPU* cpu, Chip8_Memory* mem)
+{
+    // 'Decode'
+    uint16_t opcode = (cpu->CIR & 0xF000) >> 12; 
+    uint16_t nnn    = (cpu->CIR & 0x0FFF);       // Lower 3 nibbles, typically an address operand
+    uint8_t  nn     = (cpu->CIR & 0x00FF);       // Lower byte, typically a byte literal
+    uint8_t  reg_x  = (cpu->CIR & 0x0F00) >> 8;  // typically a register index
+    uint8_t  reg_y  = (cpu->CIR & 0x00F0) >> 4;  // typically a register index
+    uint8_t  optype = (cpu->CIR & 0x000F);       // nibble which differentiates inst's with same opcode
+
+    uint8_t wait_key = 0xFF;
+
+    // Execute
+    switch(opcode) {
+        case 0x0: Execute0x0(cpu, mem, nnn); break; 
+        case 0x1: cpu->PC = nnn; break;
+        case 0x2: {
+            cpu->stack[cpu->stack_ptr] = cpu->PC;
+            cpu->stack_ptr = (cpu->stack_ptr + 1) & (CHIP8_STACK_DEPTH - 1);
+            cpu->PC        = nnn;
+        } break;
+        case 0x3: SkipIf(cpu, mem, cpu->VX[reg_x] == nn); break;
+        case 0x4: SkipIf(cpu, mem, cpu->VX[reg_x] != nn); break;
+        case 0x5: {
+            if(mem->variant == CHIP8_VARIANT_XOCHIP && (optype == 0x2 || optype == 0x3))
+                TransferRange(cpu, mem, reg_x, reg_y, optype == 0x2);
+            else
+                SkipIf(cpu, mem, cpu->VX[reg_x] == cpu->VX[reg_y]);
+        } break;
+        case 0x6: cpu->VX[reg_x]  = nn; break;
+        case 0x7: cpu->VX[reg_x] += nn; break;
+        case 0x8: Execute0x8(cpu, reg_x, reg_y, optype); break;
+        case 0x9: SkipIf(cpu, mem, cpu->VX[reg_x] != cpu->VX[reg_y]); break;
+        case 0xa: cpu->I = nnn; break;
+        case 0xb: cpu->PC = nnn + cpu->VX[0]; break;
+        case 0xc: cpu->VX[reg_x] = (NextRandom(cpu) % 255) & nn; break;
+        case 0xd: Execute0xD(cpu, mem, reg_x, reg_y, optype); break;
+        case 0xe: Execute0xE(cpu, mem, nn, reg_x); break;
+        case 0xf: wait_key = Execute0xF(cpu, mem, reg_x, nn); break;
+        default: break;
+    }
+    return wait_key;
+}
+
+void FetchInstruction(Chip8_CPU* cpu, Chip8_Memory* mem)
+{
+    cpu->CIR = InstructionAt(mem, cpu->PC);
+    cpu->PC += 2;
+}
+
+// Runs up to 'cycles' instructions back to back, stopping early only when the program
+// starts waiting for a key press (Fx0A). Returns the number of instructions executed
+uint32_t ExecCycles(Chip8_CPU* cpu, Chip8_Memory* mem, uint32_t cycles)
+{
+    for(uint32_t n = 0; n < cycles; n++) {
+#ifdef CHIP8_PROFILE
+        uint16_t pc      = cpu->PC;
+        uint64_t t_start = ProfileClock();
+#endif
+        FetchInstruction(cpu, mem);
+
+        uint8_t signal = ExecInstruction(cpu, mem);
+#ifdef CHIP8_PROFILE
+        if(mem->profile != NULL)
+            ProfileInstruction(mem->profile, pc, cpu->CIR, ProfileClock() - t_start);
+#endif
+        if(signal != 0xFF) {
+            cpu->wait_key_reg  = signal;
+            cpu->wait_key_prev = ReadKeys(mem);
+            return n + 1;
+        }
+    }
+    return cycles;
+}
+
+void InitializeScheduler(Chip8_Scheduler* sched, uint32_t instructions_per_second)
+{
+    memset(sched, 0x00, sizeof(Chip8_Scheduler));
+    sched->instructions_per_second = instructions_per_second ? instructions_per_second : CHIP8_DEFAULT_IPS;
+    sched->engine = CHIP8_ENGINE_INTERPRETER;
+}
+
+// Switches the engine RunCycles executes with, allocating whatever state it needs.
+// Returns false (and keeps the current engine) if that state could not be created
+bool SetEngine(Chip8_Scheduler* sched, Chip8_Engine engine)
+{
+    if(engine == CHIP8_ENGINE_CACHED) {
+        if(sched->decode_cache == NULL)
+            sched->decode_cache = (Chip8_DecodeCache*) malloc(sizeof(Chip8_DecodeCache));
+        if(sched->decode_cache == NULL)
+            return false;
+        FlushDecodeCache(sched->decode_cache);
+    }
+    if(engine == CHIP8_ENGINE_JIT) {
+#ifdef CHIP8_PROFILE
+        return false;
+#endif
+        if(sched->jit == NULL)
+            sched->jit = CreateJit();
+        if(sched->jit == NULL)
+            return false;
+        FlushJit(sched->jit);
+    }
+    if(engine == CHIP8_ENGINE_STATIC) {
+#ifdef CHIP8_PROFILE
+        return false;
+#endif
+        if(sched->static_code == NULL)
+            return false;
+        FlushStatic(sched->static_code);
+    }
+    sched->engine = engine;
+    return true;
+}
+
+// Makes a translation chip8_aot generated available to the static engine
+bool UseStaticProgram(Chip8_Scheduler* sched, const Chip8_StaticProgram* program)
+{
+    Chip8_Static* st = CreateStatic(program);
+    if(st == NULL)
+        return false;
+    DestroyStatic(sched->static_code);
+    sched->static_code = st;
+    return true;
+}
+
+// Engine names as accepted by the -engine command line option
+bool ParseEngineName(const char* name, Chip8_Engine* engine)
+{
+    if(strcmp(name, "interp") == 0) { *engine = CHIP8_ENGINE_INTERPRETER; return true; }
+    if(strcmp(name, "cached") == 0) { *engine = CHIP8_ENGINE_CACHED;      return true; }
+    if(strcmp(name, "jit")    == 0) { *engine = CHIP8_ENGINE_JIT;         return true; }
+    if(strcmp(name, "static") == 0) { *engine = CHIP8_ENGINE_STATIC;      return true; }
+    return false;
+}
+
+void FreeScheduler(Chip8_Scheduler* sched)
+{
+    free(sched->decode_cache);
+    DestroyJit(sched->jit);
+    DestroyStatic(sched->static_code);
+    sched->decode_cache = NULL;
+    sched->jit          = NULL;
+    sched->static_code  = NULL;
+    sched->engine       = CHIP8_ENGINE_INTERPRETER;
+}
+
+// Converts elapsed real time, in units of 1/frequency seconds (the host's high resolution
+// counter), into a number of cycles to emulate, carrying the fractional part over to the next
+// call so that the long run rate is exactly instructions_per_second
+uint64_t ScheduleRealTime(Chip8_Scheduler* sched, uint64_t elapsed, uint64_t frequency)
+{
+    if(elapsed > frequency * CHIP8_MAX_CATCHUP_MS / 1000)
+        elapsed = frequency * CHIP8_MAX_CATCHUP_MS / 1000;
+
+    uint64_t credit = elapsed * sched->instructions_per_second + sched->realtime_remainder;
+    sched->realtime_remainder = credit % frequency;
+    return credit / frequency;
+}
+
+// Real time, in the same units, until ScheduleRealTime will have handed out enough cycles for
+// the next timer tick, given 'backlog' cycles already handed out and not yet run
+uint64_t RealTimeUntilTick(const Chip8_Scheduler* sched, uint64_t backlog, uint64_t frequency)
+{
+    uint64_t cycles = CyclesUntilTick(sched);
+    if(backlog >= cycles)
+        return 0;
+
+    uint64_t credit = (cycles - backlog) * frequency - sched->realtime_remainder;
+    return (credit + sched->instructions_per_second - 1) / sched->instructions_per_second;
+}
+
+// Drops whatever the engine derived from guest memory, after memory was written from outside it
+void FlushEngine(Chip8_Scheduler* sched)
+{
+    if(sched->decode_cache != NULL)
+        FlushDecodeCache(sched->decode_cache);
+    if(sched->jit != NULL)
+        FlushJit(sched->jit);
+    if(sched->static_code != NULL)
+        FlushStatic(sched->static_code);
+}
+
+// Memory [addr, addr + len) was written from outside the engine
+void InvalidateEngine(Chip8_Scheduler* sched, uint16_t addr, uint16_t len)
+{
+    if(sched->decode_cache != NULL)
+        InvalidateDecodeCache(sched->decode_cache, addr, len);
+    if(sched->jit != NULL)
+        InvalidateJit(sched->jit, addr, len);
+    if(sched->static_code != NULL)
+        InvalidateStatic(sched->static_code, addr, len);
+}
+
+// Machine state as one flat image: the CPU, memory, screen and the scheduler's timer phase.
+// Key states are input rather than state and are left out
+size_t StateSize(const Chip8_Memory* mem)
+{
+    return sizeof(Chip8_CPU) + mem->memory_size + mem->screen_words * sizeof(uint64_t) + sizeof(uint32_t);
+}
+
+void SaveState(const Chip8_CPU* cpu, const Chip8_Memory* mem, const Chip8_Scheduler* sched, uint8_t* out)
+{
+    memcpy(out, cpu, sizeof(Chip8_CPU));                       out += sizeof(Chip8_CPU);
+    memcpy(out, mem->ptr_8, mem->memory_size);                 out += mem->memory_size;
+    memcpy(out, mem->screen_buffer, mem->screen_words * sizeof(uint64_t));
+    out += mem->screen_words * sizeof(uint64_t);
+    memcpy(out, &sched->timer_accumulator, sizeof(uint32_t));
+}
+
+void LoadState(Chip8_CPU* cpu, Chip8_Memory* mem, Chip8_Scheduler* sched, const uint8_t* in)
+{
+    memcpy(cpu, in, sizeof(Chip8_CPU));                        in += sizeof(Chip8_CPU);
+    memcpy(mem->ptr_8, in, mem->memory_size);                  in += mem->memory_size;
+    memcpy(mem->screen_buffer, in, mem->screen_words * sizeof(uint64_t));
+    in += mem->screen_words * sizeof(uint64_t);
+    memcpy(&sched->timer_accumulator, in, sizeof(uint32_t));
+
+    ApplyScreenMode(cpu, mem);
+    mem->dirty_rows = ~0ull;
+    FlushEngine(sched);
+}
+
+void TickTimers(Chip8_CPU* cpu)
+{
+    if(cpu->delay_timer) cpu->delay_timer--;
+    if(cpu->sound_timer) cpu->sound_timer--;
+}
+
+// Completes a pending Fx0A once a key that was not already held when the wait began is pressed
+void ResolveKeyWait(Chip8_CPU* cpu, Chip8_Memory* mem)
+{
+    if(cpu->wait_key_reg == 0xFF) return;
+
+    uint16_t keys = ReadKeys(mem);
+    cpu->wait_key_prev &= keys; // released keys count as new presses again
+    uint16_t pressed = keys & ~cpu->wait_key_prev;
+    if(pressed == 0) return;
+
+    uint8_t key_idx = 0;
+    while((pressed & (0x8000 >> key_idx)) == 0) key_idx++;
+
+    cpu->VX[cpu->wait_key_reg] = key_idx;
+    cpu->wait_key_reg = 0xFF;
+}
+
+// Recognizes, from any instruction in them, the loops programs spin in until the delay timer
+// changes: 'ld vX, dt / se vX, kk (or sne) / jp <the ld>', a jump to itself and SUPER-CHIP's
+// exit (00FD), which stays on itself. Returns the
+// length of the loop if it cannot exit before the next timer tick, or 0
+static uint32_t FindIdleLoop(const Chip8_CPU* cpu, const Chip8_Memory* mem, uint16_t* head)
+{
+    uint16_t mask = (uint16_t)(mem->memory_size - 1);
+    uint16_t pc   = cpu->PC & mask;
+    uint16_t at   = InstructionAt(mem, pc);
+    if(at == (0x1000 | pc) || (at == 0x00FD && mem->variant != CHIP8_VARIANT_CHIP8)) {
+        *head = pc;
+        return 1;
+    }
+
+    for(uint16_t pos = 0; pos < 3; pos++) {
+        uint16_t start = (pc - 2 * pos) & mask;
+        uint16_t load  = InstructionAt(mem, start);
+        uint16_t skip  = InstructionAt(mem, start + 2);
+        uint16_t jump  = InstructionAt(mem, start + 4);
+        uint8_t  x     = (load & 0x0F00) >> 8;
+
+        if((load & 0xF0FF) != 0xF007 || jump != (0x1000 | start))
+            continue;
+        if(((skip >> 12) != 0x3 && (skip >> 12) != 0x4) || ((skip & 0x0F00) >> 8) != x)
+            continue;
+
+        // The loop exits once the skip is taken, on vX as loaded from the timer, or on vX as
+        // it is right now if the skip comes before the next load
+        bool    skip_equal = (skip >> 12) == 0x3;
+        uint8_t kk         = skip & 0x00FF;
+        if((cpu->delay_timer == kk) == skip_equal)
+            return 0;
+        if(pos == 1 && (cpu->VX[x] == kk) == skip_equal)
+            return 0;
+
+        *head = start;
+        return 3;
+    }
+    return 0;
+}
+
+static void ReportTone(Chip8_Scheduler* sched, const Chip8_CPU* cpu)
+{
+    bool on = cpu->sound_timer > 0;
+    if(on != sched->tone_on && sched->tone_hook != NULL) {
+        sched->tone_on = on;
+        sched->tone_hook(sched->tone_arg, on, sched->cycle_count);
+    }
+}
+
+// Emulates 'cycles' instruction cycles in batches that end exactly on 60hz timer ticks.
+// Cycles which elapse while the program waits on Fx0A still advance the timers
+void RunCycles(Chip8_Scheduler* sched, Chip8_CPU* cpu, Chip8_Memory* mem, uint64_t cycles)
+{
+    const uint32_t ips = sched->instructions_per_second;
+
+    while(cycles > 0) {
+        uint32_t until_tick = CyclesUntilTick(sched);
+        uint32_t batch      = cycles < until_tick ? (uint32_t) cycles : until_tick;
+
+        ResolveKeyWait(cpu, mem);
+        if(cpu->wait_key_reg == 0xFF) {
+            // Whole iterations of an idle loop only leave vX loaded with the timer behind, and
+            // the timer does not change before the end of the batch, so they are skipped
+            uint16_t head;
+            uint32_t length  = FindIdleLoop(cpu, mem, &head);
+            uint32_t skipped = length ? batch - batch % length : 0;
+            if(skipped > 0) {
+                if(length == 3)
+                    cpu->VX[(InstructionAt(mem, head) & 0x0F00) >> 8] = cpu->delay_timer;
+                uint16_t last = cpu->PC == head ? (uint16_t)(head + 2 * (length - 1)) : (uint16_t)(cpu->PC - 2);
+                cpu->CIR = InstructionAt(mem, last);
+                sched->instruction_count += skipped;
+                sched->idle_count        += skipped;
+            }
+
+            // The cached, JIT and static engines keep a slot per address of a 4KB memory,
+            // XO-CHIP's 64KB is always interpreted
+            Chip8_Engine engine = mem->memory_size > CHIP8_DECODE_SLOTS ? CHIP8_ENGINE_INTERPRETER : sched->engine;
+            switch(engine) {
+                case CHIP8_ENGINE_INTERPRETER:
+                    sched->instruction_count += ExecCycles(cpu, mem, batch - skipped); break;
+                case CHIP8_ENGINE_CACHED:
+                    sched->instruction_count += ExecCyclesCached(sched->decode_cache, cpu, mem, batch - skipped); break;
+                case CHIP8_ENGINE_JIT:
+                    sched->instruction_count += ExecCyclesJit(sched->jit, cpu, mem, batch - skipped); break;
+                case CHIP8_ENGINE_STATIC:
+                    sched->instruction_count += ExecCyclesStatic(sched->static_code, cpu, mem, batch - skipped); break;
+            }
+        }
+
+        sched->cycle_count       += batch;
+        sched->timer_accumulator += batch * CHIP8_TIMER_HZ;
+        cycles -= batch;
+
+        // Before the tick as well, so a tone started in this batch is reported even if the tick ends it
+        ReportTone(sched, cpu);
+        while(sched->timer_accumulator >= ips) {
+            sched->timer_accumulator -= ips;
+            sched->timer_ticks++;
+            TickTimers(cpu);
+        }
+        ReportTone(sched, cpu);
+    }
+
+    uint16_t head;
+    sched->idle = cpu->wait_key_reg != 0xFF || FindIdleLoop(cpu, mem, &head) != 0;
+}
+
+// Emulates whole 60hz frames, i.e. runs until 'frames' more timer ticks have happened
+void RunFrames(Chip8_Scheduler* sched, Chip8_CPU* cpu, Chip8_Memory* mem, uint64_t frames)
+{
+    for(uint64_t target = sched->timer_ticks + frames; sched->timer_ticks < target; )
+        RunCycles(sched, cpu, mem, CyclesUntilTick(sched));
+}
+
+// Cycles left in the current frame, i.e. until the next 60hz timer tick
+uint32_t CyclesUntilTick(const Chip8_Scheduler* sched)
+{
+    return (sched->instructions_per_second - sched->timer_accumulator + CHIP8_TIMER_HZ - 1) / CHIP8_TIMER_HZ;
+}
+
+size_t VariantMemorySize(Chip8_Variant variant)
+{
+    return variant == CHIP8_VARIANT_XOCHIP ? 65536 : 4096;
+}
+
+size_t VariantScreenWords(Chip8_Variant variant)
+{
+    switch(variant) {
+        case CHIP8_VARIANT_CHIP8:  return CHIP8_SCREEN_HEIGHT;
+        case CHIP8_VARIANT_SCHIP:  return CHIP8_HIRES_HEIGHT * 2;
+        case CHIP8_VARIANT_XOCHIP: return CHIP8_HIRES_HEIGHT * 2 * CHIP8_PLANES;
+    }
+    return 0;
+}
+
+// Variant names as accepted by the -variant command line option
+bool ParseVariantName(const char* name, Chip8_Variant* variant)
+{
+    if(strcmp(name, "chip8")  == 0) { *variant = CHIP8_VARIANT_CHIP8;  return true; }
+    if(strcmp(name, "schip")  == 0) { *variant = CHIP8_VARIANT_SCHIP;  return true; }
+    if(strcmp(name, "xochip") == 0) { *variant = CHIP8_VARIANT_XOCHIP; return true; }
+    return false;
+}
+
+void ApplyScreenMode(const Chip8_CPU* cpu, Chip8_Memory* mem)
+{
+    bool hires = cpu->hires && mem->variant != CHIP8_VARIANT_CHIP8;
+    mem->screen_w     = hires ? CHIP8_HIRES_WIDTH  : CHIP8_SCREEN_WIDTH;
+    mem->screen_h     = hires ? CHIP8_HIRES_HEIGHT : CHIP8_SCREEN_HEIGHT;
+    mem->row_words    = hires ? 2 : 1;
+    mem->screen_words = VariantScreenWords(mem->variant);
+    mem->plane_words  = mem->variant == CHIP8_VARIANT_XOCHIP ? mem->screen_words / CHIP8_PLANES : mem->screen_words;
+}
+
+void Initialize(const uint8_t* program, const size_t size, Chip8_CPU* cpu, Chip8_Memory* mem)
+{
+    // Initialize the CPU
+    memset(cpu->VX, 0x00, 16);   // zero-initialize the registers
+    memset(cpu->stack, 0x00, sizeof(cpu->stack));
+    memset(cpu->rpl, 0x00, sizeof(cpu->rpl));
+    cpu->PC = 0x200;
+    cpu->I  = 0x00;
+    cpu->stack_ptr   = 0;
+    cpu->delay_timer = 0x00;
+    cpu->sound_timer = 0x00;
+    cpu->wait_key_reg  = 0xFF;
+    cpu->wait_key_prev = 0x0000;
+    cpu->hires  = 0;
+    cpu->planes = 1;
+    SeedRandom(cpu, CHIP8_DEFAULT_SEED);
+
+    // Initialize memory
+    mem->memory_size = VariantMemorySize(mem->variant);
+    ApplyScreenMode(cpu, mem);
+
+    memset(mem->ptr_8,   0x00, mem->memory_size);
+    memset(mem->screen_buffer, 0x00, mem->screen_words * sizeof(uint64_t));
+    mem->dirty_rows = ~0ull;
+
+    // Write the system font
+    uint8_t system_font[16][5] = {
+        { 0xF0, 0x90, 0x90, 0x90, 0xF0 }, { 0x20, 0x60, 0x20, 0x20, 0x70 }, // 0, 1
+        { 0xF0, 0x10, 0xF0, 0x80, 0xF0 }, { 0xF0, 0x10, 0xF0, 0x10, 0xF0 }, // 2, 3 
+        { 0x90, 0x90, 0xF0, 0x10, 0x10 }, { 0xF0, 0x80, 0xF0, 0x10, 0xF0 }, // 4, 5
+        { 0xF0, 0x80, 0xF0, 0x90, 0xF0 }, { 0xF0, 0x10, 0x20, 0x40, 0x40 }, // 6, 7
+        { 0xF0, 0x90, 0xF0, 0x90, 0xF0 }, { 0xF0, 0x90, 0xF0, 0x10, 0xF0 }, // 8, 9
+        { 0xF0, 0x90, 0xF0, 0x90, 0x90 }, { 0xE0, 0x90, 0xE0, 0x90, 0xE0 }, // A, B
+        { 0xF0, 0x80, 0x80, 0x80, 0xF0 }, { 0xE0, 0x90, 0x90, 0x90, 0xE0 }, // C, D
+        { 0xF0, 0x80, 0xF0, 0x80, 0xF0 }, { 0xF0, 0x80, 0xF0, 0x80, 0x80 }, // E, F
+    };
+    memcpy(mem->ptr_8, system_font, 16 * 5);
+
+    // And the big one of Fx30
+    if(mem->variant != CHIP8_VARIANT_CHIP8) {
+        static const uint8_t big_font[16][10] = {
+            { 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF }, // 0
+            { 0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF }, // 1
+            { 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF }, // 2
+            { 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF }, // 3
+            { 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03 }, // 4
+            { 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF }, // 5
+            { 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF }, // 6
+            { 0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18 }, // 7
+            { 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF }, // 8
+            { 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF }, // 9
+            { 0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3 }, // A
+            { 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC }, // B
+            { 0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C }, // C
+            { 0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC }, // D
+            { 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF }, // E
+            { 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0 }, // F
+        };
+        memcpy(mem->ptr_8 + CHIP8_BIG_FONT, big_font, sizeof(big_font));
+    }
+
+    // Chip-8 Programs are specified to start at 0x200
+    memcpy(mem->ptr_8 + 0x200, program, size < mem->memory_size - 0x200 ? size : mem->memory_size - 0x200);
+}
+
+static size_t ScreenPlanes(const Chip8_Memory* mem)
+{
+    return mem->variant == CHIP8_VARIANT_XOCHIP ? CHIP8_PLANES : 1;
+}
+
+// The pixel's color: bit N is set when it is lit in plane N
+uint8_t GetPixel(const Chip8_Memory* mem, size_t x, size_t y)
+{
+    uint8_t color = 0;
+    for(size_t plane = 0; plane < ScreenPlanes(mem); plane++) {
+        uint64_t word = mem->screen_buffer[plane * mem->plane_words + y * mem->row_words + x / 64];
+        color |= ((word >> (63 - x % 64)) & 1) << plane;
+    }
+    return color;
+}
+
+// FNV-1a over the rows of the screen, identical screens always hash the same
+uint64_t HashScreen(const Chip8_Memory* mem)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(size_t plane = 0; plane < ScreenPlanes(mem); plane++) {
+        const uint64_t* screen = mem->screen_buffer + plane * mem->plane_words;
+        for(size_t word = 0; word < mem->screen_h * mem->row_words; word++) {
+            uint64_t row = screen[word];
+            for(int byte = 0; byte < 8; byte++, row >>= 8)
+                hash = (hash ^ (row & 0xFF)) * 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+void SeedRandom(Chip8_CPU* cpu, uint32_t seed)
+{
+    cpu->rng_state = seed != 0 ? seed : 0x2545F491;
+}
+
+// xorshift32
+uint32_t NextRandom(Chip8_CPU* cpu)
+{
+    uint32_t x = cpu->rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return cpu->rng_state = x;
+}
+
+// Reads a whole ROM file into a malloc'd buffer, returns NULL if it could not be read
+uint8_t* LoadROM(const char* path, size_t* size)
+{
+    FILE* rom_file = fopen(path, "rb");
+    if(rom_file == NULL) return NULL;
+
+    fseek(rom_file, 0, SEEK_END);
+    long rom_size = ftell(rom_file);
+    fseek(rom_file, 0, SEEK_SET);
+
+    uint8_t* program = NULL;
+    if(rom_size > 0 && (program = (uint8_t*) malloc(rom_size)) != NULL) {
+        if(fread(program, rom_size, 1, rom_file) != 1) {
+            free(program);
+            program = NULL;
+        }
+    }
+    fclose(rom_file);
+
+    *size = program ? (size_t) rom_size : 0;
+    return program;
+}
+
+inline uint16_t LittleToBigEndianU16(const uint16_t val)
+{
+    return ((val & 0xFF) << 8) | ((val & 0xFF00) >> 8);
+}
+
+uint8_t min(uint8_t val, uint8_t val2)
+{
+    return val < val2 ? val : val2;
+}
+
+size_t max(size_t val, size_t val2)
+{
+    return val > val2 ? val : val2;
+}
@@ -0,0 +1,249 @@
+#include "Chip8_Core.h"
+
+// Pre-decoded, threaded execution engine.
+//
+// Every byte address of memory has a slot holding the instruction that starts there, already
+// split into its operands, along with the index of the handler that executes it. Slots are
+// decoded lazily the first time they are reached and invalidated whenever the engine writes
+// into memory (Fx33 and Fx55), so self-modifying code keeps working. Dispatch uses computed
+// gotos (a GNU C extension, supported by clang and gcc): every handler ends by jumping straight
+// to the next one, instead of returning to a switch.
+//
+// The SUPER-CHIP instructions go through ExecInstruction, which knows which variant is running.
+
+enum {
+    OP_DECODE = 0,
+    OP_NOP,   OP_CLS,   OP_RET,   OP_JP,    OP_CALL,  OP_SE_NN, OP_SNE_NN, OP_SE_XY,
+    OP_LD_NN, OP_ADD_NN,
+    OP_LD_XY, OP_OR,    OP_AND,   OP_XOR,   OP_ADD_XY, OP_SUB,  OP_SHR,    OP_SUBN,  OP_SHL,
+    OP_SNE_XY, OP_LD_I, OP_JP_V0, OP_RND,   OP_DRW,   OP_SKP,   OP_SKNP,
+    OP_LD_X_DT, OP_LD_KEY, OP_LD_DT, OP_LD_ST, OP_ADD_I, OP_LD_F, OP_BCD, OP_STORE, OP_LOAD,
+    OP_EXEC,
+};
+
+// Mirrors the decoding done by ExecInstruction, anything it ignores decodes to OP_NOP
+static uint8_t DecodeHandler(uint16_t instr)
+{
+    uint16_t nnn    = (instr & 0x0FFF);
+    uint8_t  nn     = (instr & 0x00FF);
+    uint8_t  optype = (instr & 0x000F);
+
+    switch((instr & 0xF000) >> 12) {
+        case 0x0: {
+            if(nnn == 0x0E0) return OP_CLS;
+            if(nnn == 0x0EE) return OP_RET;
+            if((nnn & 0xFF0) == 0x0C0 || (nnn & 0xFF0) == 0x0D0 || (nnn >= 0x0FB && nnn <= 0x0FF)) return OP_EXEC;
+        } break;
+        case 0x1: return OP_JP;
+        case 0x2: return OP_CALL;
+        case 0x3: return OP_SE_NN;
+        case 0x4: return OP_SNE_NN;
+        case 0x5: return OP_SE_XY;
+        case 0x6: return OP_LD_NN;
+        case 0x7: return OP_ADD_NN;
+        case 0x8: {
+            switch(optype) {
+                case 0x00: return OP_LD_XY;
+                case 0x01: return OP_OR;
+                case 0x02: return OP_AND;
+                case 0x03: return OP_XOR;
+                case 0x04: return OP_ADD_XY;
+                case 0x05: return OP_SUB;
+                case 0x06: return OP_SHR;
+                case 0x07: return OP_SUBN;
+                case 0x0E: return OP_SHL;
+            }
+        } break;
+        case 0x9: return OP_SNE_XY;
+        case 0xa: return OP_LD_I;
+        case 0xb: return OP_JP_V0;
+        case 0xc: return OP_RND;
+        case 0xd: return OP_DRW;
+        case 0xe: return nn == 0x9e ? OP_SKP : nn == 0xa1 ? OP_SKNP : OP_NOP;
+        case 0xf: {
+            switch(nn) {
+                case 0x07: return OP_LD_X_DT;
+                case 0x0a: return OP_LD_KEY;
+                case 0x15: return OP_LD_DT;
+                case 0x18: return OP_LD_ST;
+                case 0x1e: return OP_ADD_I;
+                case 0x29: return OP_LD_F;
+                case 0x33: return OP_BCD;
+                case 0x55: return OP_STORE;
+                case 0x65: return OP_LOAD;
+                case 0x30: case 0x75: case 0x85: return OP_EXEC;
+            }
+        } break;
+    }
+    return OP_NOP;
+}
+
+void FlushDecodeCache(Chip8_DecodeCache* cache)
+{
+    for(size_t idx = 0; idx < CHIP8_DECODE_SLOTS; idx++)
+        cache->ops[idx].handler = OP_DECODE;
+}
+
+// Invalidates every slot whose instruction overlaps [addr, addr + len), including the one
+// starting at addr - 1 whose low byte lives at addr
+void InvalidateDecodeCache(Chip8_DecodeCache* cache, uint16_t addr, uint16_t len)
+{
+    for(uint32_t idx = 0; idx <= len; idx++)
+        cache->ops[(addr - 1 + idx) & (CHIP8_DECODE_SLOTS - 1)].handler = OP_DECODE;
+}
+
+uint32_t ExecCyclesCached(Chip8_DecodeCache* cache, Chip8_CPU* cpu, Chip8_Memory* mem, uint32_t cycles)
+{
+    static const void* const dispatch[] = {
+        &&op_decode,
+        &&op_nop,    &&op_cls,    &&op_ret,    &&op_jp,     &&op_call,   &&op_se_nn,  &&op_sne_nn, &&op_se_xy,
+        &&op_ld_nn,  &&op_add_nn,
+        &&op_ld_xy,  &&op_or,     &&op_and,    &&op_xor,    &&op_add_xy, &&op_sub,    &&op_shr,    &&op_subn,  &&op_shl,
+        &&op_sne_xy, &&op_ld_i,   &&op_jp_v0,  &&op_rnd,    &&op_drw,    &&op_skp,    &&op_sknp,
+        &&op_ld_x_dt, &&op_ld_key, &&op_ld_dt, &&op_ld_st,  &&op_add_i,  &&op_ld_f,   &&op_bcd,    &&op_store, &&op_load,
+        &&op_exec,
+    };
+
+    uint8_t*         VX = cpu->VX;
+    uint8_t*         memory = mem->ptr_8;
+    uint16_t         pc = cpu->PC;
+    uint32_t         n  = 0;
+    Chip8_DecodedOp* op = NULL;
+
+#ifdef CHIP8_PROFILE
+    // An instruction is accounted for when the next one is dispatched, its slot is decoded by then
+    Chip8_Profile* profile = mem->profile;
+    uint16_t       op_pc   = 0;
+    uint64_t       t_op    = 0;
+    #define PROFILE_BEGIN() do {                                                            \
+        if(profile) { op_pc = pc; t_op = ProfileClock(); }                                  \
+    } while(0)
+    #define PROFILE_END() do {                                                              \
+        if(profile && op) ProfileInstruction(profile, op_pc, op->instr, ProfileClock() - t_op); \
+    } while(0)
+#else
+    #define PROFILE_BEGIN() do {} while(0)
+    #define PROFILE_END()   do {} while(0)
+#endif
+
+    // Fetches the slot at pc and jumps to its handler, pc is advanced past it beforehand
+    // exactly as FetchInstruction does
+    #define DISPATCH() do {                                        \
+        PROFILE_END();                                             \
+        if(n == cycles) goto done;                                 \
+        op = &cache->ops[pc & (CHIP8_DECODE_SLOTS - 1)];           \
+        PROFILE_BEGIN();                                           \
+        pc += 2;                                                   \
+        n++;                                                       \
+        goto *dispatch[op->handler];                               \
+    } while(0)
+
+    DISPATCH();
+
+op_decode: {
+        uint16_t addr  = (pc - 2) & (CHIP8_DECODE_SLOTS - 1);
+        uint16_t instr = ((uint16_t) memory[addr]) << 8 | memory[(addr + 1) & (CHIP8_DECODE_SLOTS - 1)];
+
+        op->instr   = instr;
+        op->nnn     = (instr & 0x0FFF);
+        op->nn      = (instr & 0x00FF);
+        op->x       = (instr & 0x0F00) >> 8;
+        op->y       = (instr & 0x00F0) >> 4;
+        op->handler = DecodeHandler(instr);
+        goto *dispatch[op->handler];
+    }
+
+op_nop:    DISPATCH();
+op_cls:    Execute0x0(cpu, mem, 0x0E0); DISPATCH();
+op_ret:
+    cpu->stack_ptr = (cpu->stack_ptr - 1) & (CHIP8_STACK_DEPTH - 1);
+    pc = cpu->stack[cpu->stack_ptr];
+    DISPATCH();
+op_jp:     pc = op->nnn; DISPATCH();
+op_call:
+    cpu->stack[cpu->stack_ptr] = pc;
+    cpu->stack_ptr = (cpu->stack_ptr + 1) & (CHIP8_STACK_DEPTH - 1);
+    pc = op->nnn;
+    DISPATCH();
+op_se_nn:  pc += 2 * (VX[op->x] == op->nn);     DISPATCH();
+op_sne_nn: pc += 2 * (VX[op->x] != op->nn);     DISPATCH();
+op_se_xy:  pc += 2 * (VX[op->x] == VX[op->y]);  DISPATCH();
+op_sne_xy: pc += 2 * (VX[op->x] != VX[op->y]);  DISPATCH();
+op_ld_nn:  VX[op->x]  = op->nn; DISPATCH();
+op_add_nn: VX[op->x] += op->nn; DISPATCH();
+
+op_ld_xy:  VX[op->x]  = VX[op->y]; DISPATCH();
+op_or:     VX[op->x] |= VX[op->y]; DISPATCH();
+op_and:    VX[op->x] &= VX[op->y]; DISPATCH();
+op_xor:    VX[op->x] ^= VX[op->y]; DISPATCH();
+op_add_xy:
+    VX[0x0F]   = (VX[op->y] > (255 - VX[op->x]));
+    VX[op->x] += VX[op->y];
+    DISPATCH();
+op_sub:
+    VX[0x0F]   = (VX[op->x] > VX[op->y]);
+    VX[op->x] -= VX[op->y];
+    DISPATCH();
+op_shr:
+    VX[0x0F]  = (VX[op->x] & 1);
+    VX[op->x] = (VX[op->x] >> 1);
+    DISPATCH();
+op_subn:
+    VX[0x0F]  = (VX[op->y] > VX[op->x]);
+    VX[op->x] = (VX[op->y] - VX[op->x]);
+    DISPATCH();
+op_shl:
+    VX[0x0F]  = (VX[op->x] & 0x80) >> 7;
+    VX[op->x] = (VX[op->x] << 1);
+    DISPATCH();
+
+op_ld_i:   cpu->I = op->nnn; DISPATCH();
+op_jp_v0:  pc = op->nnn + VX[0]; DISPATCH();
+op_rnd:    VX[op->x] = (NextRandom(cpu) % 255) & op->nn; DISPATCH();
+op_drw:    Execute0xD(cpu, mem, op->x, op->y, op->nn & 0x0F); DISPATCH();
+op_skp:    if(ReadKeys(mem) & (0x8000 >> op->x)) pc += 2; DISPATCH();
+op_sknp:   if((ReadKeys(mem) & (0x8000 >> op->x)) == 0) pc += 2; DISPATCH();
+
+op_ld_x_dt: VX[op->x] = cpu->delay_timer; DISPATCH();
+op_ld_key:
+    cpu->wait_key_reg  = op->x;
+    cpu->wait_key_prev = ReadKeys(mem);
+    PROFILE_END();
+    goto done;
+op_ld_dt:  cpu->delay_timer = VX[op->x]; DISPATCH();
+op_ld_st:  cpu->sound_timer = VX[op->x]; DISPATCH();
+op_add_i:  cpu->I += VX[op->x]; DISPATCH();
+op_ld_f:   cpu->I = (VX[op->x] * 5); DISPATCH();
+    // Fx1E can take I anywhere, like fetches the addresses wrap around the end of memory
+op_bcd:
+    memory[(cpu->I + 0) & (CHIP8_DECODE_SLOTS - 1)] = VX[op->x] / 100;
+    memory[(cpu->I + 1) & (CHIP8_DECODE_SLOTS - 1)] = VX[op->x] / 10 % 10;
+    memory[(cpu->I + 2) & (CHIP8_DECODE_SLOTS - 1)] = VX[op->x] % 10;
+    InvalidateDecodeCache(cache, cpu->I, 3);
+    DISPATCH();
+op_store:
+    for(uint32_t k = 0; k <= op->x; k++)
+        memory[(cpu->I + k) & (CHIP8_DECODE_SLOTS - 1)] = VX[k];
+    InvalidateDecodeCache(cache, cpu->I, op->x + 1);
+    DISPATCH();
+op_load:
+    for(uint32_t k = 0; k <= op->x; k++)
+        VX[k] = memory[(cpu->I + k) & (CHIP8_DECODE_SLOTS - 1)];
+    DISPATCH();
+op_exec:
+    cpu->PC  = pc;
+    cpu->CIR = op->instr;
+    ExecInstruction(cpu, mem);
+    pc = cpu->PC;
+    DISPATCH();
+
+    #undef DISPATCH
+    #undef PROFILE_BEGIN
+    #undef PROFILE_END
+
+done:
+    cpu->PC = pc;
+    if(op != NULL)
+        cpu->CIR = op->instr;
+    return n;
+}
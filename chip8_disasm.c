@@ -0,0 +1,127 @@
+#include "Chip8_Core.h"
+
+// Disassembly. Mnemonics depend on nothing but the 16-bit instruction, so they are formatted
+// once per opcode into a table of fixed-width strings the first time each opcode is looked
+// up. Since the table is indexed by the instruction rather than by address, writes to memory
+// never invalidate it: whatever instruction ends up at an address simply indexes another slot
+
+static char     disasm_table[0x10000][CHIP8_DISASM_LEN];
+static uint64_t disasm_built[0x10000 / 64];  // One bit per opcode that has been formatted
+
+static void FormatInstruction(char* out, uint16_t instr)
+{
+    uint16_t opcode = (instr & 0xF000) >> 12; 
+    uint16_t nnn    = (instr & 0x0FFF);       // Lower 3 nibbles, typically an address operand
+    uint8_t  nn     = (instr & 0x00FF);       // Lower byte, typically a byte literal
+    uint8_t  reg_x  = (instr & 0x0F00) >> 8;  // typically a register index
+    uint8_t  reg_y  = (instr & 0x00F0) >> 4;  // typically a register index
+    uint8_t  optype = (instr & 0x000F);       // nibble which differentiates inst's with same opcode
+    size_t   n      = CHIP8_DISASM_LEN;
+
+    out[0] = '\0';
+    switch(opcode) {
+        case 0x0: {
+            switch(nnn) {
+                case 0x0E0: snprintf(out, n, "cls"); break;
+                case 0x0EE: snprintf(out, n, "ret"); break;
+                case 0x0FB: snprintf(out, n, "scr"); break;
+                case 0x0FC: snprintf(out, n, "scl"); break;
+                case 0x0FD: snprintf(out, n, "exit"); break;
+                case 0x0FE: snprintf(out, n, "low"); break;
+                case 0x0FF: snprintf(out, n, "high"); break;
+                default:
+                    if((nnn & 0xFF0) == 0x0C0) snprintf(out, n, "scd 0x%x", optype);
+                    if((nnn & 0xFF0) == 0x0D0) snprintf(out, n, "scu 0x%x", optype);
+                    break;
+            }
+        } break; 
+        case 0x1: snprintf(out, n, "jmp 0x%03x", nnn);                 break;
+        case 0x2: snprintf(out, n, "call 0x%03x", nnn);                break;
+        case 0x3: snprintf(out, n, "skipeq v%x, 0x%02x", reg_x, nn);   break;
+        case 0x4: snprintf(out, n, "skipneq v%x, 0x%02x", reg_x, nn);  break;
+        case 0x5: {
+            switch(optype) {
+                case 0x02: snprintf(out, n, "mov [I], v%x-v%x", reg_x, reg_y); break;
+                case 0x03: snprintf(out, n, "mov v%x-v%x, [I]", reg_x, reg_y); break;
+                default:   snprintf(out, n, "skipeq v%x, v%x", reg_x, reg_y); break;
+            }
+        } break;
+        case 0x6: snprintf(out, n, "mov v%x, 0x%02x", reg_x, nn);      break;
+        case 0x7: snprintf(out, n, "add v%x, 0x%02x", reg_x, nn);      break;
+        case 0x8: {
+            switch(optype) {
+                case 0x00: snprintf(out, n, "mov v%x, v%x", reg_x, reg_y); break;
+                case 0x01: snprintf(out, n, "or v%x, v%x", reg_x, reg_y); break;
+                case 0x02: snprintf(out, n, "and v%x, v%x", reg_x, reg_y); break;
+                case 0x03: snprintf(out, n, "xor v%x, v%x", reg_x, reg_y); break;
+                case 0x04: snprintf(out, n, "addsc v%x, v%x", reg_x, reg_y); break;
+                case 0x05: snprintf(out, n, "subsc v%x, v%x", reg_x, reg_y); break;
+                case 0x06: snprintf(out, n, "shr v%x", reg_x); break;
+                case 0x07: snprintf(out, n, "subn v%x, v%x", reg_x, reg_y); break;
+                case 0x0E: snprintf(out, n, "shl v%x", reg_x); break;
+            }
+        } break;
+        case 0x9: snprintf(out, n, "skipneq v%x, v%x", reg_x, reg_y);  break;
+        case 0xa: snprintf(out, n, "mov I, 0x%03x", nnn);  break;
+        case 0xb: snprintf(out, n, "jmp v0, 0x%03x", nnn);  break;
+        case 0xc: snprintf(out, n, "rnd v%x, 0x%02x", reg_x, nn);  break;
+        case 0xd: snprintf(out, n, "drw v%x, v%x, 0x%02x", reg_x, reg_y, optype);  break;
+        case 0xe: {
+            switch(nn) {
+                case 0x9e: snprintf(out, n, "skp v%x", reg_x);  break;
+                case 0xa1: snprintf(out, n, "sknp v%x", reg_x); break;
+            }
+        }  break;
+        case 0xf: {
+            switch(nn) {
+                case 0x07: snprintf(out, n, "mov v%x, dt", reg_x); break;
+                case 0x0a: snprintf(out, n, "intk v%x", reg_x); break;
+                case 0x15: snprintf(out, n, "mov dt, v%x", reg_x); break;
+                case 0x18: snprintf(out, n, "mov st, v%x", reg_x); break;
+                case 0x1e: snprintf(out, n, "add I, v%x", reg_x); break;
+                case 0x29: snprintf(out, n, "lds v%x", reg_x); break;
+                case 0x33: snprintf(out, n, "bcd v%x", reg_x); break;
+                case 0x55: snprintf(out, n, "mov [I], v%x", reg_x); break;
+                case 0x65: snprintf(out, n, "mov v%x, [I]", reg_x); break;
+                case 0x30: snprintf(out, n, "ldhf v%x", reg_x); break;
+                case 0x75: snprintf(out, n, "mov rpl, v%x", reg_x); break;
+                case 0x85: snprintf(out, n, "mov v%x, rpl", reg_x); break;
+                case 0x01: snprintf(out, n, "plane 0x%x", reg_x); break;
+                case 0x02: if(reg_x == 0) snprintf(out, n, "audio"); break;
+                case 0x3a: snprintf(out, n, "pitch v%x", reg_x); break;
+                case 0x00: if(reg_x == 0) snprintf(out, n, "mov I, long"); break;
+            }
+        } break;
+        default: break;
+    }
+}
+
+// Returns the mnemonic of an instruction, an empty string for anything that is not one
+const char* DisassembleInstruction(uint16_t instr)
+{
+    uint64_t bit = 1ull << (instr & 63);
+
+    if((disasm_built[instr >> 6] & bit) == 0) {
+        FormatInstruction(disasm_table[instr], instr);
+        disasm_built[instr >> 6] |= bit;
+    }
+    return disasm_table[instr];
+}
+
+// Writes a listing of every instruction word in code, which is loaded at base:
+//
+//   0x200  0x00e0  cls
+//
+// Words that do not decode to an instruction (sprite data and such) are listed as data
+void DisassembleListing(FILE* out, const uint8_t* code, size_t size, uint16_t base)
+{
+    for(size_t offset = 0; offset + 1 < size; offset += 2) {
+        uint16_t    instr    = ((uint16_t) code[offset]) << 8 | code[offset + 1];
+        const char* mnemonic = DisassembleInstruction(instr);
+
+        fprintf(out, "0x%03x  0x%04x  %s\n", (unsigned)(base + offset), instr,
+                mnemonic[0] != '\0' ? mnemonic : "data");
+    }
+    if(size & 1)
+        fprintf(out, "0x%03x  0x%02x    data\n", (unsigned)(base + size - 1), code[size - 1]);
+}
@@ -0,0 +1,200 @@
+#include "Chip8.h"
+
+// The emulation thread.
+//
+// Real time is turned into emulated time one batch at a time as before (ScheduleRealTime), but
+// the thread then sleeps until the next timer tick is due (the pacer's deadline) rather than
+// until the next display refresh, so how long presenting takes no longer matters. Key changes
+// that go straight to the program wake it early, the cycles they happened in are run right away.
+// While the program waits on a key or spins in an idle loop (sched->idle) nothing it shows
+// depends on exactly when the tick comes, so the thread sleeps through without spinning.
+
+// The tone hook is only installed while emulating in real time, and only ever called from here,
+// which keeps the audio ring single-producer
+static void UpdateTone(Chip8_Emulation* emu, bool realtime)
+{
+    Chip8_Scheduler* sched = emu->sched;
+
+    if(emu->audio != NULL && realtime && sched->tone_hook == NULL) {
+        sched->tone_hook      = PostTone;
+        sched->tone_arg       = emu->audio;
+        sched->tone_on        = false;
+        emu->audio->anchored  = false;
+    } else if(!realtime && sched->tone_hook != NULL) {
+        PostTone(emu->audio, false, sched->cycle_count);
+        sched->tone_hook = NULL;
+    }
+}
+
+static void PublishFrame(Chip8_Emulation* emu)
+{
+    Chip8_Frame* frame = &emu->frames[emu->back];
+    frame->cpu         = *emu->cpu;
+    frame->timer_ticks = emu->sched->timer_ticks;
+    memcpy(frame->memory, emu->mem->ptr_8, emu->mem->memory_size);
+    memcpy(frame->screen, emu->mem->screen_buffer, emu->mem->screen_words * sizeof(uint64_t));
+    if(emu->options->exporter != NULL)
+        ExportFrame(emu->options->exporter, emu->cpu, emu->mem, emu->sched->timer_ticks);
+
+    uint32_t middle = atomic_exchange_explicit(&emu->middle, emu->back | CHIP8_FRAME_FRESH, memory_order_acq_rel);
+    emu->back = middle & ~CHIP8_FRAME_FRESH;
+
+    if(atomic_exchange_explicit(&emu->frame_wanted, false, memory_order_acq_rel)) {
+        SDL_Event event = {};
+        event.type = emu->frame_event;
+        SDL_PushEvent(&event);
+    }
+}
+
+// The newest frame published, 'fresh' tells whether it is newer than the last one taken
+const Chip8_Frame* TakeFrame(Chip8_Emulation* emu, bool* fresh)
+{
+    *fresh = (atomic_load_explicit(&emu->middle, memory_order_relaxed) & CHIP8_FRAME_FRESH) != 0;
+    if(*fresh) {
+        uint32_t middle = atomic_exchange_explicit(&emu->middle, emu->front, memory_order_acq_rel);
+        emu->front = middle & ~CHIP8_FRAME_FRESH;
+    }
+    return &emu->frames[emu->front];
+}
+
+static int RunEmulation(void* arg)
+{
+    Chip8_Emulation*     emu     = (Chip8_Emulation*) arg;
+    Chip8_CPU*           cpu     = emu->cpu;
+    Chip8_Memory*        mem     = emu->mem;
+    Chip8_Scheduler*     sched   = emu->sched;
+    const Chip8_Options* options = emu->options;
+    Chip8_Pacer*         pacer   = emu->pacer;
+
+    uint64_t rewind_tick    = sched->timer_ticks;
+    uint64_t record_backlog = 0;
+    uint64_t t_rewind       = 0;
+    uint64_t frame_period   = pacer->frequency / CHIP8_TIMER_HZ;
+
+    while(atomic_load_explicit(&emu->running, memory_order_relaxed)) {
+        bool rewinding = emu->rewind != NULL && atomic_load_explicit(&emu->rewinding, memory_order_relaxed);
+        bool turbo     = options->turbo != atomic_load_explicit(&emu->turbo_held, memory_order_relaxed);
+        UpdateTone(emu, !rewinding && !turbo);
+
+        // Keys from the export ring are picked up once per batch, at least once a frame
+        if(options->exporter != NULL) {
+            uint16_t pressed, released;
+            ExportedKeys(options->exporter, &pressed, &released);
+            ApplyKeys(emu->input, pressed, released);
+        }
+
+        // Emulate however many cycles the real time since the last batch is worth, unless
+        // rewinding, which steps back one state per frame's worth of real time, or fast-forwarding,
+        // which emulates whole frames flat out; the render thread presents the newest of them
+        // once per display refresh and skips the rest
+        if(rewinding) {
+            PaceSkip(pacer);
+            if(pacer->last - t_rewind >= frame_period) {
+                t_rewind = pacer->last;
+                PopRewind(emu->rewind, cpu, mem, sched);
+                rewind_tick = sched->timer_ticks;
+                PublishFrame(emu);
+            }
+            WaitForDeadline(pacer, emu->wake, t_rewind + frame_period, false);
+        } else if(turbo) {
+            PaceSkip(pacer);
+            if(options->recording != NULL)
+                RecordFrame(options->recording, LatchKeys(emu->input));
+            RunFrames(sched, cpu, mem, 1);
+            if(emu->rewind != NULL)
+                PushRewind(emu->rewind, cpu, mem, sched);
+            rewind_tick    = sched->timer_ticks;
+            record_backlog = 0;
+            PublishFrame(emu);
+        } else if(options->recording != NULL) {
+            record_backlog += PaceRealTime(pacer, sched);
+            while(record_backlog >= CyclesUntilTick(sched)) {
+                record_backlog -= CyclesUntilTick(sched);
+                RecordFrame(options->recording, LatchKeys(emu->input));
+                RunFrames(sched, cpu, mem, 1);
+            }
+            PublishFrame(emu);
+            PaceFrame(pacer, sched, record_backlog);
+            WaitForDeadline(pacer, emu->wake, pacer->deadline, !sched->idle);
+        } else {
+            RunCycles(sched, cpu, mem, PaceRealTime(pacer, sched));
+            if(emu->rewind != NULL && sched->timer_ticks != rewind_tick) {
+                rewind_tick = sched->timer_ticks;
+                PushRewind(emu->rewind, cpu, mem, sched);
+            }
+            PublishFrame(emu);
+            PaceFrame(pacer, sched, 0);
+            WaitForDeadline(pacer, emu->wake, pacer->deadline, !sched->idle);
+        }
+    }
+
+    UpdateTone(emu, false);
+    return 0;
+}
+
+bool StartEmulation(Chip8_Emulation* emu)
+{
+    size_t memory_size = emu->mem->memory_size;
+    size_t screen_size = emu->mem->screen_words * sizeof(uint64_t);
+
+    // Every frame starts out as the current state, so the render thread has one from the start
+    for(int f = 0; f < 3; f++) {
+        emu->frames[f].memory = (uint8_t*) malloc(memory_size);
+        emu->frames[f].screen = (uint64_t*) malloc(screen_size);
+        if(emu->frames[f].memory == NULL || emu->frames[f].screen == NULL) {
+            StopEmulation(emu);
+            return false;
+        }
+        emu->frames[f].cpu         = *emu->cpu;
+        emu->frames[f].timer_ticks = emu->sched->timer_ticks;
+        memcpy(emu->frames[f].memory, emu->mem->ptr_8, memory_size);
+        memcpy(emu->frames[f].screen, emu->mem->screen_buffer, screen_size);
+    }
+    emu->front = 0;
+    emu->back  = 2;
+    atomic_init(&emu->middle, 1);
+    atomic_init(&emu->running, true);
+    atomic_init(&emu->rewinding, false);
+    atomic_init(&emu->turbo_held, false);
+    atomic_init(&emu->frame_wanted, false);
+
+    emu->frame_event = SDL_RegisterEvents(1);
+    emu->wake        = SDL_CreateSemaphore(0);
+    if(emu->frame_event == (uint32_t) -1 || emu->wake == NULL) {
+        StopEmulation(emu);
+        return false;
+    }
+
+    // Handed to the input before the thread exists and taken back after it has finished, so
+    // the thread never sees it change
+    emu->input->wake = emu->wake;
+    emu->thread = SDL_CreateThread(RunEmulation, "emulation", emu);
+    if(emu->thread == NULL) {
+        StopEmulation(emu);
+        return false;
+    }
+    return true;
+}
+
+// Waits for the thread to finish its batch, the CPU, memory and scheduler are the caller's again
+void StopEmulation(Chip8_Emulation* emu)
+{
+    if(emu->thread != NULL) {
+        atomic_store(&emu->running, false);
+        SDL_SemPost(emu->wake);
+        SDL_WaitThread(emu->thread, NULL);
+        emu->thread = NULL;
+    }
+    if(emu->input != NULL)
+        emu->input->wake = NULL;
+    if(emu->wake != NULL)
+        SDL_DestroySemaphore(emu->wake);
+    emu->wake = NULL;
+
+    for(int f = 0; f < 3; f++) {
+        free(emu->frames[f].memory);
+        free(emu->frames[f].screen);
+        emu->frames[f].memory = NULL;
+        emu->frames[f].screen = NULL;
+    }
+}
@@ -0,0 +1,271 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "Chip8_Env.h"
+#include "Chip8_Pool.h"
+
+// Batched environment.
+//
+// The instances live in one array, each padded to whole cache lines so that workers stepping
+// neighbouring instances never write to the same line, and their memories and screens come out
+// of two blocks allocated up front. A step hands the pool one task per CHIP8_ENV_CHUNK
+// instances: small enough that stealing evens out ROMs that take longer on some instances,
+// large enough that the task overhead does not matter. A batch that fits in one chunk is
+// stepped on the calling thread without waking the pool.
+
+typedef struct ENVINSTANCE {
+    Chip8_CPU       cpu;
+    Chip8_Memory    mem;
+    Chip8_Scheduler sched;
+} __attribute__((aligned(64))) Env_Instance;
+
+struct CHIP8ENV {
+    uint8_t*      program;
+    size_t        rom_size;
+    size_t        num_envs;
+    Env_Instance* instances;
+    uint8_t*      memory;               // memory_size bytes per instance
+    uint64_t*     screens;              // VariantScreenWords per instance
+    Chip8_Pool*   pool;                 // NULL when stepping on one thread
+
+    size_t planes;                      // Shape of an observation
+    size_t height;
+    size_t row_bytes;
+
+    Chip8_ScoreSource score_source;
+    uint16_t          score_location;
+    Chip8_EnvReward   reward;
+    void*             reward_arg;
+
+    // The step in progress, for the pool tasks
+    const uint16_t* actions;
+    uint8_t*        observations;
+    float*          rewards;
+    size_t          count;
+};
+
+Chip8_Env* CreateEnv(const uint8_t* program, size_t size, Chip8_Variant variant, size_t num_envs,
+                     uint32_t instructions_per_second, Chip8_Engine engine, size_t num_threads)
+{
+    Chip8_Env* env = (Chip8_Env*) calloc(1, sizeof(Chip8_Env));
+    if(env == NULL)
+        return NULL;
+
+    size_t memory_size  = VariantMemorySize(variant);
+    size_t screen_words = VariantScreenWords(variant);
+
+    env->rom_size  = size;
+    env->program   = (uint8_t*) malloc(size ? size : 1);
+    env->instances = (Env_Instance*) aligned_alloc(64, (num_envs ? num_envs : 1) * sizeof(Env_Instance));
+    env->memory    = (uint8_t*) malloc((num_envs ? num_envs : 1) * memory_size);
+    env->screens   = (uint64_t*) malloc((num_envs ? num_envs : 1) * screen_words * sizeof(uint64_t));
+    if(env->program == NULL || env->instances == NULL || env->memory == NULL || env->screens == NULL) {
+        DestroyEnv(env);
+        return NULL;
+    }
+    memcpy(env->program, program, size);
+    memset(env->instances, 0x00, num_envs * sizeof(Env_Instance));
+    env->num_envs = num_envs;
+
+    env->planes    = variant == CHIP8_VARIANT_XOCHIP ? CHIP8_PLANES : 1;
+    env->height    = variant == CHIP8_VARIANT_CHIP8 ? CHIP8_SCREEN_HEIGHT : CHIP8_HIRES_HEIGHT;
+    env->row_bytes = (variant == CHIP8_VARIANT_CHIP8 ? CHIP8_SCREEN_WIDTH : CHIP8_HIRES_WIDTH) / 8;
+
+    for(size_t idx = 0; idx < num_envs; idx++) {
+        Env_Instance* inst = &env->instances[idx];
+        inst->mem.variant       = variant;
+        inst->mem.ptr_8         = env->memory + idx * memory_size;
+        inst->mem.screen_buffer = env->screens + idx * screen_words;
+        InitializeScheduler(&inst->sched, instructions_per_second);
+        SetEngine(&inst->sched, engine);
+    }
+
+    if(num_threads == 0)
+        num_threads = CountCores();
+    if(num_threads > 1 && num_envs > CHIP8_ENV_CHUNK) {
+        env->pool = CreatePool(num_threads);
+        if(env->pool == NULL) {
+            DestroyEnv(env);
+            return NULL;
+        }
+    }
+
+    ResetEnv(env, CHIP8_DEFAULT_SEED, NULL);
+    return env;
+}
+
+void DestroyEnv(Chip8_Env* env)
+{
+    if(env == NULL)
+        return;
+    if(env->pool != NULL)
+        DestroyPool(env->pool);
+    if(env->instances != NULL) {
+        for(size_t idx = 0; idx < env->num_envs; idx++)
+            FreeScheduler(&env->instances[idx].sched);
+    }
+    free(env->instances);
+    free(env->memory);
+    free(env->screens);
+    free(env->program);
+    free(env);
+}
+
+size_t EnvCount(const Chip8_Env* env)
+{
+    return env->num_envs;
+}
+
+size_t EnvObservationSize(const Chip8_Env* env)
+{
+    return env->planes * env->height * env->row_bytes;
+}
+
+void EnvObservationShape(const Chip8_Env* env, size_t* planes, size_t* height, size_t* width)
+{
+    *planes = env->planes;
+    *height = env->height;
+    *width  = env->row_bytes * 8;
+}
+
+void SetEnvScore(Chip8_Env* env, Chip8_ScoreSource source, uint16_t location)
+{
+    env->score_source   = source;
+    env->score_location = location;
+}
+
+void SetEnvReward(Chip8_Env* env, Chip8_EnvReward reward, void* arg)
+{
+    env->reward     = reward;
+    env->reward_arg = arg;
+}
+
+static uint8_t ScoreOf(const Chip8_Env* env, const Env_Instance* inst)
+{
+    switch(env->score_source) {
+        case CHIP8_SCORE_REGISTER: return inst->cpu.VX[env->score_location & 0xF];
+        case CHIP8_SCORE_MEMORY:   return inst->mem.ptr_8[env->score_location & (inst->mem.memory_size - 1)];
+        default:                   return 0;
+    }
+}
+
+// Each bit of a 32 pixel half row twice, for showing 64x32 mode at 128x64
+static uint64_t DoubleBits(uint32_t bits)
+{
+    uint64_t x = bits;
+    x = (x | x << 16) & 0x0000FFFF0000FFFFull;
+    x = (x | x << 8)  & 0x00FF00FF00FF00FFull;
+    x = (x | x << 4)  & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | x << 2)  & 0x3333333333333333ull;
+    x = (x | x << 1)  & 0x5555555555555555ull;
+    return x | x << 1;
+}
+
+// Screen words keep the leftmost pixel in the top bit, stored big-endian that is the top bit
+// of the first byte
+static void PutWord(uint8_t* out, uint64_t word)
+{
+    word = __builtin_bswap64(word);
+    memcpy(out, &word, sizeof(uint64_t));
+}
+
+static void WriteObservation(const Chip8_Env* env, const Env_Instance* inst, uint8_t* out)
+{
+    const Chip8_Memory* mem = &inst->mem;
+
+    for(size_t plane = 0; plane < env->planes; plane++) {
+        const uint64_t* screen = mem->screen_buffer + plane * mem->plane_words;
+
+        if(mem->screen_h == env->height) {
+            for(size_t word = 0; word < env->height * mem->row_words; word++, out += 8)
+                PutWord(out, screen[word]);
+            continue;
+        }
+        for(size_t row = 0; row < mem->screen_h; row++, out += 2 * env->row_bytes) {
+            PutWord(out,     DoubleBits((uint32_t)(screen[row] >> 32)));
+            PutWord(out + 8, DoubleBits((uint32_t) screen[row]));
+            memcpy(out + env->row_bytes, out, env->row_bytes);
+        }
+    }
+}
+
+static void ResetInstance(Chip8_Env* env, size_t index, uint32_t seed)
+{
+    Env_Instance* inst = &env->instances[index];
+
+    // Nearby seeds give nearby xorshift states, the index is mixed in so instances diverge
+    uint32_t mixed = seed ^ (uint32_t)(index * 0x9E3779B9u);
+    mixed ^= mixed >> 16;
+    mixed *= 0x85EBCA6Bu;
+    mixed ^= mixed >> 13;
+
+    Initialize(env->program, env->rom_size, &inst->cpu, &inst->mem);
+    SeedRandom(&inst->cpu, mixed);
+    atomic_store_explicit(&inst->mem.key_states, 0, memory_order_relaxed);
+    inst->sched.timer_accumulator = 0;
+    inst->sched.idle              = false;
+    FlushEngine(&inst->sched);
+}
+
+void ResetEnv(Chip8_Env* env, uint32_t seed, uint8_t* observations)
+{
+    for(size_t idx = 0; idx < env->num_envs; idx++) {
+        ResetInstance(env, idx, seed);
+        if(observations != NULL)
+            WriteObservation(env, &env->instances[idx], observations + idx * EnvObservationSize(env));
+    }
+}
+
+void ResetEnvIndex(Chip8_Env* env, size_t index, uint32_t seed, uint8_t* observations)
+{
+    if(index >= env->num_envs)
+        return;
+    ResetInstance(env, index, seed);
+    if(observations != NULL)
+        WriteObservation(env, &env->instances[index], observations + index * EnvObservationSize(env));
+}
+
+// Pool task: steps the instances of chunk 'index'
+static void StepChunk(void* arg, size_t index, size_t worker)
+{
+    (void) worker;
+    Chip8_Env* env   = (Chip8_Env*) arg;
+    size_t     first = index * CHIP8_ENV_CHUNK;
+    size_t     last  = first + CHIP8_ENV_CHUNK < env->count ? first + CHIP8_ENV_CHUNK : env->count;
+
+    for(size_t idx = first; idx < last; idx++) {
+        Env_Instance* inst  = &env->instances[idx];
+        uint8_t       score = ScoreOf(env, inst);
+
+        if(env->actions[idx] != atomic_load_explicit(&inst->mem.key_states, memory_order_relaxed)) {
+            atomic_store_explicit(&inst->mem.key_states, env->actions[idx], memory_order_relaxed);
+            atomic_store_explicit(&inst->mem.key_fresh, true, memory_order_release);
+        }
+        RunFrames(&inst->sched, &inst->cpu, &inst->mem, 1);
+
+        if(env->rewards != NULL) {
+            if(env->reward != NULL)
+                env->rewards[idx] = env->reward(env->reward_arg, idx, &inst->cpu, &inst->mem);
+            else
+                env->rewards[idx] = (float)(int8_t)(ScoreOf(env, inst) - score);
+        }
+        if(env->observations != NULL)
+            WriteObservation(env, inst, env->observations + idx * EnvObservationSize(env));
+    }
+}
+
+void StepEnv(Chip8_Env* env, const uint16_t* actions, size_t num_envs, uint8_t* observations, float* rewards)
+{
+    env->actions      = actions;
+    env->observations = observations;
+    env->rewards      = rewards;
+    env->count        = num_envs < env->num_envs ? num_envs : env->num_envs;
+
+    size_t chunks = (env->count + CHIP8_ENV_CHUNK - 1) / CHIP8_ENV_CHUNK;
+    if(env->pool != NULL && chunks > 1)
+        RunPool(env->pool, chunks, StepChunk, env);
+    else {
+        for(size_t chunk = 0; chunk < chunks; chunk++)
+            StepChunk(env, chunk, 0);
+    }
+}
@@ -0,0 +1,192 @@
+#include "Chip8_Core.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// Shared memory export.
+//
+// Writing a frame is a copy of the CPU and of the screen words in use, at most 2KB, between two
+// stores of the slot's sequence number; no system call and no lock, so the emulation thread does
+// not notice it. A reader that is too slow loses frames (the sequence numbers tell it how many)
+// but never holds the writer up. POSIX hosts use shm_open, where the name shows up under
+// /dev/shm, Windows a named file mapping.
+
+struct CHIP8EXPORT {
+    Chip8_ExportRing* ring;
+    uint64_t          sequence;         // Of the last frame written
+    uint16_t          keys;             // ring->keys as last applied
+    char              name[];
+};
+
+static void* MapRing(const char* name, bool create)
+{
+#ifdef _WIN32
+    if(*name == '/')
+        name++;
+    HANDLE mapping = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                                                 sizeof(Chip8_ExportRing), name)
+                            : OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    if(mapping == NULL)
+        return NULL;
+    void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(Chip8_ExportRing));
+    CloseHandle(mapping);   // The view keeps the mapping alive
+    return view;
+#else
+    int fd = shm_open(name, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0600);
+    if(fd < 0)
+        return NULL;
+    if(create && ftruncate(fd, sizeof(Chip8_ExportRing)) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    void* view = mmap(NULL, sizeof(Chip8_ExportRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(view == MAP_FAILED) {
+        if(create)
+            shm_unlink(name);
+        return NULL;
+    }
+    return view;
+#endif
+}
+
+static void UnmapRing(Chip8_ExportRing* ring)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(ring);
+#else
+    munmap(ring, sizeof(Chip8_ExportRing));
+#endif
+}
+
+// Names are POSIX shared memory names, a leading '/' is added if missing
+Chip8_Export* OpenExport(const char* name, Chip8_Variant variant)
+{
+    size_t        length = strlen(name);
+    Chip8_Export* exp    = (Chip8_Export*) calloc(1, sizeof(Chip8_Export) + length + 2);
+    if(exp == NULL)
+        return NULL;
+    snprintf(exp->name, length + 2, "%s%s", *name == '/' ? "" : "/", name);
+
+    exp->ring = (Chip8_ExportRing*) MapRing(exp->name, true);
+    if(exp->ring == NULL) {
+        free(exp);
+        return NULL;
+    }
+
+    Chip8_ExportRing* ring = exp->ring;
+    ring->version   = CHIP8_EXPORT_VERSION;
+    ring->slot_size = sizeof(Chip8_ExportSlot);
+    ring->num_slots = CHIP8_EXPORT_SLOTS;
+    ring->variant   = variant;
+    atomic_init(&ring->keys, 0);
+    atomic_init(&ring->latest, 0);
+    for(int s = 0; s < CHIP8_EXPORT_SLOTS; s++)
+        atomic_init(&ring->slots[s].sequence, 0);
+    atomic_thread_fence(memory_order_release);
+    memcpy(ring->magic, "C8FB", 4);
+    return exp;
+}
+
+// Removes the name, readers still attached keep their mapping
+void CloseExport(Chip8_Export* exp)
+{
+    if(exp == NULL)
+        return;
+    UnmapRing(exp->ring);
+#ifndef _WIN32
+    shm_unlink(exp->name);
+#endif
+    free(exp);
+}
+
+void ExportFrame(Chip8_Export* exp, const Chip8_CPU* cpu, const Chip8_Memory* mem, uint64_t timer_ticks)
+{
+    uint64_t          sequence = ++exp->sequence;
+    Chip8_ExportSlot* slot     = &exp->ring->slots[sequence % CHIP8_EXPORT_SLOTS];
+
+    atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->timer_ticks  = timer_ticks;
+    slot->cpu          = *cpu;
+    slot->key_states   = atomic_load_explicit(&mem->key_states, memory_order_relaxed);
+    slot->screen_w     = mem->screen_w;
+    slot->screen_h     = mem->screen_h;
+    slot->row_words    = mem->row_words;
+    slot->plane_words  = mem->plane_words;
+    slot->screen_words = mem->screen_words;
+    memcpy(slot->screen, mem->screen_buffer, mem->screen_words * sizeof(uint64_t));
+
+    atomic_store_explicit(&slot->sequence, sequence, memory_order_release);
+    atomic_store_explicit(&exp->ring->latest, sequence, memory_order_release);
+}
+
+// The keys readers hold, and which of them went down or up since the last call
+uint16_t ExportedKeys(Chip8_Export* exp, uint16_t* pressed, uint16_t* released)
+{
+    uint16_t keys = atomic_load_explicit(&exp->ring->keys, memory_order_relaxed);
+    *pressed  = keys & ~exp->keys;
+    *released = exp->keys & ~keys;
+    exp->keys = keys;
+    return keys;
+}
+
+// Maps a ring another process exports, NULL if there is none by that name or it is of another
+// version
+Chip8_ExportRing* AttachExport(const char* name)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s%s", *name == '/' ? "" : "/", name);
+
+    Chip8_ExportRing* ring = (Chip8_ExportRing*) MapRing(path, false);
+    if(ring == NULL)
+        return NULL;
+    if(memcmp(ring->magic, "C8FB", 4) != 0 || ring->version != CHIP8_EXPORT_VERSION ||
+       ring->slot_size != sizeof(Chip8_ExportSlot) || ring->num_slots != CHIP8_EXPORT_SLOTS) {
+        UnmapRing(ring);
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return ring;
+}
+
+void DetachExport(Chip8_ExportRing* ring)
+{
+    if(ring != NULL)
+        UnmapRing(ring);
+}
+
+// The newest frame, NULL if there is none yet or it is already being overwritten. Check
+// ExportIntact after reading it
+const Chip8_ExportSlot* LatestExport(const Chip8_ExportRing* ring, uint64_t* sequence)
+{
+    *sequence = atomic_load_explicit(&ring->latest, memory_order_acquire);
+    if(*sequence == 0)
+        return NULL;
+
+    const Chip8_ExportSlot* slot = &ring->slots[*sequence % CHIP8_EXPORT_SLOTS];
+    if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != *sequence)
+        return NULL;
+    return slot;
+}
+
+// Whether the slot still held frame 'sequence' all the while it was being read
+bool ExportIntact(const Chip8_ExportSlot* slot, uint64_t sequence)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence;
+}
+
+void SetExportKey(Chip8_ExportRing* ring, uint8_t key, bool down)
+{
+    uint16_t bit = 0x8000 >> (key & 0xF);
+    if(down) atomic_fetch_or_explicit(&ring->keys, bit, memory_order_relaxed);
+    else     atomic_fetch_and_explicit(&ring->keys, (uint16_t) ~bit, memory_order_relaxed);
+}
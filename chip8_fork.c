@@ -0,0 +1,225 @@
+#include "Chip8_Core.h"
+
+// Forks.
+//
+// The engines read and write guest memory in place (the JIT even bakes its address into the
+// generated code), so a running instance always owns a flat copy of its memory. Copy-on-write
+// happens at the boundaries instead: a fork's memory and screen are split into CHIP8_FORK_PAGE
+// byte pages shared between forks by reference count. Capturing an instance against its parent
+// fork compares page by page and only allocates the pages that were written to, restoring one
+// only copies (and invalidates the engine's translations of) the pages that differ from what
+// the instance holds. Cloning, the branching step of a search, never copies a page at all.
+
+struct CHIP8FORKPAGE {
+    uint32_t refs;
+    union {
+        struct CHIP8FORKPAGE* next_free;
+        uint8_t               data[CHIP8_FORK_PAGE];
+    };
+};
+
+static const size_t FORK_SLAB_PAGES = 256;
+static const size_t FORK_SLAB_FORKS = 64;
+
+// Allocates 'count' objects of 'size' bytes in one block and threads them onto a free list
+static void* AllocateSlab(Chip8_ForkPool* pool, size_t size, size_t count)
+{
+    size_t   header = (sizeof(void*) + 15) & ~(size_t) 15;
+    uint8_t* slab   = (uint8_t*) malloc(header + size * count);
+    if(slab == NULL)
+        return NULL;
+
+    *(void**) slab = pool->slabs;
+    pool->slabs    = slab;
+    return slab + header;
+}
+
+static Chip8_ForkPage* AllocatePage(Chip8_ForkPool* pool)
+{
+    if(pool->free_pages == NULL) {
+        Chip8_ForkPage* pages = (Chip8_ForkPage*) AllocateSlab(pool, sizeof(Chip8_ForkPage), FORK_SLAB_PAGES);
+        if(pages == NULL)
+            return NULL;
+        for(size_t idx = 0; idx < FORK_SLAB_PAGES; idx++) {
+            pages[idx].next_free = pool->free_pages;
+            pool->free_pages     = &pages[idx];
+        }
+    }
+
+    Chip8_ForkPage* page = pool->free_pages;
+    pool->free_pages = page->next_free;
+    page->refs       = 1;
+    pool->live_pages++;
+    return page;
+}
+
+static void ReleasePage(Chip8_ForkPool* pool, Chip8_ForkPage* page)
+{
+    if(--page->refs == 0) {
+        page->next_free  = pool->free_pages;
+        pool->free_pages = page;
+        pool->live_pages--;
+    }
+}
+
+static Chip8_Fork* AllocateFork(Chip8_ForkPool* pool)
+{
+    if(pool->free_forks == NULL) {
+        uint8_t* forks = (uint8_t*) AllocateSlab(pool, pool->fork_size, FORK_SLAB_FORKS);
+        if(forks == NULL)
+            return NULL;
+        for(size_t idx = 0; idx < FORK_SLAB_FORKS; idx++) {
+            Chip8_Fork* fork = (Chip8_Fork*)(forks + idx * pool->fork_size);
+            fork->next_free  = pool->free_forks;
+            pool->free_forks = fork;
+        }
+    }
+
+    Chip8_Fork* fork = pool->free_forks;
+    pool->free_forks = fork->next_free;
+    pool->live_forks++;
+    return fork;
+}
+
+// Page 'idx' of an instance: memory pages first, then the screen
+static uint8_t* PageOf(const Chip8_ForkPool* pool, const Chip8_Memory* mem, size_t idx, size_t* size)
+{
+    uint8_t* base  = mem->ptr_8;
+    size_t   total = mem->memory_size;
+
+    if(idx >= pool->memory_pages) {
+        base  = (uint8_t*) mem->screen_buffer;
+        total = pool->screen_size;
+        idx  -= pool->memory_pages;
+    }
+
+    size_t offset = idx * CHIP8_FORK_PAGE;
+    *size = total - offset < CHIP8_FORK_PAGE ? total - offset : CHIP8_FORK_PAGE;
+    return base + offset;
+}
+
+Chip8_ForkPool* CreateForkPool(const Chip8_Memory* mem)
+{
+    Chip8_ForkPool* pool = (Chip8_ForkPool*) calloc(1, sizeof(Chip8_ForkPool));
+    if(pool == NULL)
+        return NULL;
+
+    pool->screen_size  = mem->screen_words * sizeof(uint64_t);
+    pool->memory_pages = (mem->memory_size + CHIP8_FORK_PAGE - 1) / CHIP8_FORK_PAGE;
+    pool->num_pages    = pool->memory_pages + (pool->screen_size + CHIP8_FORK_PAGE - 1) / CHIP8_FORK_PAGE;
+    pool->fork_size    = sizeof(Chip8_Fork) + pool->num_pages * sizeof(Chip8_ForkPage*);
+    pool->fork_size    = (pool->fork_size + 15) & ~(size_t) 15;
+    return pool;
+}
+
+// Frees every fork and page at once, including those still in use
+void DestroyForkPool(Chip8_ForkPool* pool)
+{
+    if(pool == NULL)
+        return;
+    while(pool->slabs != NULL) {
+        void* next = *(void**) pool->slabs;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+    free(pool);
+}
+
+// Forks a running instance. Pages equal to the parent's (which may be NULL) are shared with it
+Chip8_Fork* CaptureFork(Chip8_ForkPool* pool, const Chip8_Fork* parent, const Chip8_CPU* cpu,
+                        const Chip8_Memory* mem, const Chip8_Scheduler* sched)
+{
+    Chip8_Fork* fork = AllocateFork(pool);
+    if(fork == NULL)
+        return NULL;
+
+    fork->cpu               = *cpu;
+    fork->timer_accumulator = sched->timer_accumulator;
+
+    for(size_t idx = 0; idx < pool->num_pages; idx++) {
+        size_t   size;
+        uint8_t* data = PageOf(pool, mem, idx, &size);
+
+        if(parent != NULL && memcmp(parent->pages[idx]->data, data, size) == 0) {
+            fork->pages[idx] = parent->pages[idx];
+            fork->pages[idx]->refs++;
+            continue;
+        }
+
+        fork->pages[idx] = AllocatePage(pool);
+        if(fork->pages[idx] == NULL) {
+            while(idx-- > 0)
+                ReleasePage(pool, fork->pages[idx]);
+            fork->next_free  = pool->free_forks;
+            pool->free_forks = fork;
+            pool->live_forks--;
+            return NULL;
+        }
+        memcpy(fork->pages[idx]->data, data, size);
+    }
+    return fork;
+}
+
+Chip8_Fork* CloneFork(Chip8_ForkPool* pool, const Chip8_Fork* fork)
+{
+    Chip8_Fork* clone = AllocateFork(pool);
+    if(clone == NULL)
+        return NULL;
+
+    clone->cpu               = fork->cpu;
+    clone->timer_accumulator = fork->timer_accumulator;
+    for(size_t idx = 0; idx < pool->num_pages; idx++) {
+        clone->pages[idx] = fork->pages[idx];
+        clone->pages[idx]->refs++;
+    }
+    return clone;
+}
+
+// Loads a fork into a running instance. Only the pages that differ are copied, and only those
+// are invalidated in the engine, restoring siblings one after the other keeps their code cached
+void RestoreFork(const Chip8_ForkPool* pool, const Chip8_Fork* fork, Chip8_CPU* cpu,
+                 Chip8_Memory* mem, Chip8_Scheduler* sched)
+{
+    bool mode_changed = cpu->hires != fork->cpu.hires;
+    *cpu = fork->cpu;
+    sched->timer_accumulator = fork->timer_accumulator;
+    ApplyScreenMode(cpu, mem);
+    if(sched->jit != NULL)
+        UnlinkJit(sched->jit);
+
+    for(size_t idx = 0; idx < pool->memory_pages; idx++) {
+        size_t   size;
+        uint8_t* data = PageOf(pool, mem, idx, &size);
+
+        if(memcmp(data, fork->pages[idx]->data, size) != 0) {
+            memcpy(data, fork->pages[idx]->data, size);
+            InvalidateEngine(sched, idx * CHIP8_FORK_PAGE, size);
+        }
+    }
+
+    // The screen is compared word by word, the frontend only uploads the rows that changed
+    for(size_t idx = 0; idx < mem->screen_words; idx++) {
+        size_t    page = pool->memory_pages + idx * sizeof(uint64_t) / CHIP8_FORK_PAGE;
+        uint64_t  word;
+        memcpy(&word, fork->pages[page]->data + idx * sizeof(uint64_t) % CHIP8_FORK_PAGE, sizeof(uint64_t));
+
+        if(mem->screen_buffer[idx] != word) {
+            mem->screen_buffer[idx] = word;
+            mem->dirty_rows        |= 1ULL << ((idx % mem->plane_words) / mem->row_words & 63);
+        }
+    }
+    if(mode_changed)
+        mem->dirty_rows = ~0ull;
+}
+
+void FreeFork(Chip8_ForkPool* pool, Chip8_Fork* fork)
+{
+    if(fork == NULL)
+        return;
+    for(size_t idx = 0; idx < pool->num_pages; idx++)
+        ReleasePage(pool, fork->pages[idx]);
+
+    fork->next_free  = pool->free_forks;
+    pool->free_forks = fork;
+    pool->live_forks--;
+}
@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+
+#include "Chip8_Core.h"
+
+// Runs a ROM without any window, input or rendering and reports the raw throughput of the core.
+//
+//   chip8_headless <rom> [-ips N] [-engine interp|cached|jit|static] [-variant chip8|schip|xochip]
+//                  (-n INSTRUCTIONS | -frames FRAMES)
+//   chip8_headless <rom> -disasm
+//   chip8_headless <rom> [-ips N] -lanes L (-n INSTRUCTIONS | -frames FRAMES)
+//   chip8_headless <rom> [-engine interp|cached|jit|static] -replay RECORDING
+//   chip8_headless <rom> [-ips N] [-engine interp|cached|jit|static] [-variant chip8|schip|xochip]
+//                  -export NAME [-frames FRAMES]
+//
+// Runs and replays also take -profile FILE in builds with -DCHIP8_PROFILE, which writes the
+// profiling counters (see Chip8_Profile) to FILE as JSON.
+//
+// -n runs the given number of instruction cycles, -frames the given number of emulated 60hz
+// frames. -ips sets the emulated instruction rate, which decides how many cycles make a frame.
+// -variant picks the instruction set the ROM was written for, CHIP-8 unless given.
+// -disasm writes a listing of the whole ROM to stdout instead of running it. -lanes runs L
+// instances in lockstep (see Chip8_Lockstep), each seeded differently, and reports their total.
+// -replay runs a recording made with the interpreter's -record as fast as possible, at the rate
+// and seed it was recorded with, and checks that it ends in the same state (exit status 1 if not).
+// -export runs in real time instead, publishing every frame to the shared memory ring NAME (see
+// Chip8_ExportRing) and taking keys from it, for FRAMES frames or until interrupted
+//
+// -engine static runs the translation of the ROM made by chip8_aot, which has to be compiled
+// and linked into this runner (see chip8_aot.c). Builds without one fall back to the interpreter
+
+// Defined by the C file chip8_aot generated, when one is linked in
+extern const Chip8_StaticProgram chip8_static_program __attribute__((weak));
+
+static double GetSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void PrintUsage(const char* exe)
+{
+    fprintf(stderr, "usage: %s <rom> [-ips N] [-engine interp|cached|jit|static] [-variant chip8|schip|xochip]\n", exe);
+    fprintf(stderr, "       %*s (-n INSTRUCTIONS | -frames FRAMES)\n", (int) strlen(exe), "");
+    fprintf(stderr, "       %s <rom> -disasm\n", exe);
+    fprintf(stderr, "       %s <rom> [-ips N] -lanes L (-n INSTRUCTIONS | -frames FRAMES)\n", exe);
+    fprintf(stderr, "       %s <rom> [-engine interp|cached|jit|static] -replay RECORDING\n", exe);
+    fprintf(stderr, "       %s <rom> [-ips N] [-engine interp|cached|jit|static] [-variant chip8|schip|xochip]\n", exe);
+    fprintf(stderr, "       %*s -export NAME [-frames FRAMES]\n", (int) strlen(exe), "");
+}
+
+// Hands the linked in translation to the scheduler, as long as it was made from this ROM
+static void SelectEngine(Chip8_Scheduler* sched, Chip8_Engine engine, const uint8_t* program,
+                         size_t rom_size, Chip8_Variant variant)
+{
+    const Chip8_StaticProgram* translation = &chip8_static_program;
+    if(engine == CHIP8_ENGINE_STATIC && translation != NULL) {
+        if(translation->rom_hash != HashROM(program, rom_size) || translation->variant != variant)
+            fprintf(stderr, "The linked translation was made from another ROM or variant\n");
+        else
+            UseStaticProgram(sched, translation);
+    }
+    if(!SetEngine(sched, engine))
+        fprintf(stderr, "The selected engine is not available, falling back to the interpreter\n");
+}
+
+// Attaches profiling counters to the instance if a dump was asked for
+static bool StartProfile(Chip8_Memory* mem, const char* profile_path)
+{
+    if(profile_path == NULL)
+        return true;
+#ifdef CHIP8_PROFILE
+    mem->profile = (Chip8_Profile*) calloc(1, sizeof(Chip8_Profile));
+    if(mem->profile == NULL)
+        fprintf(stderr, "Failed to allocate the profiling counters\n");
+    return mem->profile != NULL;
+#else
+    (void) mem;
+    fprintf(stderr, "-profile needs a build with -DCHIP8_PROFILE\n");
+    return false;
+#endif
+}
+
+static void FinishProfile(Chip8_Memory* mem, const char* profile_path)
+{
+#ifdef CHIP8_PROFILE
+    if(mem->profile == NULL)
+        return;
+
+    FILE* file = fopen(profile_path, "w");
+    if(file != NULL) {
+        WriteProfile(file, mem->profile, mem);
+        fclose(file);
+    } else
+        fprintf(stderr, "Failed to write the profile: %s\n", profile_path);
+
+    free(mem->profile);
+    mem->profile = NULL;
+#else
+    (void) mem;
+    (void) profile_path;
+#endif
+}
+
+static int RunLockstep(uint8_t* program, size_t rom_size, const char* rom_path, uint32_t ips,
+                       uint32_t lanes, uint64_t cycles, uint64_t frames)
+{
+    Chip8_Lockstep* ls = CreateLockstep(program, rom_size, lanes, ips);
+    if(ls == NULL) {
+        fprintf(stderr, "Failed to create %u lockstep lanes (at most %d)\n", lanes, CHIP8_LOCKSTEP_LANES);
+        free(program);
+        return -1;
+    }
+
+    double t_start = GetSeconds();
+    if(frames)
+        RunLockstepFrames(ls, frames);
+    else
+        RunLockstepCycles(ls, cycles);
+    double t_elapsed = GetSeconds() - t_start;
+
+    uint64_t instructions = 0;
+    for(uint32_t lane = 0; lane < lanes; lane++)
+        instructions += ls->instruction_count[lane];
+
+    printf("rom:          %s\n",  rom_path);
+    printf("lanes:        %u\n", lanes);
+    printf("instructions: %llu\n", (unsigned long long) instructions);
+    printf("frames:       %llu\n", (unsigned long long) ls->timer_ticks);
+    printf("time:         %.3f s\n", t_elapsed);
+    printf("IPS:          %.0f\n", t_elapsed > 0 ? instructions / t_elapsed : 0.0);
+    printf("lanes/issue:  %.2f\n", ls->group_steps ? (double) instructions / ls->group_steps : 0.0);
+
+    DestroyLockstep(ls);
+    free(program);
+    return 0;
+}
+
+static int RunReplay(uint8_t* program, size_t rom_size, const char* rom_path, Chip8_Engine engine,
+                     const char* replay_path, const char* profile_path)
+{
+    Chip8_Recording rec;
+    if(!LoadRecording(replay_path, &rec)) {
+        fprintf(stderr, "Failed to read the recording: %s\n", replay_path);
+        free(program);
+        return -1;
+    }
+    if(rec.rom_hash != HashROM(program, rom_size))
+        fprintf(stderr, "Warning: %s was not recorded with this ROM\n", replay_path);
+
+    Chip8_CPU       cpu    = {};
+    Chip8_Memory    memory = {};
+    Chip8_Scheduler sched;
+
+    memory.variant       = rec.variant;
+    memory.ptr_8         = (uint8_t*) malloc(VariantMemorySize(rec.variant));
+    memory.screen_buffer = (uint64_t*) malloc(VariantScreenWords(rec.variant) * sizeof(uint64_t));
+    if(memory.ptr_8 == NULL || memory.screen_buffer == NULL)
+        fprintf(stderr, "Failed to allocate the emulated memory\n");
+    if(memory.ptr_8 == NULL || memory.screen_buffer == NULL || !StartProfile(&memory, profile_path)) {
+        free(memory.screen_buffer);
+        free(memory.ptr_8);
+        FreeRecording(&rec);
+        free(program);
+        return -1;
+    }
+
+    Initialize(program, rom_size, &cpu, &memory);
+    SeedRandom(&cpu, rec.seed);
+    InitializeScheduler(&sched, rec.instructions_per_second);
+    SelectEngine(&sched, engine, program, rom_size, rec.variant);
+
+    double   t_start   = GetSeconds();
+    uint64_t hash      = ReplayRecording(&rec, &sched, &cpu, &memory);
+    double   t_elapsed = GetSeconds() - t_start;
+    bool     match     = hash == rec.final_hash;
+
+    printf("rom:          %s\n",  rom_path);
+    printf("replay:       %s\n",  replay_path);
+    printf("instructions: %llu\n", (unsigned long long) sched.instruction_count);
+    printf("frames:       %llu\n", (unsigned long long) sched.timer_ticks);
+    printf("time:         %.3f s\n", t_elapsed);
+    printf("IPS:          %.0f\n", t_elapsed > 0 ? sched.instruction_count / t_elapsed : 0.0);
+    printf("idle:         %llu instructions skipped\n", (unsigned long long) sched.idle_count);
+    printf("final state:  %016llx (%s)\n", (unsigned long long) hash, match ? "ok" : "MISMATCH");
+
+    FinishProfile(&memory, profile_path);
+    free(memory.screen_buffer);
+    free(memory.ptr_8);
+    FreeScheduler(&sched);
+    FreeRecording(&rec);
+    free(program);
+    return match ? 0 : 1;
+}
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void OnInterrupt(int sig)
+{
+    (void) sig;
+    interrupted = 1;
+}
+
+static int RunExport(uint8_t* program, size_t rom_size, Chip8_Engine engine, Chip8_Variant variant,
+                     uint32_t ips, uint64_t frames, const char* export_name)
+{
+    Chip8_Export* exporter = OpenExport(export_name, variant);
+    if(exporter == NULL) {
+        fprintf(stderr, "Failed to create the shared memory export: %s\n", export_name);
+        free(program);
+        return -1;
+    }
+
+    Chip8_CPU       cpu    = {};
+    Chip8_Memory    memory = {};
+    Chip8_Scheduler sched;
+
+    memory.variant       = variant;
+    memory.ptr_8         = (uint8_t*) malloc(VariantMemorySize(variant));
+    memory.screen_buffer = (uint64_t*) malloc(VariantScreenWords(variant) * sizeof(uint64_t));
+    if(memory.ptr_8 == NULL || memory.screen_buffer == NULL) {
+        fprintf(stderr, "Failed to allocate the emulated memory\n");
+        CloseExport(exporter);
+        free(memory.screen_buffer);
+        free(memory.ptr_8);
+        free(program);
+        return -1;
+    }
+    Initialize(program, rom_size, &cpu, &memory);
+    InitializeScheduler(&sched, ips);
+    SelectEngine(&sched, engine, program, rom_size, variant);
+
+    // Interrupting ends the run normally, so the name is removed
+    signal(SIGINT, OnInterrupt);
+    signal(SIGTERM, OnInterrupt);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t t_start = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+    for(uint64_t frame = 0; (frames == 0 || frame < frames) && !interrupted; frame++) {
+        uint16_t pressed, released;
+        uint16_t keys = ExportedKeys(exporter, &pressed, &released);
+        if((pressed | released) != 0) {
+            atomic_store_explicit(&memory.key_states, keys, memory_order_relaxed);
+            atomic_store_explicit(&memory.key_fresh, true, memory_order_release);
+        }
+
+        RunFrames(&sched, &cpu, &memory, 1);
+        ExportFrame(exporter, &cpu, &memory, sched.timer_ticks);
+
+        // Deadlines count from the start, a late frame does not push back the ones after it
+        uint64_t due = t_start + (frame + 1) * 1000000000ull / CHIP8_TIMER_HZ;
+        ts.tv_sec  = due / 1000000000ull;
+        ts.tv_nsec = due % 1000000000ull;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0 && !interrupted)
+            ;
+    }
+
+    printf("frames:       %llu\n", (unsigned long long) sched.timer_ticks);
+    printf("instructions: %llu\n", (unsigned long long) sched.instruction_count);
+
+    CloseExport(exporter);
+    free(memory.screen_buffer);
+    free(memory.ptr_8);
+    FreeScheduler(&sched);
+    free(program);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const char* rom_path = NULL;
+    uint32_t    ips      = CHIP8_DEFAULT_IPS;
+    Chip8_Engine engine  = CHIP8_ENGINE_INTERPRETER;
+    uint64_t    cycles   = 0;
+    uint64_t    frames   = 0;
+    bool        disasm   = false;
+    uint32_t    lanes    = 0;
+    Chip8_Variant variant = CHIP8_VARIANT_CHIP8;
+    const char* replay   = NULL;
+    const char* profile_path = NULL;
+    const char* export_name  = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-ips") == 0 && i + 1 < argc)
+            ips = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-engine") == 0 && i + 1 < argc) {
+            if(!ParseEngineName(argv[++i], &engine)) {
+                fprintf(stderr, "Unknown engine: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "-variant") == 0 && i + 1 < argc) {
+            if(!ParseVariantName(argv[++i], &variant)) {
+                fprintf(stderr, "Unknown variant: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            cycles = strtoull(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+            frames = strtoull(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-disasm") == 0)
+            disasm = true;
+        else if(strcmp(argv[i], "-lanes") == 0 && i + 1 < argc)
+            lanes = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-replay") == 0 && i + 1 < argc)
+            replay = argv[++i];
+        else if(strcmp(argv[i], "-profile") == 0 && i + 1 < argc)
+            profile_path = argv[++i];
+        else if(strcmp(argv[i], "-export") == 0 && i + 1 < argc)
+            export_name = argv[++i];
+        else
+            rom_path = argv[i];
+    }
+
+    if(rom_path == NULL || (cycles == 0 && frames == 0 && !disasm && replay == NULL && export_name == NULL)) {
+        PrintUsage(argv[0]);
+        return -1;
+    }
+
+    size_t   rom_size = 0;
+    uint8_t* program  = LoadROM(rom_path, &rom_size);
+
+    if(program == NULL) {
+        fprintf(stderr, "Failed to open the ROM file: %s\n", rom_path);
+        return -1;
+    }
+
+    if(disasm) {
+        DisassembleListing(stdout, program, rom_size, 0x200);
+        free(program);
+        return 0;
+    }
+
+    if(replay != NULL)
+        return RunReplay(program, rom_size, rom_path, engine, replay, profile_path);
+    if(export_name != NULL)
+        return RunExport(program, rom_size, engine, variant, ips, frames, export_name);
+
+    if(lanes > 0 && variant != CHIP8_VARIANT_CHIP8) {
+        fprintf(stderr, "-lanes only runs CHIP-8 programs\n");
+        free(program);
+        return -1;
+    }
+    if(lanes > 0)
+        return RunLockstep(program, rom_size, rom_path, ips, lanes, cycles, frames);
+
+    Chip8_CPU       cpu    = {};
+    Chip8_Memory    memory = {};
+    Chip8_Scheduler sched;
+
+    memory.variant       = variant;
+    memory.ptr_8         = (uint8_t*) malloc(VariantMemorySize(variant));
+    memory.screen_buffer = (uint64_t*) malloc(VariantScreenWords(variant) * sizeof(uint64_t));
+    if(memory.ptr_8 == NULL || memory.screen_buffer == NULL)
+        fprintf(stderr, "Failed to allocate the emulated memory\n");
+    if(memory.ptr_8 == NULL || memory.screen_buffer == NULL || !StartProfile(&memory, profile_path)) {
+        free(memory.screen_buffer);
+        free(memory.ptr_8);
+        free(program);
+        return -1;
+    }
+
+    Initialize(program, rom_size, &cpu, &memory);
+    InitializeScheduler(&sched, ips);
+    SelectEngine(&sched, engine, program, rom_size, variant);
+
+    double t_start = GetSeconds();
+    if(frames)
+        RunFrames(&sched, &cpu, &memory, frames);
+    else
+        RunCycles(&sched, &cpu, &memory, cycles);
+    double t_elapsed = GetSeconds() - t_start;
+
+    double emulated_seconds = (double) sched.cycle_count / sched.instructions_per_second;
+
+    printf("rom:          %s\n",  rom_path);
+    printf("instructions: %llu\n", (unsigned long long) sched.instruction_count);
+    printf("cycles:       %llu\n", (unsigned long long) sched.cycle_count);
+    printf("frames:       %llu\n", (unsigned long long) sched.timer_ticks);
+    printf("time:         %.3f s\n", t_elapsed);
+    printf("IPS:          %.0f\n", t_elapsed > 0 ? sched.instruction_count / t_elapsed : 0.0);
+    printf("idle:         %llu instructions skipped\n", (unsigned long long) sched.idle_count);
+    printf("speed:        x%.1f real time\n", t_elapsed > 0 ? emulated_seconds / t_elapsed : 0.0);
+
+    FinishProfile(&memory, profile_path);
+    free(memory.screen_buffer);
+    free(memory.ptr_8);
+    FreeScheduler(&sched);
+    free(program);
+    return 0;
+}
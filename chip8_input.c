@@ -0,0 +1,111 @@
+#include "Chip8.h"
+
+// Input.
+//
+// SDL calls event watches from whichever thread queues the event, on the spot, so key_states
+// changes without waiting for the main loop to poll. Every change is stamped with the performance
+// counter unless an earlier one is still unread, so the histogram measures from the oldest event
+// a read catches up with
+
+static int KeyIndex(SDL_Keycode keycode)
+{
+    return (keycode >= 'a' && keycode <= 'f') ? (keycode - 'a' + 10) :
+           (keycode >= 'A' && keycode <= 'F') ? (keycode - 'A' + 10) :
+           (keycode >= '0' && keycode <= '9') ? (keycode - '0') : -1;
+}
+
+static void SetKey(_Atomic uint16_t* keys, uint16_t bit, bool down)
+{
+    if(down) atomic_fetch_or_explicit(keys, bit, memory_order_relaxed);
+    else     atomic_fetch_and_explicit(keys, (uint16_t) ~bit, memory_order_relaxed);
+}
+
+// 'wake' is false on the emulation thread itself, which runs the cycles right away anyway
+static void ChangeKeys(Chip8_Input* input, uint16_t bits, bool down, bool wake)
+{
+    SetKey(&input->keys, bits, down);
+
+    uint64_t none = 0;
+    atomic_compare_exchange_strong_explicit(&input->pending, &none, SDL_GetPerformanceCounter(),
+                                            memory_order_relaxed, memory_order_relaxed);
+    if(input->live) {
+        SetKey(&input->mem->key_states, bits, down);
+        atomic_store_explicit(&input->mem->key_fresh, true, memory_order_release);
+        if(wake && input->wake != NULL)
+            SDL_SemPost(input->wake);
+    }
+}
+
+static int InputWatch(void* userdata, SDL_Event* event)
+{
+    Chip8_Input* input = (Chip8_Input*) userdata;
+    if(event->type != SDL_KEYDOWN && event->type != SDL_KEYUP)
+        return 1;
+
+    int key_idx = KeyIndex(event->key.keysym.sym);
+    if(key_idx < 0 || key_idx > 15)
+        return 1;
+
+    bool     down = event->type == SDL_KEYDOWN;
+    uint16_t bit  = 0x8000 >> key_idx;
+    if(((atomic_load_explicit(&input->keys, memory_order_relaxed) & bit) != 0) == down)
+        return 1;   // Key repeat
+    ChangeKeys(input, bit, down, true);
+    return 1;
+}
+
+// Keys held from outside the window (the export ring's key channel) go the same way as those
+// of the keyboard, a key is up as soon as either lets go of it. Called by the emulation thread
+void ApplyKeys(Chip8_Input* input, uint16_t pressed, uint16_t released)
+{
+    if(pressed != 0)
+        ChangeKeys(input, pressed, true, false);
+    if(released != 0)
+        ChangeKeys(input, released, false, false);
+}
+
+// Key hook, runs on whichever thread emulates
+static void NoteKeyRead(void* arg)
+{
+    Chip8_Input* input = (Chip8_Input*) arg;
+    uint64_t     stamp = atomic_exchange_explicit(&input->pending, 0, memory_order_relaxed);
+    if(stamp == 0)
+        return;
+
+    NoteMicros(input->histogram, (SDL_GetPerformanceCounter() - stamp) * 1000000 / input->frequency);
+}
+
+void OpenInput(Chip8_Input* input, Chip8_Memory* mem, bool live)
+{
+    memset(input, 0x00, sizeof(Chip8_Input));
+    input->mem       = mem;
+    input->live      = live;
+    input->frequency = SDL_GetPerformanceFrequency();
+    atomic_init(&input->keys, atomic_load(&mem->key_states));
+    atomic_init(&input->pending, 0);
+    for(int b = 0; b < CHIP8_LATENCY_BUCKETS; b++)
+        atomic_init(&input->histogram[b], 0);
+
+    mem->key_hook = NoteKeyRead;
+    mem->key_arg  = input;
+    SDL_AddEventWatch(InputWatch, input);
+}
+
+void CloseInput(Chip8_Input* input)
+{
+    SDL_DelEventWatch(InputWatch, input);
+    input->mem->key_hook = NULL;
+    input->mem->key_arg  = NULL;
+}
+
+// Copies the keys into the memory, for when they may only change between frames
+uint16_t LatchKeys(Chip8_Input* input)
+{
+    uint16_t keys = atomic_load_explicit(&input->keys, memory_order_relaxed);
+    if(keys != atomic_load_explicit(&input->mem->key_states, memory_order_relaxed)) {
+        atomic_store_explicit(&input->mem->key_states, keys, memory_order_relaxed);
+        atomic_store_explicit(&input->mem->key_fresh, true, memory_order_release);
+    } else if(!atomic_load_explicit(&input->mem->key_fresh, memory_order_relaxed))
+        atomic_store_explicit(&input->pending, 0, memory_order_relaxed);   // Pressed and released within the frame
+    return keys;
+}
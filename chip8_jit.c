@@ -0,0 +1,831 @@
+#include <stddef.h>
+
+#include "Chip8_Core.h"
+
+// Basic-block dynamic recompiler to x86-64.
+//
+// Starting from a guest PC, instructions are translated up to the first one that changes
+// control flow (or JIT_MAX_BLOCK of them) into native code. The V registers a block uses most
+// are loaded into host registers when it is entered and written back to the Chip8_CPU on the
+// way out, the rest are operated on in place. While translated code runs the host registers hold:
+//
+//   rbx - Chip8_CPU*      r12d - cycle budget left    r13 - guest memory (Chip8_Memory::ptr_8)
+//   r14 - Chip8_Jit*      r15  - Chip8_Memory*        rax, rcx - scratch
+//   rdx, rsi, rdi, rbp, r8-r11 - V registers allocated by the current block
+//
+// Jumps, skips and fall-through exits go through stubs which are patched into direct jumps
+// to the successor block once it has been translated, and returns/computed jumps look their
+// target up in the block table, so hot loops run without coming back to C. Every block starts
+// by checking the budget covers its whole length, which keeps the cycle count exact.
+//
+// Dxyn, Cxnn, 00E0, Fx0A, Fx33, Fx55 and the SUPER-CHIP instructions call back into
+// ExecInstruction. Whenever memory that holds translated code is written all translations are
+// discarded, and code in pages that keep getting rewritten is no longer translated but
+// interpreted one instruction at a time.
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define JIT_CODE_SIZE     (4 << 20)
+#define JIT_MAX_BLOCK     64
+#define JIT_MAX_BLOCK_CODE (JIT_MAX_BLOCK * 96 + 256) // generous upper bound on one block's code
+#define JIT_PAGE_SHIFT    8
+#define JIT_SMC_LIMIT     4    // flushes caused by writes into a page before it is only interpreted
+
+struct CHIP8JIT {
+    uint8_t* entry[CHIP8_DECODE_SLOTS];       // translated block starting at each guest address
+    uint8_t  block_len[CHIP8_DECODE_SLOTS];   // instructions in that block
+    uint8_t  covered[CHIP8_DECODE_SLOTS];     // 1 where a byte of memory belongs to a translation
+    uint8_t  smc_count[CHIP8_DECODE_SLOTS >> JIT_PAGE_SHIFT];
+
+    uint8_t* code;
+    size_t   code_used;
+    size_t   code_reserved;  // bytes taken by the enter trampoline and the shared exit
+    uint8_t* exit_code;
+
+    // State shared with translated code while it runs
+    Chip8_CPU*    cpu;
+    Chip8_Memory* mem;
+    int32_t       budget;
+    uint32_t      exit_pc;
+    uint8_t*      exit_link;     // rel32 of the jump to patch towards exit_pc, NULL for none
+    uint32_t      flushed;
+
+    uint8_t*      pending_link;  // exit_link of the last block run, patched once exit_pc is translated
+    uint16_t      pending_pc;
+    uint8_t*      memory;        // guest memory the translations were made from
+};
+
+// Register numbers as used in ModRM/SIB fields
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RBP = 5, RSI = 6, RDI = 7, R8 = 8, R9 = 9, R10 = 10, R11 = 11 };
+
+#define CPU_OFF(field) ((uint8_t) offsetof(Chip8_CPU, field))
+
+typedef struct JITEMITTER {
+    uint8_t* code;
+    size_t   pos;
+} Jit_Emitter;
+
+// Host registers available to hold V registers, in the order they are handed out
+static const int8_t jit_host_regs[] = { RDX, RSI, RDI, RBP, R8, R9, R10, R11 };
+
+typedef struct JITBLOCK {
+    Jit_Emitter e;
+    int8_t      host[16];   // host register caching VX[i] within the block, -1 if it stays in memory
+    uint16_t    written;    // bit (0x8000 >> i) set if the block writes VX[i] natively
+} Jit_Block;
+
+// Operand of a byte sized instruction: a host register, or [rbx + disp] when reg < 0
+typedef struct JITOPERAND {
+    int8_t  reg;
+    uint8_t disp;
+} Jit_Operand;
+
+static Jit_Operand OpReg(int8_t reg)   { Jit_Operand op = { reg, 0 };  return op; }
+static Jit_Operand OpMem(uint8_t disp) { Jit_Operand op = { -1, disp }; return op; }
+
+static Jit_Operand OpVX(const Jit_Block* b, uint8_t x)
+{
+    return b->host[x] >= 0 ? OpReg(b->host[x]) : OpMem(CPU_OFF(VX) + x);
+}
+
+static void Emit8(Jit_Emitter* e, uint8_t b) { e->code[e->pos++] = b; }
+static void Emit16(Jit_Emitter* e, uint16_t v) { memcpy(e->code + e->pos, &v, 2); e->pos += 2; }
+static void Emit32(Jit_Emitter* e, uint32_t v) { memcpy(e->code + e->pos, &v, 4); e->pos += 4; }
+static void Emit64(Jit_Emitter* e, uint64_t v) { memcpy(e->code + e->pos, &v, 8); e->pos += 8; }
+
+static void EmitBytes(Jit_Emitter* e, const uint8_t* bytes, size_t n)
+{
+    memcpy(e->code + e->pos, bytes, n);
+    e->pos += n;
+}
+
+// Emits a (one or two byte) opcode with its REX prefix and ModRM for a byte operation on rm.
+// 'reg' is the ModRM.reg field: a register, or an opcode extension when reg_is_ext
+static void EmitRM8(Jit_Emitter* e, uint16_t opcode, uint8_t reg, bool reg_is_ext, Jit_Operand rm)
+{
+    uint8_t rex = 0;
+    if(!reg_is_ext && reg >= 8) rex |= 0x44;
+    else if(!reg_is_ext && reg >= 4) rex |= 0x40;     // spl..dil rather than ah..bh
+    if(rm.reg >= 8) rex |= 0x41;
+    else if(rm.reg >= 4) rex |= 0x40;
+
+    if(rex) Emit8(e, rex);
+    if(opcode > 0xFF) Emit8(e, opcode >> 8);
+    Emit8(e, opcode & 0xFF);
+
+    if(rm.reg >= 0) {
+        Emit8(e, 0xC0 | ((reg & 7) << 3) | (rm.reg & 7));
+    } else {
+        Emit8(e, 0x40 | ((reg & 7) << 3) | RBX);
+        Emit8(e, rm.disp);
+    }
+}
+
+static void EmitMov8(Jit_Emitter* e, Jit_Operand dst, Jit_Operand src)
+{
+    if(dst.reg >= 0)      EmitRM8(e, 0x8A, dst.reg, false, src);
+    else if(src.reg >= 0) EmitRM8(e, 0x88, src.reg, false, dst);
+    else {
+        EmitRM8(e, 0x8A, RAX, false, src);
+        EmitRM8(e, 0x88, RAX, false, dst);
+    }
+}
+
+// Two operand ALU op given by its 'op r/m8, r8' opcode (add 00, or 08, and 20, sub 28, xor 30,
+// cmp 38). Memory to memory goes through cl
+static void EmitAlu8(Jit_Emitter* e, uint8_t opcode, Jit_Operand dst, Jit_Operand src)
+{
+    if(dst.reg >= 0)      EmitRM8(e, opcode + 2, dst.reg, false, src);
+    else if(src.reg >= 0) EmitRM8(e, opcode, src.reg, false, dst);
+    else {
+        EmitRM8(e, 0x8A, RCX, false, src);
+        EmitRM8(e, opcode, RCX, false, dst);
+    }
+}
+
+enum { ALU_ADD = 0x00, ALU_OR = 0x08, ALU_AND = 0x20, ALU_SUB = 0x28, ALU_XOR = 0x30, ALU_CMP = 0x38 };
+enum { EXT_ADD = 0, EXT_AND = 4, EXT_SHL = 4, EXT_SHR = 5, EXT_CMP = 7 };
+
+static void EmitAluImm8(Jit_Emitter* e, uint8_t ext, Jit_Operand dst, uint8_t imm)
+{
+    EmitRM8(e, 0x80, ext, true, dst);
+    Emit8(e, imm);
+}
+
+static void EmitMovImm8(Jit_Emitter* e, Jit_Operand dst, uint8_t imm)
+{
+    EmitRM8(e, 0xC6, 0, true, dst);
+    Emit8(e, imm);
+}
+
+static void EmitMovzx8(Jit_Emitter* e, uint8_t reg32, Jit_Operand src)
+{
+    EmitRM8(e, 0x0FB6, reg32, false, src);
+}
+
+static uint8_t* Here(Jit_Emitter* e) { return e->code + e->pos; }
+
+// Emits a rel32 jump/jcc with an unknown target and returns where its displacement lives
+static uint8_t* EmitJump32(Jit_Emitter* e, uint8_t cond)
+{
+    if(cond) { Emit8(e, 0x0F); Emit8(e, cond); }
+    else     { Emit8(e, 0xE9); }
+    uint8_t* rel = Here(e);
+    Emit32(e, 0);
+    return rel;
+}
+
+static void PatchRel32(uint8_t* rel, const uint8_t* target)
+{
+    int32_t disp = (int32_t)(target - (rel + 4));
+    memcpy(rel, &disp, 4);
+}
+
+static void EmitJumpTo(Jit_Emitter* e, const uint8_t* target)
+{
+    PatchRel32(EmitJump32(e, 0), target);
+}
+
+enum { JCC_JE = 0x84, JCC_JNE = 0x85, JCC_JA = 0x87 };
+
+// Writes the V registers the block modified back to the Chip8_CPU
+static void EmitSpill(Jit_Block* b)
+{
+    for(uint8_t x = 0; x < 16; x++) {
+        if(b->host[x] >= 0 && (b->written & (0x8000 >> x)))
+            EmitMov8(&b->e, OpMem(CPU_OFF(VX) + x), OpReg(b->host[x]));
+    }
+}
+
+static void EmitReload(Jit_Block* b)
+{
+    for(uint8_t x = 0; x < 16; x++) {
+        if(b->host[x] >= 0)
+            EmitMov8(&b->e, OpReg(b->host[x]), OpMem(CPU_OFF(VX) + x));
+    }
+}
+
+// mov word [rbx + CIR], instr ; sub r12d, count
+static void EmitRetire(Jit_Emitter* e, uint16_t instr, uint32_t count)
+{
+    Emit8(e, 0x66); Emit8(e, 0xC7); Emit8(e, 0x43); Emit8(e, CPU_OFF(CIR)); Emit16(e, instr);
+    Emit8(e, 0x41); Emit8(e, 0x81); Emit8(e, 0xEC); Emit32(e, count);
+}
+
+// Leaves to the dispatcher with the target PC in eax and no link to patch
+static void EmitExitNoLink(Chip8_Jit* jit, Jit_Emitter* e)
+{
+    Emit8(e, 0x31); Emit8(e, 0xD2);                 // xor edx, edx
+    EmitJumpTo(e, jit->exit_code);
+}
+
+// Exit to a PC known at translation time, through a jump the dispatcher later points at the
+// target block
+static void EmitExitStatic(Chip8_Jit* jit, Jit_Block* b, uint16_t target, uint16_t instr, uint32_t count)
+{
+    Jit_Emitter* e = &b->e;
+
+    EmitSpill(b);
+    EmitRetire(e, instr, count);
+    uint8_t* link = EmitJump32(e, 0);
+    PatchRel32(link, Here(e));
+
+    Emit8(e, 0xB8); Emit32(e, target);              // mov eax, target
+    Emit8(e, 0x48); Emit8(e, 0xBA);                 // mov rdx, link
+    Emit64(e, (uint64_t)(uintptr_t) link);
+    EmitJumpTo(e, jit->exit_code);
+}
+
+// Exit to the PC in eax, jumping straight into its block when one exists
+static void EmitExitDynamic(Chip8_Jit* jit, Jit_Block* b, uint16_t instr, uint32_t count)
+{
+    Jit_Emitter* e = &b->e;
+
+    EmitSpill(b);
+    EmitRetire(e, instr, count);
+
+    Emit8(e, 0x3D); Emit32(e, CHIP8_DECODE_SLOTS - 2);    // cmp eax, last translatable pc
+    uint8_t* out_of_range = EmitJump32(e, JCC_JA);
+
+    static const uint8_t lookup[] = {
+        0x49, 0x8B, 0x8C, 0xC6,                           // mov rcx, [r14 + rax * 8 + entry]
+    };
+    EmitBytes(e, lookup, sizeof(lookup));
+    Emit32(e, (uint32_t) offsetof(Chip8_Jit, entry));
+    Emit8(e, 0x48); Emit8(e, 0x85); Emit8(e, 0xC9);      // test rcx, rcx
+    uint8_t* missing = EmitJump32(e, JCC_JE);
+    Emit8(e, 0xFF); Emit8(e, 0xE1);                      // jmp rcx
+
+    PatchRel32(out_of_range, Here(e));
+    PatchRel32(missing, Here(e));
+    EmitExitNoLink(jit, e);
+}
+
+// movzx eax, word [rbx + PC] - for leaving after a call back into C moved the PC
+static void EmitLoadPC(Jit_Emitter* e)
+{
+    Emit8(e, 0x0F); Emit8(e, 0xB7); Emit8(e, 0x43); Emit8(e, CPU_OFF(PC));
+}
+
+static uint32_t JitFallback(Chip8_Jit* jit, uint32_t pc);
+
+// Calls JitFallback(jit, pc) which executes the instruction at pc through ExecInstruction,
+// with the V registers written back beforehand and reloaded after, as C may change any of
+// them. If the call discarded the translations the block is left straight away
+static void EmitFallback(Chip8_Jit* jit, Jit_Block* b, uint16_t pc, uint16_t instr, uint32_t count)
+{
+    Jit_Emitter* e = &b->e;
+
+    EmitSpill(b);
+#ifdef _WIN32
+    Emit8(e, 0x4C); Emit8(e, 0x89); Emit8(e, 0xF1);      // mov rcx, r14
+    Emit8(e, 0xBA); Emit32(e, pc);                       // mov edx, pc
+#else
+    Emit8(e, 0x4C); Emit8(e, 0x89); Emit8(e, 0xF7);      // mov rdi, r14
+    Emit8(e, 0xBE); Emit32(e, pc);                       // mov esi, pc
+#endif
+    Emit8(e, 0x48); Emit8(e, 0xB8);                      // mov rax, JitFallback
+    Emit64(e, (uint64_t)(uintptr_t) &JitFallback);
+    Emit8(e, 0xFF); Emit8(e, 0xD0);                      // call rax
+    Emit8(e, 0x85); Emit8(e, 0xC0);                      // test eax, eax
+    uint8_t* carry_on = EmitJump32(e, JCC_JE);
+
+    EmitRetire(e, instr, count);
+    EmitLoadPC(e);
+    EmitExitNoLink(jit, e);
+    PatchRel32(carry_on, Here(e));
+    EmitReload(b);
+}
+
+// Builds the enter trampoline, uint32_t enter(Chip8_Jit*, uint8_t* block), and the shared
+// exit path at the start of the code buffer
+static void EmitTrampolines(Chip8_Jit* jit)
+{
+    Jit_Emitter e = { jit->code, 0 };
+
+#ifdef _WIN32
+    static const uint8_t prologue[] = {
+        0x53, 0x55, 0x57, 0x56, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, // push rbx..r15
+        0x48, 0x83, 0xEC, 0x28,                     // sub rsp, 40 (shadow space + alignment)
+        0x49, 0x89, 0xCE,                           // mov r14, rcx
+        0x48, 0x89, 0xD0,                           // mov rax, rdx
+    };
+    static const uint8_t epilogue[] = {
+        0x48, 0x83, 0xC4, 0x28,                     // add rsp, 40
+        0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5E, 0x5F, 0x5D, 0x5B, // pop r15..rbx
+        0xC3,
+    };
+#else
+    static const uint8_t prologue[] = {
+        0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, // push rbx, rbp, r12-r15
+        0x48, 0x83, 0xEC, 0x08,                     // sub rsp, 8 (alignment)
+        0x49, 0x89, 0xFE,                           // mov r14, rdi
+        0x48, 0x89, 0xF0,                           // mov rax, rsi
+    };
+    static const uint8_t epilogue[] = {
+        0x48, 0x83, 0xC4, 0x08,                     // add rsp, 8
+        0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, // pop r15..r12, rbp, rbx
+        0xC3,
+    };
+#endif
+
+    EmitBytes(&e, prologue, sizeof(prologue));
+    Emit8(&e, 0x49); Emit8(&e, 0x8B); Emit8(&e, 0x9E);  // mov rbx, [r14 + cpu]
+    Emit32(&e, (uint32_t) offsetof(Chip8_Jit, cpu));
+    Emit8(&e, 0x4D); Emit8(&e, 0x8B); Emit8(&e, 0xBE);  // mov r15, [r14 + mem]
+    Emit32(&e, (uint32_t) offsetof(Chip8_Jit, mem));
+    Emit8(&e, 0x4D); Emit8(&e, 0x8B); Emit8(&e, 0x2F);  // mov r13, [r15] (ptr_8)
+    Emit8(&e, 0x45); Emit8(&e, 0x8B); Emit8(&e, 0xA6);  // mov r12d, [r14 + budget]
+    Emit32(&e, (uint32_t) offsetof(Chip8_Jit, budget));
+    Emit8(&e, 0xFF); Emit8(&e, 0xE0);                    // jmp rax
+
+    jit->exit_code = Here(&e);
+    Emit8(&e, 0x45); Emit8(&e, 0x89); Emit8(&e, 0xA6);  // mov [r14 + budget], r12d
+    Emit32(&e, (uint32_t) offsetof(Chip8_Jit, budget));
+    Emit8(&e, 0x41); Emit8(&e, 0x89); Emit8(&e, 0x86);  // mov [r14 + exit_pc], eax
+    Emit32(&e, (uint32_t) offsetof(Chip8_Jit, exit_pc));
+    Emit8(&e, 0x49); Emit8(&e, 0x89); Emit8(&e, 0x96);  // mov [r14 + exit_link], rdx
+    Emit32(&e, (uint32_t) offsetof(Chip8_Jit, exit_link));
+    EmitBytes(&e, epilogue, sizeof(epilogue));
+
+    jit->code_reserved = (e.pos + 15) & ~(size_t) 15;
+    jit->code_used     = jit->code_reserved;
+}
+
+void FlushJit(Chip8_Jit* jit)
+{
+    memset(jit->entry,     0x00, sizeof(jit->entry));
+    memset(jit->block_len, 0x00, sizeof(jit->block_len));
+    memset(jit->covered,   0x00, sizeof(jit->covered));
+    jit->code_used    = jit->code_reserved;
+    jit->pending_link = NULL;
+    jit->flushed      = 1;
+}
+
+// Called after guest memory [addr, addr + len) was written, wrapping around its end like the
+// writes do. Returns true, having thrown the translations away, if any of it was translated code
+static bool JitNoteWrite(Chip8_Jit* jit, uint32_t addr, uint32_t len)
+{
+    for(uint32_t k = 0; k < len; k++) {
+        uint32_t a = (addr + k) & (CHIP8_DECODE_SLOTS - 1);
+        if(jit->covered[a]) {
+            uint8_t* count = &jit->smc_count[a >> JIT_PAGE_SHIFT];
+            if(*count < 0xFF) (*count)++;
+            FlushJit(jit);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Memory [addr, addr + len) is about to change from outside the engine (a fork being restored),
+// translations are only thrown away when they covered any of it
+void InvalidateJit(Chip8_Jit* jit, uint16_t addr, uint16_t len)
+{
+    jit->pending_link = NULL;
+    for(uint32_t a = addr; a < (uint32_t) addr + len && a < CHIP8_DECODE_SLOTS; a++) {
+        if(jit->covered[a]) {
+            FlushJit(jit);
+            return;
+        }
+    }
+}
+
+// The CPU was loaded from outside the engine (a fork being restored), the last block's exit no
+// longer leads to where it resumes
+void UnlinkJit(Chip8_Jit* jit)
+{
+    jit->pending_link = NULL;
+}
+
+// Runs one instruction at cpu->PC through ExecInstruction, keeping the translations coherent
+// with whatever it wrote to memory
+static void JitExecOne(Chip8_Jit* jit, Chip8_CPU* cpu, Chip8_Memory* mem)
+{
+    FetchInstruction(cpu, mem);
+
+    uint16_t instr  = cpu->CIR;
+    uint8_t  signal = ExecInstruction(cpu, mem);
+    if(signal != 0xFF) {
+        cpu->wait_key_reg  = signal;
+        cpu->wait_key_prev = ReadKeys(mem);
+    }
+
+    switch(instr & 0xF0FF) {
+        case 0xF033: JitNoteWrite(jit, cpu->I, 3); break;
+        case 0xF055: JitNoteWrite(jit, cpu->I, ((instr & 0x0F00) >> 8) + 1); break;
+    }
+}
+
+static uint32_t JitFallback(Chip8_Jit* jit, uint32_t pc)
+{
+    jit->cpu->PC = (uint16_t) pc;
+    JitExecOne(jit, jit->cpu, jit->mem);
+    return jit->flushed;
+}
+
+// True for instructions after which a block cannot continue straight on
+static bool EndsBlock(uint16_t instr)
+{
+    switch(instr >> 12) {
+        case 0x0: return (instr & 0x0FFF) == 0x0EE || (instr & 0x0FFF) == 0x0FD;
+        case 0x1: case 0x2: case 0x3: case 0x4: case 0x5: case 0x9: case 0xb: return true;
+        case 0xe: return (instr & 0xFF) == 0x9e || (instr & 0xFF) == 0xa1;
+        case 0xf: return (instr & 0xFF) == 0x0a;
+    }
+    return false;
+}
+
+// Counts how often the natively translated instruction reads or writes each V register
+static void CountRegisterUses(uint16_t instr, uint8_t uses[16], uint16_t* written)
+{
+    uint8_t x = (instr & 0x0F00) >> 8;
+    uint8_t y = (instr & 0x00F0) >> 4;
+
+    switch(instr >> 12) {
+        case 0x3: case 0x4: uses[x]++; break;
+        case 0x5: case 0x9: uses[x]++; uses[y]++; break;
+        case 0x6: case 0x7: uses[x]++; *written |= 0x8000 >> x; break;
+        case 0x8: {
+            uses[x]++; uses[y]++;
+            *written |= 0x8000 >> x;
+            if((instr & 0x000F) >= 0x4) {
+                uses[0xF]++;
+                *written |= 0x0001;
+            }
+        } break;
+        case 0xb: uses[0]++; break;
+        case 0xf: {
+            switch(instr & 0xFF) {
+                case 0x07: uses[x]++; *written |= 0x8000 >> x; break;
+                case 0x15: case 0x18: case 0x1e: case 0x29: uses[x]++; break;
+                case 0x65:
+                    for(uint8_t k = 0; k <= x; k++) {
+                        uses[k]++;
+                        *written |= 0x8000 >> k;
+                    }
+                    break;
+            }
+        } break;
+    }
+}
+
+// Translates the block starting at pc. Returns NULL if it should be interpreted instead
+static uint8_t* TranslateBlock(Chip8_Jit* jit, uint16_t pc)
+{
+    if(jit->smc_count[pc >> JIT_PAGE_SHIFT] >= JIT_SMC_LIMIT)
+        return NULL;
+
+    if(jit->code_used + JIT_MAX_BLOCK_CODE > JIT_CODE_SIZE)
+        FlushJit(jit);
+
+    const uint8_t* memory = jit->mem->ptr_8;
+
+    // 1: Find the extent of the block and give the most used V registers a host register
+    uint16_t instrs[JIT_MAX_BLOCK];
+    uint8_t  uses[16] = {};
+    uint16_t written  = 0;
+    uint32_t count    = 0;
+    uint16_t addr     = pc;
+
+    while(count < JIT_MAX_BLOCK && addr <= CHIP8_DECODE_SLOTS - 2) {
+        uint16_t instr = ((uint16_t) memory[addr]) << 8 | memory[addr + 1];
+        instrs[count++] = instr;
+        addr += 2;
+
+        CountRegisterUses(instr, uses, &written);
+        if(EndsBlock(instr))
+            break;
+    }
+
+    Jit_Block b;
+    b.e       = (Jit_Emitter){ jit->code, jit->code_used };
+    b.written = written;
+    memset(b.host, -1, sizeof(b.host));
+
+    for(size_t slot = 0; slot < sizeof(jit_host_regs); slot++) {
+        int8_t best = -1;
+        for(uint8_t x = 0; x < 16; x++) {
+            if(b.host[x] < 0 && uses[x] >= 2 && (best < 0 || uses[x] > uses[best]))
+                best = x;
+        }
+        if(best < 0) break;
+        b.host[best] = jit_host_regs[slot];
+    }
+
+    // 2: Emit it, starting with the check that the budget covers the whole block
+    Jit_Emitter* e     = &b.e;
+    uint8_t*     block = Here(e);
+
+    Emit8(e, 0x41); Emit8(e, 0x81); Emit8(e, 0xFC); Emit32(e, count); // cmp r12d, count
+    Emit8(e, 0x7D); Emit8(e, 12);                                      // jge body
+    Emit8(e, 0xB8); Emit32(e, pc);                                     // mov eax, pc
+    EmitExitNoLink(jit, e);
+    EmitReload(&b);
+
+    const Jit_Operand vf = OpVX(&b, 0x0F);
+    const Jit_Operand al = OpReg(RAX);
+    const Jit_Operand cl = OpReg(RCX);
+    bool ended = false;
+
+    for(uint32_t idx = 0; idx < count; idx++) {
+        uint16_t    instr = instrs[idx];
+        uint16_t    at    = pc + idx * 2;
+        uint16_t    next  = at + 2;
+        uint32_t    done  = idx + 1;           // instructions retired once this one completes
+        uint16_t    nnn   = (instr & 0x0FFF);
+        uint8_t     nn    = (instr & 0x00FF);
+        uint8_t     x     = (instr & 0x0F00) >> 8;
+        uint8_t     y     = (instr & 0x00F0) >> 4;
+        Jit_Operand vx    = OpVX(&b, x);
+        Jit_Operand vy    = OpVX(&b, y);
+
+        switch(instr >> 12) {
+            case 0x0: {
+                if(nnn == 0x0E0) {
+                    EmitFallback(jit, &b, at, instr, done);
+                } else if(nnn == 0x0EE) {
+                    Emit8(e, 0x0F); Emit8(e, 0xB7); Emit8(e, 0x43); Emit8(e, CPU_OFF(stack_ptr)); // movzx eax, word [sp]
+                    Emit8(e, 0xFF); Emit8(e, 0xC8);                                               // dec eax
+                    Emit8(e, 0x83); Emit8(e, 0xE0); Emit8(e, CHIP8_STACK_DEPTH - 1);              // and eax, depth - 1
+                    Emit8(e, 0x66); Emit8(e, 0x89); Emit8(e, 0x43); Emit8(e, CPU_OFF(stack_ptr)); // mov [sp], ax
+                    Emit8(e, 0x0F); Emit8(e, 0xB7); Emit8(e, 0x44); Emit8(e, 0x43);               // movzx eax, word [rbx + rax * 2 + stack]
+                    Emit8(e, CPU_OFF(stack));
+                    EmitExitDynamic(jit, &b, instr, done);
+                    ended = true;
+                } else if(nnn == 0x0FD) {
+                    // SUPER-CHIP's exit moves the PC back onto itself
+                    EmitFallback(jit, &b, at, instr, done);
+                    EmitRetire(e, instr, done);
+                    EmitLoadPC(e);
+                    EmitExitNoLink(jit, e);
+                    ended = true;
+                } else if((nnn & 0xFF0) == 0x0C0 || (nnn & 0xFF0) == 0x0D0 || (nnn >= 0x0FB && nnn <= 0x0FF)) {
+                    EmitFallback(jit, &b, at, instr, done);
+                }
+            } break;
+            case 0x1: EmitExitStatic(jit, &b, nnn, instr, done); ended = true; break;
+            case 0x2: {
+                Emit8(e, 0x0F); Emit8(e, 0xB7); Emit8(e, 0x43); Emit8(e, CPU_OFF(stack_ptr)); // movzx eax, word [sp]
+                Emit8(e, 0x66); Emit8(e, 0xC7); Emit8(e, 0x44); Emit8(e, 0x43);               // mov word [rbx + rax * 2 + stack], next
+                Emit8(e, CPU_OFF(stack)); Emit16(e, next);
+                Emit8(e, 0xFF); Emit8(e, 0xC0);                                               // inc eax
+                Emit8(e, 0x83); Emit8(e, 0xE0); Emit8(e, CHIP8_STACK_DEPTH - 1);              // and eax, depth - 1
+                Emit8(e, 0x66); Emit8(e, 0x89); Emit8(e, 0x43); Emit8(e, CPU_OFF(stack_ptr)); // mov [sp], ax
+                EmitExitStatic(jit, &b, nnn, instr, done);
+                ended = true;
+            } break;
+            case 0x3: case 0x4: case 0x5: case 0x9: {
+                if((instr >> 12) == 0x3 || (instr >> 12) == 0x4)
+                    EmitAluImm8(e, EXT_CMP, vx, nn);
+                else
+                    EmitAlu8(e, ALU_CMP, vx, vy);
+
+                bool     if_equal = (instr >> 12) == 0x3 || (instr >> 12) == 0x5;
+                uint8_t* skip     = EmitJump32(e, if_equal ? JCC_JE : JCC_JNE);
+                EmitExitStatic(jit, &b, next, instr, done);
+                PatchRel32(skip, Here(e));
+                EmitExitStatic(jit, &b, next + 2, instr, done);
+                ended = true;
+            } break;
+            case 0x6: EmitMovImm8(e, vx, nn); break;
+            case 0x7: EmitAluImm8(e, EXT_ADD, vx, nn); break;
+            case 0x8: {
+                // The flag is always written before the result, and operands are re-read after
+                // it, so x or y being 0xF behaves exactly as in Execute0x8
+                switch(instr & 0x000F) {
+                    case 0x0: EmitMov8(e, vx, vy); break;
+                    case 0x1: EmitAlu8(e, ALU_OR,  vx, vy); break;
+                    case 0x2: EmitAlu8(e, ALU_AND, vx, vy); break;
+                    case 0x3: EmitAlu8(e, ALU_XOR, vx, vy); break;
+                    case 0x4:
+                        EmitMov8(e, al, vx);
+                        EmitAlu8(e, ALU_ADD, al, vy);
+                        Emit8(e, 0x0F); Emit8(e, 0x92); Emit8(e, 0xC1);   // setc cl
+                        EmitMov8(e, vf, cl);
+                        EmitAlu8(e, ALU_ADD, vx, vy);
+                        break;
+                    case 0x5:
+                        EmitMov8(e, al, vx);
+                        EmitAlu8(e, ALU_CMP, al, vy);
+                        Emit8(e, 0x0F); Emit8(e, 0x97); Emit8(e, 0xC1);   // seta cl
+                        EmitMov8(e, vf, cl);
+                        EmitAlu8(e, ALU_SUB, vx, vy);
+                        break;
+                    case 0x6:
+                        EmitMov8(e, cl, vx);
+                        EmitAluImm8(e, EXT_AND, cl, 0x01);
+                        EmitMov8(e, vf, cl);
+                        EmitRM8(e, 0xD0, EXT_SHR, true, vx);
+                        break;
+                    case 0x7:
+                        EmitMov8(e, al, vy);
+                        EmitAlu8(e, ALU_CMP, al, vx);
+                        Emit8(e, 0x0F); Emit8(e, 0x97); Emit8(e, 0xC1);   // seta cl
+                        EmitMov8(e, vf, cl);
+                        EmitMov8(e, al, vy);
+                        EmitAlu8(e, ALU_SUB, al, vx);
+                        EmitMov8(e, vx, al);
+                        break;
+                    case 0xE:
+                        EmitMov8(e, cl, vx);
+                        EmitRM8(e, 0xC0, EXT_SHR, true, cl);               // shr cl, 7
+                        Emit8(e, 7);
+                        EmitMov8(e, vf, cl);
+                        EmitRM8(e, 0xD0, EXT_SHL, true, vx);
+                        break;
+                }
+            } break;
+            case 0xa: Emit8(e, 0x66); Emit8(e, 0xC7); Emit8(e, 0x43); Emit8(e, CPU_OFF(I)); Emit16(e, nnn); break;
+            case 0xb: {
+                EmitMovzx8(e, RAX, OpVX(&b, 0));
+                Emit8(e, 0x05); Emit32(e, nnn);                                     // add eax, nnn
+                Emit8(e, 0x0F); Emit8(e, 0xB7); Emit8(e, 0xC0);                     // movzx eax, ax
+                EmitExitDynamic(jit, &b, instr, done);
+                ended = true;
+            } break;
+            case 0xc: case 0xd: EmitFallback(jit, &b, at, instr, done); break;
+            case 0xe: {
+                if(nn != 0x9e && nn != 0xa1) break;
+                static const uint8_t fresh[] = { 0x41, 0x80, 0x7F };                // cmp byte [r15 + key_fresh], 0
+                EmitBytes(e, fresh, sizeof(fresh));
+                Emit8(e, (uint8_t) offsetof(Chip8_Memory, key_fresh)); Emit8(e, 0x00);
+                uint8_t* changed = EmitJump32(e, JCC_JNE);
+
+                static const uint8_t keys[] = { 0x41, 0x0F, 0xB7, 0x47 };          // movzx eax, word [r15 + key_states]
+                EmitBytes(e, keys, sizeof(keys));
+                Emit8(e, (uint8_t) offsetof(Chip8_Memory, key_states));
+                Emit8(e, 0xA9); Emit32(e, 0x8000 >> x);                             // test eax, key bit
+                uint8_t* skip = EmitJump32(e, nn == 0x9e ? JCC_JNE : JCC_JE);
+                EmitExitStatic(jit, &b, next, instr, done);
+                PatchRel32(skip, Here(e));
+                EmitExitStatic(jit, &b, next + 2, instr, done);
+
+                // The first read after the keys changed goes through ReadKeys, which reports it
+                PatchRel32(changed, Here(e));
+                EmitFallback(jit, &b, at, instr, done);
+                EmitRetire(e, instr, done);
+                EmitLoadPC(e);
+                EmitExitNoLink(jit, e);
+                ended = true;
+            } break;
+            case 0xf: {
+                switch(nn) {
+                    case 0x07: EmitMov8(e, vx, OpMem(CPU_OFF(delay_timer))); break;
+                    case 0x15: EmitMov8(e, OpMem(CPU_OFF(delay_timer)), vx); break;
+                    case 0x18: EmitMov8(e, OpMem(CPU_OFF(sound_timer)), vx); break;
+                    case 0x1e:
+                        EmitMovzx8(e, RAX, vx);
+                        Emit8(e, 0x66); Emit8(e, 0x01); Emit8(e, 0x43); Emit8(e, CPU_OFF(I)); // add [I], ax
+                        break;
+                    case 0x29:
+                        EmitMovzx8(e, RAX, vx);
+                        Emit8(e, 0x8D); Emit8(e, 0x04); Emit8(e, 0x80);                      // lea eax, [rax + rax * 4]
+                        Emit8(e, 0x66); Emit8(e, 0x89); Emit8(e, 0x43); Emit8(e, CPU_OFF(I)); // mov [I], ax
+                        break;
+                    case 0x65:
+                        Emit8(e, 0x0F); Emit8(e, 0xB7); Emit8(e, 0x43); Emit8(e, CPU_OFF(I)); // movzx eax, word [I]
+                        for(uint8_t k = 0; k <= x; k++) {
+                            // The address wraps around the end of memory, I can be anywhere
+                            if(k > 0) {
+                                Emit8(e, 0xFF); Emit8(e, 0xC0);                               // inc eax
+                            }
+                            Emit8(e, 0x25); Emit32(e, CHIP8_DECODE_SLOTS - 1);                // and eax, 0xFFF
+
+                            // mov r8, [r13 + rax], into the register caching Vk or into cl
+                            int8_t reg = b.host[k] >= 0 ? b.host[k] : RCX;
+                            Emit8(e, 0x41 | (reg >= 8 ? 0x04 : 0x00));
+                            Emit8(e, 0x8A);
+                            Emit8(e, 0x44 | ((reg & 7) << 3));
+                            Emit8(e, 0x05);
+                            Emit8(e, 0x00);
+                            if(b.host[k] < 0)
+                                EmitMov8(e, OpMem(CPU_OFF(VX) + k), cl);
+                        }
+                        break;
+                    case 0x0a: {
+                        EmitFallback(jit, &b, at, instr, done);
+                        EmitRetire(e, instr, done);
+                        EmitLoadPC(e);
+                        EmitExitNoLink(jit, e);
+                        ended = true;
+                    } break;
+                    case 0x33: case 0x55: case 0x30: case 0x75: case 0x85:
+                        EmitFallback(jit, &b, at, instr, done);
+                        break;
+                }
+            } break;
+        }
+    }
+
+    if(!ended)
+        EmitExitStatic(jit, &b, addr, instrs[count - 1], count);
+
+    memset(jit->covered + pc, 1, addr - pc);
+    jit->entry[pc]     = block;
+    jit->block_len[pc] = (uint8_t) count;
+    jit->code_used     = (e->pos + 15) & ~(size_t) 15;
+    return block;
+}
+
+Chip8_Jit* CreateJit(void)
+{
+    Chip8_Jit* jit = (Chip8_Jit*) calloc(1, sizeof(Chip8_Jit));
+    if(jit == NULL) return NULL;
+
+#ifdef _WIN32
+    jit->code = (uint8_t*) VirtualAlloc(NULL, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+    jit->code = (uint8_t*) mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(jit->code == MAP_FAILED) jit->code = NULL;
+#endif
+    if(jit->code == NULL) {
+        free(jit);
+        return NULL;
+    }
+
+    EmitTrampolines(jit);
+    return jit;
+}
+
+void DestroyJit(Chip8_Jit* jit)
+{
+    if(jit == NULL) return;
+#ifdef _WIN32
+    VirtualFree(jit->code, 0, MEM_RELEASE);
+#else
+    munmap(jit->code, JIT_CODE_SIZE);
+#endif
+    free(jit);
+}
+
+uint32_t ExecCyclesJit(Chip8_Jit* jit, Chip8_CPU* cpu, Chip8_Memory* mem, uint32_t cycles)
+{
+    typedef uint32_t (*Jit_Enter)(Chip8_Jit*, uint8_t*);
+    Jit_Enter enter = (Jit_Enter)(uintptr_t) jit->code;
+
+    jit->cpu = cpu;
+    jit->mem = mem;
+    if(jit->memory != mem->ptr_8) {
+        FlushJit(jit);
+        memset(jit->smc_count, 0x00, sizeof(jit->smc_count));
+        jit->memory = mem->ptr_8;
+    }
+
+    uint32_t remaining = cycles;
+    while(remaining > 0 && cpu->wait_key_reg == 0xFF) {
+        uint16_t pc    = cpu->PC;
+        uint8_t* block = NULL;
+
+        if(pc <= CHIP8_DECODE_SLOTS - 2) {
+            block = jit->entry[pc];
+            if(block == NULL)
+                block = TranslateBlock(jit, pc);
+        }
+
+        if(jit->pending_link != NULL) {
+            if(block != NULL && pc == jit->pending_pc) PatchRel32(jit->pending_link, block);
+            jit->pending_link = NULL;
+        }
+
+        if(block == NULL || remaining < jit->block_len[pc]) {
+            JitExecOne(jit, cpu, mem);
+            remaining--;
+            continue;
+        }
+
+        jit->budget    = (int32_t) remaining;
+        jit->exit_link = NULL;
+        jit->flushed   = 0;
+        enter(jit, block);
+
+        remaining         = (uint32_t) jit->budget;
+        cpu->PC           = (uint16_t) jit->exit_pc;
+        jit->pending_link = jit->flushed ? NULL : jit->exit_link;
+        jit->pending_pc   = cpu->PC;
+    }
+    return cycles - remaining;
+}
+
+#else // not x86-64: there is nothing to generate code for, SetEngine keeps the current engine
+
+Chip8_Jit* CreateJit(void) { return NULL; }
+void       DestroyJit(Chip8_Jit* jit) { (void) jit; }
+void       FlushJit(Chip8_Jit* jit) { (void) jit; }
+void       InvalidateJit(Chip8_Jit* jit, uint16_t addr, uint16_t len) { (void) jit; (void) addr; (void) len; }
+void       UnlinkJit(Chip8_Jit* jit) { (void) jit; }
+
+uint32_t ExecCyclesJit(Chip8_Jit* jit, Chip8_CPU* cpu, Chip8_Memory* mem, uint32_t cycles)
+{
+    (void) jit;
+    return ExecCycles(cpu, mem, cycles);
+}
+
+#endif
@@ -0,0 +1,519 @@
+#include "Chip8_Core.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Lockstep execution of many instances of one ROM.
+//
+// Register rows are operated on through GCC vector extensions, one vector holding the same
+// register of all 32 lanes: they compile to single AVX2 operations when building with -mavx2
+// and to pairs of SSE2 operations otherwise. An instruction is issued for a group of lanes that
+// share a PC, the other lanes are masked out of every register write. Memory, the screen and
+// the stack belong to each lane, so instructions touching them loop over the group's lanes.
+//
+// Timing follows RunCycles exactly: batches end on 60hz ticks and every lane gets the same
+// number of cycles per batch, which is what keeps lanes in step to begin with.
+
+typedef uint8_t  Lane8  __attribute__((vector_size(CHIP8_LOCKSTEP_LANES),     aligned(16), may_alias));
+typedef uint16_t Lane16 __attribute__((vector_size(CHIP8_LOCKSTEP_LANES * 2), aligned(16), may_alias));
+typedef uint32_t Lane32 __attribute__((vector_size(CHIP8_LOCKSTEP_LANES * 4), aligned(16), may_alias));
+
+#define V8(reg)      (*(Lane8*)  ls->VX[reg])
+#define LANES16(arr) (*(Lane16*) (arr))
+#define LANES8(arr)  (*(Lane8*)  (arr))
+#define LANES32(arr) (*(Lane32*) (arr))
+
+#define FOR_EACH_LANE(lane, bits) \
+    for(uint32_t lane##_bits = (bits), lane; lane##_bits && ((lane = __builtin_ctz(lane##_bits)), 1); lane##_bits &= lane##_bits - 1)
+
+// A set of lanes as a bitmask and as the masks blending register writes of each width
+typedef struct LOCKSTEPGROUP {
+    uint32_t bits;
+    Lane8    m8;
+    Lane16   m16;
+    Lane32   m32;
+} Lockstep_Group;
+
+static const Lane32 lane_bit = {
+    1u <<  0, 1u <<  1, 1u <<  2, 1u <<  3, 1u <<  4, 1u <<  5, 1u <<  6, 1u <<  7,
+    1u <<  8, 1u <<  9, 1u << 10, 1u << 11, 1u << 12, 1u << 13, 1u << 14, 1u << 15,
+    1u << 16, 1u << 17, 1u << 18, 1u << 19, 1u << 20, 1u << 21, 1u << 22, 1u << 23,
+    1u << 24, 1u << 25, 1u << 26, 1u << 27, 1u << 28, 1u << 29, 1u << 30, 1u << 31,
+};
+
+static void SetGroup(Lockstep_Group* g, uint32_t bits)
+{
+    g->bits = bits;
+    g->m32  = (Lane32)((lane_bit & bits) != 0);
+    g->m16  = __builtin_convertvector(g->m32, Lane16);
+    g->m8   = __builtin_convertvector(g->m32, Lane8);
+}
+
+// One bit per lane of a byte mask, the inverse of SetGroup
+static inline uint32_t LaneBitsOf(const Lane8* mask)
+{
+#if defined(__AVX2__)
+    __m256i v;
+    memcpy(&v, mask, sizeof(v));
+    return (uint32_t) _mm256_movemask_epi8(v);
+#elif defined(__SSE2__)
+    __m128i lo, hi;
+    memcpy(&lo, mask, sizeof(lo));
+    memcpy(&hi, (const uint8_t*) mask + sizeof(lo), sizeof(hi));
+    return (uint32_t) _mm_movemask_epi8(lo) | (uint32_t) _mm_movemask_epi8(hi) << 16;
+#else
+    uint32_t bits = 0;
+    for(uint32_t lane = 0; lane < CHIP8_LOCKSTEP_LANES; lane++)
+        bits |= (uint32_t)((*mask)[lane] >> 7) << lane;
+    return bits;
+#endif
+}
+
+// Vectors wider than the enabled instruction set are never passed by value, which keeps the
+// calling convention out of it: these are macros and LaneBits takes its mask by address
+#define Blend8(m, value, old)  (((value) & (m)) | ((old) & ~(m)))
+#define Blend16(m, value, old) (((value) & (m)) | ((old) & ~(m)))
+#define Blend32(m, value, old) (((value) & (m)) | ((old) & ~(m)))
+#define LaneBits(mask)         ({ Lane8 lane_mask = (mask); LaneBitsOf(&lane_mask); })
+
+static inline void MarkWritten(Chip8_Lockstep* ls, uint16_t addr)
+{
+    addr &= 0xFFF;
+    ls->written[addr >> 6] |= 1ull << (addr & 63);
+}
+
+static inline bool WasWritten(const Chip8_Lockstep* ls, uint16_t addr)
+{
+    addr &= 0xFFF;
+    return (ls->written[addr >> 6] >> (addr & 63)) & 1;
+}
+
+// Sprite drawing for a single lane, the same wrap and clip rules as Execute0xD
+static void DrawLane(Chip8_Lockstep* ls, uint32_t lane, uint8_t reg_x, uint8_t reg_y, uint8_t height)
+{
+    uint32_t  x      = ls->VX[reg_x][lane] % CHIP8_SCREEN_WIDTH;
+    uint32_t  y      = ls->VX[reg_y][lane] % CHIP8_SCREEN_HEIGHT;
+    uint32_t  rows   = min(height, CHIP8_SCREEN_HEIGHT - y);
+    uint64_t* screen = ls->screen[lane] + y;
+    uint64_t  collision = 0;
+
+    for(uint32_t row = 0; row < rows; row++) {
+        uint64_t line = ((uint64_t) ls->memory[lane][(ls->I[lane] + row) & 0xFFF] << 56) >> x;
+        collision   |= screen[row] & line;
+        screen[row] ^= line;
+    }
+    ls->VX[0x0F][lane] = collision != 0;
+}
+
+// Lowest PC among the given lanes, 0xFFFF when there are none
+static uint16_t LowestPC(const Chip8_Lockstep* ls, uint32_t bits)
+{
+    uint16_t lowest = 0xFFFF;
+    FOR_EACH_LANE(lane, bits)
+        lowest = ls->PC[lane] < lowest ? ls->PC[lane] : lowest;
+    return lowest;
+}
+
+// Number of instructions the group can issue before one of its lanes runs out of cycles
+static uint32_t GroupBudget(const Lane32* remaining, uint32_t bits)
+{
+    uint32_t budget = UINT32_MAX;
+    FOR_EACH_LANE(lane, bits)
+        budget = (*remaining)[lane] < budget ? (*remaining)[lane] : budget;
+    return budget;
+}
+
+// Runs every lane that is not waiting on a key for 'cycles' instructions.
+//
+// While a group executes, its shared PC is kept in a scalar and the instructions it issued are
+// only counted, both are written back to the lanes (flushed) when the group changes: a lane
+// runs out of cycles, a branch sends the lanes different ways, or the group catches up with the
+// lowest PC among the other lanes, at which point they merge
+static void ExecLockstep(Chip8_Lockstep* ls, uint32_t cycles)
+{
+    Lane32         remaining  = {};
+    Lane32         executed   = {};
+    uint32_t       runnable   = 0;
+    Lockstep_Group g;
+    uint16_t       pc         = 0;
+    uint32_t       budget     = 0;
+    uint32_t       pending    = 0;      // Instructions issued by the group since the last flush
+    uint16_t       others_min = 0xFFFF; // Lowest PC of the runnable lanes outside the group
+
+    for(uint32_t lane = 0; lane < ls->num_lanes; lane++) {
+        if(ls->wait_key_reg[lane] != 0xFF || cycles == 0)
+            continue;
+        remaining[lane] = cycles;
+        runnable |= 1u << lane;
+    }
+    SetGroup(&g, 0);
+
+    #define FLUSH() do {                                                                  \
+        LANES16(ls->PC) = Blend16(g.m16, (Lane16){} + pc, LANES16(ls->PC));               \
+        remaining -= g.m32 & pending;                                                     \
+        executed  += g.m32 & pending;                                                     \
+        pending    = 0;                                                                   \
+    } while(0)
+
+    while(runnable) {
+        if(g.bits == 0) {
+            uint32_t bits = 0;
+            pc = LowestPC(ls, runnable);
+            FOR_EACH_LANE(lane, runnable)
+                bits |= (uint32_t)(ls->PC[lane] == pc) << lane;
+            SetGroup(&g, bits);
+            budget     = GroupBudget(&remaining, bits);
+            others_min = LowestPC(ls, runnable & ~bits);
+        }
+
+        uint32_t leader = __builtin_ctz(g.bits);
+        uint16_t addr   = pc & 0xFFF;
+        uint16_t instr  = (uint16_t) ls->memory[leader][addr] << 8 | ls->memory[leader][(addr + 1) & 0xFFF];
+
+        // Where some lane wrote into memory the lanes' code may differ, those that disagree with
+        // the leader are split off and wait at this PC for a group of their own
+        if(WasWritten(ls, addr) || WasWritten(ls, addr + 1)) {
+            uint32_t agree = 0;
+            FOR_EACH_LANE(lane, g.bits) {
+                uint16_t own = (uint16_t) ls->memory[lane][addr] << 8 | ls->memory[lane][(addr + 1) & 0xFFF];
+                agree |= (uint32_t)(own == instr) << lane;
+            }
+            if(agree != g.bits) {
+                FLUSH();
+                SetGroup(&g, agree);
+                budget     = GroupBudget(&remaining, agree);
+                others_min = pc;
+            }
+        }
+
+        uint16_t nnn    = (instr & 0x0FFF);
+        uint8_t  nn     = (instr & 0x00FF);
+        uint8_t  x      = (instr & 0x0F00) >> 8;
+        uint8_t  y      = (instr & 0x00F0) >> 4;
+        uint8_t  optype = (instr & 0x000F);
+        uint32_t group  = g.bits;
+        bool     split  = false;    // The lanes' PCs were written individually, the group ends
+
+        pc += 2;
+        pending++;
+        budget--;
+        ls->group_steps++;
+
+        switch(instr >> 12) {
+            case 0x0: {
+                if(nnn == 0x0E0) {
+                    FOR_EACH_LANE(lane, group)
+                        memset(ls->screen[lane], 0x00, sizeof(ls->screen[lane]));
+                } else if(nnn == 0x0EE) {
+                    // Lanes usually return to the same address, in which case they stay together
+                    uint16_t target   = 0;
+                    bool     uniform  = true;
+                    bool     first    = true;
+                    FLUSH();
+                    FOR_EACH_LANE(lane, group) {
+                        ls->stack_ptr[lane] = (ls->stack_ptr[lane] - 1) & (CHIP8_STACK_DEPTH - 1);
+                        ls->PC[lane]        = ls->stack[ls->stack_ptr[lane]][lane];
+                        uniform &= first || ls->PC[lane] == target;
+                        target   = ls->PC[lane];
+                        first    = false;
+                    }
+                    if(uniform)
+                        pc = target;
+                    else
+                        split = true;
+                }
+            } break;
+            case 0x1: pc = nnn; break;
+            case 0x2: {
+                FOR_EACH_LANE(lane, group) {
+                    ls->stack[ls->stack_ptr[lane]][lane] = pc;
+                    ls->stack_ptr[lane] = (ls->stack_ptr[lane] + 1) & (CHIP8_STACK_DEPTH - 1);
+                }
+                pc = nnn;
+            } break;
+            case 0x3: case 0x4: case 0x5: case 0x9: case 0xe: {
+                Lane8 cond;
+                switch(instr >> 12) {
+                    case 0x3: cond = (Lane8)(V8(x) == nn);    break;
+                    case 0x4: cond = (Lane8)(V8(x) != nn);    break;
+                    case 0x5: cond = (Lane8)(V8(x) == V8(y)); break;
+                    case 0x9: cond = (Lane8)(V8(x) != V8(y)); break;
+                    default: {
+                        // Same as Execute0xE, the key tested is given by the register index
+                        Lane16 down = (Lane16)((LANES16(ls->key_states) & (uint16_t)(0x8000 >> x)) != 0);
+                        cond = __builtin_convertvector(down, Lane8);
+                        if(nn == 0xa1) cond = ~cond;
+                        else if(nn != 0x9e) cond = (Lane8){};
+                    } break;
+                }
+
+                uint32_t taken = LaneBits(cond) & group;
+                if(taken == group)
+                    pc += 2;
+                else if(taken != 0) {
+                    Lockstep_Group t;
+                    FLUSH();
+                    SetGroup(&t, taken);
+                    LANES16(ls->PC) += t.m16 & 2;
+                    split = true;
+                }
+            } break;
+            case 0x6: V8(x) = Blend8(g.m8, (Lane8){} + nn, V8(x)); break;
+            case 0x7: V8(x) = Blend8(g.m8, V8(x) + nn, V8(x)); break;
+            case 0x8: {
+                // As in Execute0x8 the flag is written first and the operands read again after
+                switch(optype) {
+                    case 0x00: V8(x) = Blend8(g.m8, V8(y), V8(x)); break;
+                    case 0x01: V8(x) = Blend8(g.m8, V8(x) | V8(y), V8(x)); break;
+                    case 0x02: V8(x) = Blend8(g.m8, V8(x) & V8(y), V8(x)); break;
+                    case 0x03: V8(x) = Blend8(g.m8, V8(x) ^ V8(y), V8(x)); break;
+                    case 0x04:
+                        V8(0xF) = Blend8(g.m8, (Lane8)(V8(y) > (255 - V8(x))) & 1, V8(0xF));
+                        V8(x)   = Blend8(g.m8, V8(x) + V8(y), V8(x));
+                        break;
+                    case 0x05:
+                        V8(0xF) = Blend8(g.m8, (Lane8)(V8(x) > V8(y)) & 1, V8(0xF));
+                        V8(x)   = Blend8(g.m8, V8(x) - V8(y), V8(x));
+                        break;
+                    case 0x06:
+                        V8(0xF) = Blend8(g.m8, V8(x) & 1, V8(0xF));
+                        V8(x)   = Blend8(g.m8, V8(x) >> 1, V8(x));
+                        break;
+                    case 0x07:
+                        V8(0xF) = Blend8(g.m8, (Lane8)(V8(y) > V8(x)) & 1, V8(0xF));
+                        V8(x)   = Blend8(g.m8, V8(y) - V8(x), V8(x));
+                        break;
+                    case 0x0E:
+                        V8(0xF) = Blend8(g.m8, V8(x) >> 7, V8(0xF));
+                        V8(x)   = Blend8(g.m8, V8(x) << 1, V8(x));
+                        break;
+                }
+            } break;
+            case 0xa: LANES16(ls->I) = Blend16(g.m16, (Lane16){} + nnn, LANES16(ls->I)); break;
+            case 0xb: {
+                FLUSH();
+                Lane16 target = __builtin_convertvector(V8(0), Lane16) + nnn;
+                LANES16(ls->PC) = Blend16(g.m16, target, LANES16(ls->PC));
+                split = true;
+            } break;
+            case 0xc: {
+                // The per-lane xorshift32 of NextRandom, all lanes stepped at once
+                Lane32 state = LANES32(ls->rng_state);
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                LANES32(ls->rng_state) = Blend32(g.m32, state, LANES32(ls->rng_state));
+                V8(x) = Blend8(g.m8, __builtin_convertvector(state % 255, Lane8) & nn, V8(x));
+            } break;
+            case 0xd: {
+                FOR_EACH_LANE(lane, group)
+                    DrawLane(ls, lane, x, y, optype);
+            } break;
+            case 0xf: {
+                switch(nn) {
+                    case 0x07: V8(x) = Blend8(g.m8, LANES8(ls->delay_timer), V8(x)); break;
+                    case 0x0a: {
+                        FLUSH();
+                        FOR_EACH_LANE(lane, group) {
+                            ls->wait_key_reg[lane]  = x;
+                            ls->wait_key_prev[lane] = ls->key_states[lane];
+                        }
+                        remaining &= ~g.m32;
+                        split = true;
+                    } break;
+                    case 0x15: LANES8(ls->delay_timer) = Blend8(g.m8, V8(x), LANES8(ls->delay_timer)); break;
+                    case 0x18: LANES8(ls->sound_timer) = Blend8(g.m8, V8(x), LANES8(ls->sound_timer)); break;
+                    case 0x1e: {
+                        Lane16 sum = LANES16(ls->I) + __builtin_convertvector(V8(x), Lane16);
+                        LANES16(ls->I) = Blend16(g.m16, sum, LANES16(ls->I));
+                    } break;
+                    case 0x29: {
+                        Lane16 glyph = __builtin_convertvector(V8(x), Lane16) * 5;
+                        LANES16(ls->I) = Blend16(g.m16, glyph, LANES16(ls->I));
+                    } break;
+                    case 0x33: {
+                        FOR_EACH_LANE(lane, group) {
+                            uint8_t  value = ls->VX[x][lane];
+                            uint16_t at    = ls->I[lane];
+                            ls->memory[lane][(at + 0) & 0xFFF] = value / 100;
+                            ls->memory[lane][(at + 1) & 0xFFF] = value / 10 % 10;
+                            ls->memory[lane][(at + 2) & 0xFFF] = value % 10;
+                            for(int offset = 0; offset < 3; offset++)
+                                MarkWritten(ls, at + offset);
+                        }
+                    } break;
+                    case 0x55: {
+                        FOR_EACH_LANE(lane, group) {
+                            for(int reg = 0; reg <= x; reg++) {
+                                ls->memory[lane][(ls->I[lane] + reg) & 0xFFF] = ls->VX[reg][lane];
+                                MarkWritten(ls, ls->I[lane] + reg);
+                            }
+                        }
+                    } break;
+                    case 0x65: {
+                        FOR_EACH_LANE(lane, group) {
+                            for(int reg = 0; reg <= x; reg++)
+                                ls->VX[reg][lane] = ls->memory[lane][(ls->I[lane] + reg) & 0xFFF];
+                        }
+                    } break;
+                }
+            } break;
+        }
+
+        if(split || budget == 0) {
+            // Lanes out of cycles (or now waiting on a key) drop out. If the group held every
+            // runnable lane and stayed together it carries on with whichever lanes are left
+            bool everyone = group == runnable && !split;
+            if(!split)
+                FLUSH();
+            uint32_t done = LaneBits(__builtin_convertvector((Lane32)(remaining == 0), Lane8));
+            runnable &= ~done;
+
+            if(everyone && runnable) {
+                SetGroup(&g, runnable);
+                budget = GroupBudget(&remaining, runnable);
+            } else
+                SetGroup(&g, 0);
+        }
+        else if(pc >= others_min) {
+            // Caught up with (or went past) other lanes: regroup around the lowest PC
+            FLUSH();
+            SetGroup(&g, 0);
+        }
+    }
+    #undef FLUSH
+
+    for(uint32_t lane = 0; lane < ls->num_lanes; lane++)
+        ls->instruction_count[lane] += executed[lane];
+}
+
+// ResolveKeyWait, for every lane
+static void ResolveLaneKeyWaits(Chip8_Lockstep* ls)
+{
+    for(uint32_t lane = 0; lane < ls->num_lanes; lane++) {
+        if(ls->wait_key_reg[lane] == 0xFF)
+            continue;
+
+        ls->wait_key_prev[lane] &= ls->key_states[lane];
+        uint16_t pressed = ls->key_states[lane] & ~ls->wait_key_prev[lane];
+        if(pressed == 0)
+            continue;
+
+        uint8_t key_idx = 0;
+        while((pressed & (0x8000 >> key_idx)) == 0) key_idx++;
+        ls->VX[ls->wait_key_reg[lane]][lane] = key_idx;
+        ls->wait_key_reg[lane] = 0xFF;
+    }
+}
+
+// Every lane starts as a copy of a freshly Initialize'd instance, seeded with the lane index
+// plus one. The caller can reseed lanes and set their keys before running
+Chip8_Lockstep* CreateLockstep(const uint8_t* program, size_t size, uint32_t num_lanes,
+                               uint32_t instructions_per_second)
+{
+    if(num_lanes == 0 || num_lanes > CHIP8_LOCKSTEP_LANES || size > 4096 - 0x200)
+        return NULL;
+
+    Chip8_Lockstep* ls = (Chip8_Lockstep*) aligned_alloc(64, sizeof(Chip8_Lockstep));
+    if(ls == NULL)
+        return NULL;
+    memset(ls, 0x00, sizeof(Chip8_Lockstep));
+
+    Chip8_CPU    cpu = {};
+    Chip8_Memory mem = {};
+    mem.ptr_8         = ls->memory[0];
+    mem.screen_buffer = ls->screen[0];
+    Initialize(program, size, &cpu, &mem);
+
+    for(uint32_t lane = 0; lane < CHIP8_LOCKSTEP_LANES; lane++) {
+        if(lane > 0)
+            memcpy(ls->memory[lane], ls->memory[0], sizeof(ls->memory[0]));
+        ls->PC[lane]           = cpu.PC;
+        ls->I[lane]            = cpu.I;
+        ls->stack_ptr[lane]    = cpu.stack_ptr;
+        ls->wait_key_reg[lane] = 0xFF;
+        ls->rng_state[lane]    = lane + 1;
+    }
+    ls->num_lanes               = num_lanes;
+    ls->instructions_per_second = instructions_per_second ? instructions_per_second : CHIP8_DEFAULT_IPS;
+    return ls;
+}
+
+void DestroyLockstep(Chip8_Lockstep* ls)
+{
+    free(ls);
+}
+
+// The lockstep counterpart of RunCycles
+void RunLockstepCycles(Chip8_Lockstep* ls, uint64_t cycles)
+{
+    const uint32_t ips = ls->instructions_per_second;
+
+    while(cycles > 0) {
+        uint32_t until_tick = (ips - ls->timer_accumulator + CHIP8_TIMER_HZ - 1) / CHIP8_TIMER_HZ;
+        uint32_t batch      = cycles < until_tick ? (uint32_t) cycles : until_tick;
+
+        ResolveLaneKeyWaits(ls);
+        ExecLockstep(ls, batch);
+
+        ls->cycle_count       += batch;
+        ls->timer_accumulator += batch * CHIP8_TIMER_HZ;
+        cycles -= batch;
+
+        while(ls->timer_accumulator >= ips) {
+            ls->timer_accumulator -= ips;
+            ls->timer_ticks++;
+            LANES8(ls->delay_timer) -= (Lane8)(LANES8(ls->delay_timer) != 0) & 1;
+            LANES8(ls->sound_timer) -= (Lane8)(LANES8(ls->sound_timer) != 0) & 1;
+        }
+    }
+}
+
+void RunLockstepFrames(Chip8_Lockstep* ls, uint64_t frames)
+{
+    const uint32_t ips = ls->instructions_per_second;
+
+    for(uint64_t target = ls->timer_ticks + frames; ls->timer_ticks < target; ) {
+        uint32_t until_tick = (ips - ls->timer_accumulator + CHIP8_TIMER_HZ - 1) / CHIP8_TIMER_HZ;
+        RunLockstepCycles(ls, until_tick);
+    }
+}
+
+// Copies a lane out into regular CPU and memory structures, mem must already point to a
+// 4096 byte memory and a screen buffer
+void ExtractLane(const Chip8_Lockstep* ls, uint32_t lane, Chip8_CPU* cpu, Chip8_Memory* mem)
+{
+    for(int reg = 0; reg < 16; reg++)
+        cpu->VX[reg] = ls->VX[reg][lane];
+    cpu->PC            = ls->PC[lane];
+    cpu->I             = ls->I[lane];
+    cpu->stack_ptr     = ls->stack_ptr[lane];
+    cpu->delay_timer   = ls->delay_timer[lane];
+    cpu->sound_timer   = ls->sound_timer[lane];
+    cpu->wait_key_reg  = ls->wait_key_reg[lane];
+    cpu->wait_key_prev = ls->wait_key_prev[lane];
+    cpu->rng_state     = ls->rng_state[lane];
+    cpu->hires         = 0;
+    cpu->planes        = 1;
+    memset(cpu->rpl, 0x00, sizeof(cpu->rpl));
+    for(int entry = 0; entry < CHIP8_STACK_DEPTH; entry++)
+        cpu->stack[entry] = ls->stack[entry][lane];
+
+    memcpy(mem->ptr_8, ls->memory[lane], sizeof(ls->memory[lane]));
+    memcpy(mem->screen_buffer, ls->screen[lane], sizeof(ls->screen[lane]));
+    mem->key_states  = ls->key_states[lane];
+    mem->variant     = CHIP8_VARIANT_CHIP8;
+    mem->memory_size = 4096;
+    mem->dirty_rows  = ~0ull;
+    ApplyScreenMode(cpu, mem);
+}
+
+uint64_t HashLaneScreen(const Chip8_Lockstep* ls, uint32_t lane)
+{
+    Chip8_Memory mem = {};
+    Chip8_CPU    cpu = {};
+    mem.screen_buffer = (uint64_t*) ls->screen[lane];
+    ApplyScreenMode(&cpu, &mem);
+    return HashScreen(&mem);
+}
@@ -10,8 +10,75 @@
 
 #include "Chip8.h"
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
+    const char* rom_path = "ROMS/Kaleidoscope.ch8";
+    uint32_t    ips      = CHIP8_DEFAULT_IPS;
+    Chip8_Engine engine  = CHIP8_ENGINE_INTERPRETER;
+    Chip8_Variant variant = CHIP8_VARIANT_CHIP8;
+    uint32_t    seed     = CHIP8_DEFAULT_SEED;
+    const char* record_path = NULL;
+    const char* profile_path = NULL;
+    const char* export_name  = NULL;
+    Chip8_Options options = {};
+
+    options.scale    = CHIP8_SCREEN_SCALE;
+    options.filter   = CHIP8_FILTER_NONE;
+    options.panel_hz = CHIP8_DEFAULT_PANEL_HZ;
+    options.rewind   = CHIP8_DEFAULT_REWIND;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-ips") == 0 && i + 1 < argc)
+            ips = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-engine") == 0 && i + 1 < argc) {
+            if(!ParseEngineName(argv[++i], &engine)) {
+                fprintf(stderr, "Unknown engine: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "-variant") == 0 && i + 1 < argc) {
+            if(!ParseVariantName(argv[++i], &variant)) {
+                fprintf(stderr, "Unknown variant: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "-scale") == 0 && i + 1 < argc)
+            options.scale = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+            if(!ParseFilterName(argv[++i], &options.filter)) {
+                fprintf(stderr, "Unknown filter: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "-panel-hz") == 0 && i + 1 < argc)
+            options.panel_hz = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-rewind") == 0 && i + 1 < argc)
+            options.rewind = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+            seed = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-record") == 0 && i + 1 < argc)
+            record_path = argv[++i];
+        else if(strcmp(argv[i], "-turbo") == 0)
+            options.turbo = true;
+        else if(strcmp(argv[i], "-profile") == 0 && i + 1 < argc)
+            profile_path = argv[++i];
+        else if(strcmp(argv[i], "-export") == 0 && i + 1 < argc)
+            export_name = argv[++i];
+        else
+            rom_path = argv[i];
+    }
+
+    if(options.scale == 0)
+        options.scale = 1;
+
+    // The filter needs at least its own factor to work with, 128x64 mode gets half the scale
+    uint32_t factor = FilterFactor(options.filter);
+    if(options.scale < factor)
+        fprintf(stderr, "The filter needs a scale of %u or more, drawing without it\n", factor);
+    else if(variant != CHIP8_VARIANT_CHIP8 && options.scale * CHIP8_SCREEN_WIDTH / CHIP8_HIRES_WIDTH < factor)
+        fprintf(stderr, "The filter needs a scale of %u or more, 128x64 mode is drawn without it\n",
+                factor * CHIP8_HIRES_WIDTH / CHIP8_SCREEN_WIDTH);
+
     // SDL-Specific Initialization
     if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0) {
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, 
@@ -28,8 +95,8 @@ int main(int, char**)
     SDL_Window* window = SDL_CreateWindow("Chip-8 Interpreter",
                                           SDL_WINDOWPOS_CENTERED,
                                           SDL_WINDOWPOS_CENTERED,
-                                          CHIP8_SCREEN_WIDTH  * CHIP8_SCREEN_SCALE,
-                                          CHIP8_SCREEN_HEIGHT * CHIP8_SCREEN_SCALE + CHIP8_INFO_REGION_HEIGHT,
+                                          CHIP8_SCREEN_WIDTH  * max(options.scale, CHIP8_SCREEN_SCALE),
+                                          CHIP8_SCREEN_HEIGHT * options.scale + CHIP8_INFO_REGION_HEIGHT,
                                           SDL_WINDOW_SHOWN);
 
     if(window == NULL) {
@@ -47,36 +114,86 @@ int main(int, char**)
     }
 
     // Load the program ROM
-    FILE* rom_file = fopen("ROMS/Kaleidoscope.ch8", "rb");
+    size_t   rom_size = 0;
+    uint8_t* program  = LoadROM(rom_path, &rom_size);
 
-    if(rom_file == NULL) {
+    if(program == NULL) {
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, 
                                  "ROM Read Failure", "Failed to open the ROM file.", NULL);
         return -1;
     }
 
-    fseek(rom_file, 0, SEEK_END);
-    size_t rom_size = ftell(rom_file);
-    fseek(rom_file, 0, SEEK_SET);
-
-    uint8_t* program = (uint8_t*) malloc(rom_size);
-    fread (program, rom_size, 1, rom_file);
-    fclose(rom_file);
-
     Chip8_CPU   cpu     = {};
     Chip8_Memory memory = {};
+    Chip8_Scheduler sched;
+
+    // XO-CHIP's 64KB of memory is too large for the stack
+    memory.variant       = variant;
+    memory.ptr_8         = (uint8_t*) malloc(VariantMemorySize(variant));
+    memory.screen_buffer = (uint64_t*) malloc(VariantScreenWords(variant) * sizeof(uint64_t));
+    if(memory.ptr_8 == NULL || memory.screen_buffer == NULL) {
+        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR,
+                                 "Memory Failure", "Failed to allocate the emulated memory.", NULL);
+        return -1;
+    }
 
-    // These are small enough that they can fit in the stack
-    uint8_t stack_memory [4096];
-    uint8_t stack_screen_buffer [CHIP8_SCREEN_WIDTH * CHIP8_SCREEN_HEIGHT];
+    Initialize(program, rom_size, &cpu, &memory);
+    SeedRandom(&cpu, seed);
+    InitializeScheduler(&sched, ips);
+    if(!SetEngine(&sched, engine))
+        fprintf(stderr, "The selected engine is not available, falling back to the interpreter\n");
+
+    // Recording, replayed with chip8_headless <rom> -replay FILE
+    Chip8_Recording recording = {};
+    if(record_path != NULL) {
+        recording.variant                 = variant;
+        recording.seed                    = seed;
+        recording.instructions_per_second = ips;
+        recording.rom_hash                = HashROM(program, rom_size);
+        options.recording                 = &recording;
+    }
 
-    memory.ptr_8         = stack_memory;
-    memory.screen_buffer = stack_screen_buffer;
+    // Frames and registers for other processes, which can also press keys through it
+    if(export_name != NULL) {
+        options.exporter = OpenExport(export_name, variant);
+        if(options.exporter == NULL)
+            fprintf(stderr, "Failed to create the shared memory export: %s\n", export_name);
+    }
 
-    Initialize(program, rom_size, &cpu, &memory);
-    RunProgram(&cpu, &memory, renderer);
+#ifdef CHIP8_PROFILE
+    // Always collected in profiling builds for the heat map, -profile FILE dumps it at exit
+    memory.profile = (Chip8_Profile*) calloc(1, sizeof(Chip8_Profile));
+#else
+    if(profile_path != NULL)
+        fprintf(stderr, "-profile needs a build with -DCHIP8_PROFILE\n");
+#endif
+
+    RunProgram(&cpu, &memory, &sched, renderer, &options);
+
+#ifdef CHIP8_PROFILE
+    if(profile_path != NULL && memory.profile != NULL) {
+        FILE* file = fopen(profile_path, "w");
+        if(file != NULL) {
+            WriteProfile(file, memory.profile, &memory);
+            fclose(file);
+        } else
+            fprintf(stderr, "Failed to write the profile: %s\n", profile_path);
+    }
+    free(memory.profile);
+#endif
+
+    if(record_path != NULL) {
+        recording.final_hash = HashState(&cpu, &memory, &sched);
+        if(!SaveRecording(record_path, &recording))
+            fprintf(stderr, "Failed to write the recording: %s\n", record_path);
+        FreeRecording(&recording);
+    }
 
     // Cleanup
+    CloseExport(options.exporter);
+    FreeScheduler(&sched);
+    free(memory.ptr_8);
+    free(memory.screen_buffer);
     free(program);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
@@ -0,0 +1,109 @@
+#include "Chip8.h"
+
+// Frame pacing.
+//
+// SDL's semaphore timeout has millisecond resolution and the host scheduler may wake a thread a
+// millisecond or more after that, so the wait for a deadline only sleeps until
+// CHIP8_PACER_SPIN_US before it and polls the counter for the rest. Spinning costs at most that
+// much of a core per frame, and it is what gets ticks out within microseconds of when they are
+// due instead of anywhere in the following millisecond or two. Waits that do not need that
+// precision sleep all the way and leave the core alone.
+
+void NoteMicros(atomic_uint_fast64_t histogram[CHIP8_LATENCY_BUCKETS], uint64_t micros)
+{
+    int bucket = 0;
+    while(bucket < CHIP8_LATENCY_BUCKETS - 1 && micros >= (2ull << bucket))
+        bucket++;
+    atomic_fetch_add_explicit(&histogram[bucket], 1, memory_order_relaxed);
+}
+
+// Upper bound, in microseconds, of the time 'percent' percent of the samples stayed under. 0
+// before the first one
+uint32_t HistogramPercentile(const atomic_uint_fast64_t histogram[CHIP8_LATENCY_BUCKETS], uint32_t percent)
+{
+    uint64_t total = 0;
+    for(int b = 0; b < CHIP8_LATENCY_BUCKETS; b++)
+        total += atomic_load_explicit(&histogram[b], memory_order_relaxed);
+    if(total == 0)
+        return 0;
+
+    uint64_t wanted = (total * percent + 99) / 100, seen = 0;
+    for(int b = 0; b < CHIP8_LATENCY_BUCKETS; b++) {
+        seen += atomic_load_explicit(&histogram[b], memory_order_relaxed);
+        if(seen >= wanted)
+            return 2u << b;
+    }
+    return 2u << (CHIP8_LATENCY_BUCKETS - 1);
+}
+
+void LogHistogram(const char* name, const atomic_uint_fast64_t histogram[CHIP8_LATENCY_BUCKETS])
+{
+    for(int b = 0; b < CHIP8_LATENCY_BUCKETS; b++) {
+        uint64_t count = atomic_load_explicit(&histogram[b], memory_order_relaxed);
+        if(count > 0)
+            SDL_Log("%s %6u-%6u us: %llu\n", name, b ? 1u << b : 0, 2u << b, (unsigned long long) count);
+    }
+    if(HistogramPercentile(histogram, 100) > 0)
+        SDL_Log("%s percentiles: 50%% < %u us, 90%% < %u us, 99%% < %u us\n", name,
+                HistogramPercentile(histogram, 50), HistogramPercentile(histogram, 90),
+                HistogramPercentile(histogram, 99));
+}
+
+void OpenPacer(Chip8_Pacer* pacer)
+{
+    pacer->frequency = SDL_GetPerformanceFrequency();
+    pacer->last      = SDL_GetPerformanceCounter();
+    pacer->deadline  = 0;
+    pacer->slept     = false;
+    for(int b = 0; b < CHIP8_LATENCY_BUCKETS; b++)
+        atomic_init(&pacer->histogram[b], 0);
+}
+
+// Cycles the real time since the last call is worth
+uint64_t PaceRealTime(Chip8_Pacer* pacer, Chip8_Scheduler* sched)
+{
+    uint64_t now    = SDL_GetPerformanceCounter();
+    uint64_t cycles = ScheduleRealTime(sched, now - pacer->last, pacer->frequency);
+    pacer->last     = now;
+    return cycles;
+}
+
+// The real time since the last call is not emulated (rewinding, fast-forwarding), and there is
+// no tick to be late for
+void PaceSkip(Chip8_Pacer* pacer)
+{
+    pacer->last     = SDL_GetPerformanceCounter();
+    pacer->deadline = 0;
+}
+
+// Called once the cycles PaceRealTime handed out, but for 'backlog' of them, have run and the
+// frame was published. A tick that was due by then counts as late by however long ago it was
+// due, a batch cut short by a key event before the tick leaves the deadline as it was
+void PaceFrame(Chip8_Pacer* pacer, const Chip8_Scheduler* sched, uint64_t backlog)
+{
+    if(pacer->deadline != 0 && !pacer->slept && pacer->last >= pacer->deadline) {
+        uint64_t late = SDL_GetPerformanceCounter() - pacer->deadline;
+        NoteMicros(pacer->histogram, late * 1000000 / pacer->frequency);
+    }
+    pacer->deadline = pacer->last + RealTimeUntilTick(sched, backlog, pacer->frequency);
+}
+
+// Returns at the deadline, or as soon as 'wake' is posted. Without 'spin' it sleeps the whole
+// way, rounded up to a millisecond, and may return a little late
+void WaitForDeadline(Chip8_Pacer* pacer, SDL_sem* wake, uint64_t deadline, bool spin)
+{
+    uint64_t now    = SDL_GetPerformanceCounter();
+    uint64_t margin = spin ? pacer->frequency * CHIP8_PACER_SPIN_US / 1000000 : 0;
+
+    pacer->slept = !spin;
+    if(deadline > now + margin) {
+        uint64_t left     = (deadline - now - margin) * 1000;
+        uint32_t sleep_ms = (uint32_t)(spin ? left / pacer->frequency : (left + pacer->frequency - 1) / pacer->frequency);
+        if(sleep_ms > 0 && SDL_SemWaitTimeout(wake, sleep_ms) == 0)
+            return;
+    }
+    while(SDL_GetPerformanceCounter() < deadline) {
+        if(SDL_SemTryWait(wake) == 0)
+            return;
+    }
+}
@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include "Chip8_Pool.h"
+
+// Range of task indices a worker still has to run. Owners take from begin, thieves from end
+typedef struct POOLQUEUE {
+    pthread_mutex_t lock;
+    size_t          begin;
+    size_t          end;
+    char            padding[64];    // Keeps the queues of different workers off the same line
+} Pool_Queue;
+
+typedef struct POOLWORKER {
+    Chip8_Pool* pool;
+    size_t      id;
+} Pool_Worker;
+
+struct CHIP8POOL {
+    size_t          num_workers;
+    pthread_t*      threads;        // num_workers - 1 threads, worker 0 is the caller of RunPool
+    Pool_Worker*    workers;
+    Pool_Queue*     queues;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  start;
+    pthread_cond_t  finished;
+    uint64_t        generation;     // Incremented by every RunPool, wakes the workers up
+    size_t          running;        // Threads that have not finished the current batch yet
+    bool            quit;
+
+    Chip8_PoolTask  task;
+    void*           arg;
+    atomic_uint_fast64_t steals;
+};
+
+static bool PopTask(Pool_Queue* queue, size_t* index)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&queue->lock);
+    if(queue->begin < queue->end) {
+        *index = queue->begin++;
+        found  = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Moves the back half of the first non-empty victim's range into the worker's own queue
+static bool StealTasks(Chip8_Pool* pool, size_t id)
+{
+    for(size_t offset = 1; offset < pool->num_workers; offset++) {
+        Pool_Queue* victim = &pool->queues[(id + offset) % pool->num_workers];
+        size_t      begin, end;
+
+        pthread_mutex_lock(&victim->lock);
+        end   = victim->end;
+        begin = victim->end - (victim->end - victim->begin + 1) / 2;
+        victim->end = begin;
+        pthread_mutex_unlock(&victim->lock);
+
+        if(begin < end) {
+            Pool_Queue* own = &pool->queues[id];
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin;
+            own->end   = end;
+            pthread_mutex_unlock(&own->lock);
+
+            atomic_fetch_add_explicit(&pool->steals, 1, memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+// No task ever creates another, so once every queue is seen empty the batch is drained
+static void WorkOn(Chip8_Pool* pool, size_t id)
+{
+    size_t index;
+
+    for(;;) {
+        while(PopTask(&pool->queues[id], &index))
+            pool->task(pool->arg, index, id);
+        if(!StealTasks(pool, id))
+            break;
+    }
+}
+
+static void* WorkerMain(void* param)
+{
+    Pool_Worker* worker = (Pool_Worker*) param;
+    Chip8_Pool*  pool   = worker->pool;
+    uint64_t     seen   = 0;
+
+    for(;;) {
+        pthread_mutex_lock(&pool->lock);
+        while(pool->generation == seen && !pool->quit)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        seen = pool->generation;
+        bool quit = pool->quit;
+        pthread_mutex_unlock(&pool->lock);
+
+        if(quit)
+            break;
+
+        WorkOn(pool, worker->id);
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->running == 0)
+            pthread_cond_signal(&pool->finished);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+Chip8_Pool* CreatePool(size_t num_workers)
+{
+    Chip8_Pool* pool = (Chip8_Pool*) calloc(1, sizeof(Chip8_Pool));
+    if(pool == NULL)
+        return NULL;
+
+    pool->num_workers = num_workers > 0 ? num_workers : 1;
+    pool->threads     = (pthread_t*)   calloc(pool->num_workers, sizeof(pthread_t));
+    pool->workers     = (Pool_Worker*) calloc(pool->num_workers, sizeof(Pool_Worker));
+    pool->queues      = (Pool_Queue*)  calloc(pool->num_workers, sizeof(Pool_Queue));
+
+    if(pool->threads == NULL || pool->workers == NULL || pool->queues == NULL) {
+        free(pool->threads);
+        free(pool->workers);
+        free(pool->queues);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+    atomic_init(&pool->steals, 0);
+
+    for(size_t id = 0; id < pool->num_workers; id++) {
+        pthread_mutex_init(&pool->queues[id].lock, NULL);
+        pool->workers[id].pool = pool;
+        pool->workers[id].id   = id;
+    }
+
+    // Should a thread fail to start, the pool just runs with fewer of them
+    size_t started = 1;
+    for(size_t id = 1; id < pool->num_workers; id++, started++) {
+        if(pthread_create(&pool->threads[id], NULL, WorkerMain, &pool->workers[id]) != 0)
+            break;
+    }
+    pool->num_workers = started;
+    return pool;
+}
+
+void DestroyPool(Chip8_Pool* pool)
+{
+    if(pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(size_t id = 1; id < pool->num_workers; id++)
+        pthread_join(pool->threads[id], NULL);
+
+    for(size_t id = 0; id < pool->num_workers; id++)
+        pthread_mutex_destroy(&pool->queues[id].lock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->finished);
+
+    free(pool->threads);
+    free(pool->workers);
+    free(pool->queues);
+    free(pool);
+}
+
+size_t PoolSize(const Chip8_Pool* pool)
+{
+    return pool->num_workers;
+}
+
+uint64_t PoolSteals(const Chip8_Pool* pool)
+{
+    return atomic_load_explicit(&((Chip8_Pool*) pool)->steals, memory_order_relaxed);
+}
+
+void RunPool(Chip8_Pool* pool, size_t count, Chip8_PoolTask task, void* arg)
+{
+    if(count == 0)
+        return;
+
+    // Contiguous, even split: neighbouring tasks tend to stay on the same worker
+    for(size_t id = 0; id < pool->num_workers; id++) {
+        pthread_mutex_lock(&pool->queues[id].lock);
+        pool->queues[id].begin = count *  id      / pool->num_workers;
+        pool->queues[id].end   = count * (id + 1) / pool->num_workers;
+        pthread_mutex_unlock(&pool->queues[id].lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task    = task;
+    pool->arg     = arg;
+    pool->running = pool->num_workers - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    WorkOn(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while(pool->running > 0)
+        pthread_cond_wait(&pool->finished, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+size_t CountCores(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (size_t) cores : 1;
+}
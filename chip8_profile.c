@@ -0,0 +1,72 @@
+#include "Chip8_Core.h"
+
+#ifdef CHIP8_PROFILE
+
+static const char* const class_names[16] = {
+    "0nnn", "1nnn", "2nnn", "3xnn", "4xnn", "5xy0", "6xnn", "7xnn",
+    "8xyn", "9xy0", "Annn", "Bnnn", "Cxnn", "Dxyn", "Exnn", "Fxnn",
+};
+
+typedef struct {
+    uint64_t count;
+    uint16_t addr;
+} Profile_Address;
+
+static int CompareHotness(const void* a, const void* b)
+{
+    uint64_t count_a = ((const Profile_Address*) a)->count;
+    uint64_t count_b = ((const Profile_Address*) b)->count;
+    return (count_a < count_b) - (count_a > count_b);
+}
+
+// Dumps the counters as JSON. Addresses that were executed are listed hottest first along
+// with the instruction currently at each of them
+void WriteProfile(FILE* out, const Chip8_Profile* profile, const Chip8_Memory* mem)
+{
+    uint64_t total_count = 0, total_time = 0;
+    for(int c = 0; c < 16; c++) {
+        total_count += profile->class_count[c];
+        total_time  += profile->class_time[c];
+    }
+
+    fprintf(out, "{\n  \"instructions\": %llu,\n  \"ticks\": %llu,\n  \"classes\": [\n",
+            (unsigned long long) total_count, (unsigned long long) total_time);
+    for(int c = 0; c < 16; c++) {
+        fprintf(out, "    { \"class\": \"%s\", \"count\": %llu, \"ticks\": %llu }%s\n", class_names[c],
+                (unsigned long long) profile->class_count[c], (unsigned long long) profile->class_time[c],
+                c < 15 ? "," : "");
+    }
+
+    fprintf(out, "  ],\n  \"draw\": {\n");
+    fprintf(out, "    \"count\": %llu,\n",      (unsigned long long) profile->draw_count);
+    fprintf(out, "    \"rows\": %llu,\n",       (unsigned long long) profile->draw_rows);
+    fprintf(out, "    \"clipped\": %llu,\n",    (unsigned long long) profile->draw_clipped);
+    fprintf(out, "    \"collisions\": %llu,\n", (unsigned long long) profile->draw_collisions);
+    fprintf(out, "    \"ticks\": %llu,\n",      (unsigned long long) profile->draw_time);
+    fprintf(out, "    \"heights\": [");
+    for(int h = 0; h < 16; h++)
+        fprintf(out, "%llu%s", (unsigned long long) profile->draw_height[h], h < 15 ? ", " : "");
+    fprintf(out, "]\n  },\n  \"addresses\": [\n");
+
+    Profile_Address hot[4096];
+    size_t          num_hot = 0;
+    for(uint16_t addr = 0; addr < 4096; addr++) {
+        if(profile->pc_count[addr] > 0) {
+            hot[num_hot].count = profile->pc_count[addr];
+            hot[num_hot].addr  = addr;
+            num_hot++;
+        }
+    }
+    qsort(hot, num_hot, sizeof(Profile_Address), CompareHotness);
+
+    for(size_t idx = 0; idx < num_hot; idx++) {
+        uint16_t addr  = hot[idx].addr;
+        uint16_t instr = (uint16_t)(mem->ptr_8[addr] << 8 | mem->ptr_8[(addr + 1) & 0xFFF]);
+        fprintf(out, "    { \"addr\": \"0x%03x\", \"count\": %llu, \"instr\": \"%s\" }%s\n", addr,
+                (unsigned long long) hot[idx].count, DisassembleInstruction(instr),
+                idx + 1 < num_hot ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+#endif
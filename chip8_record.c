@@ -0,0 +1,202 @@
+#include "Chip8_Core.h"
+
+// Input recordings.
+//
+// A run is deterministic given the ROM, the variant, the instruction rate, the seed of the Cxkk
+// generator and the keys held during every frame, as long as the keys only change on frame
+// boundaries and the frames are emulated whole (RunFrames, or RunCycles up to CyclesUntilTick).
+// That is all a recording holds, plus the hash of the state the run ended in to check a replay
+// against.
+//
+// File layout, little-endian:
+//
+//   "C8RC"  magic
+//   u32     version (2)
+//   u32     variant (Chip8_Variant)
+//   u32     seed
+//   u32     instructions per second
+//   u64     ROM hash
+//   u64     frames
+//   u64     final state hash
+//   ...     key_states runs, each a LEB128 frame count and the u16 mask held for those frames
+
+static const uint32_t RECORDING_VERSION = 2;
+
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*) data;
+    for(size_t idx = 0; idx < size; idx++)
+        hash = (hash ^ bytes[idx]) * 0x100000001b3ull;
+    return hash;
+}
+
+uint64_t HashROM(const uint8_t* program, size_t size)
+{
+    return HashBytes(0xcbf29ce484222325ull, program, size);
+}
+
+// Field by field rather than over the structs, so padding never makes two equal states differ
+uint64_t HashState(const Chip8_CPU* cpu, const Chip8_Memory* mem, const Chip8_Scheduler* sched)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = HashBytes(hash, cpu->VX, sizeof(cpu->VX));
+    hash = HashBytes(hash, &cpu->PC, sizeof(cpu->PC));
+    hash = HashBytes(hash, &cpu->I, sizeof(cpu->I));
+    hash = HashBytes(hash, &cpu->delay_timer, sizeof(cpu->delay_timer));
+    hash = HashBytes(hash, &cpu->sound_timer, sizeof(cpu->sound_timer));
+    hash = HashBytes(hash, &cpu->stack_ptr, sizeof(cpu->stack_ptr));
+    hash = HashBytes(hash, &cpu->wait_key_reg, sizeof(cpu->wait_key_reg));
+    hash = HashBytes(hash, &cpu->rng_state, sizeof(cpu->rng_state));
+    hash = HashBytes(hash, cpu->stack, sizeof(cpu->stack));
+    hash = HashBytes(hash, &cpu->hires, sizeof(cpu->hires));
+    hash = HashBytes(hash, &cpu->planes, sizeof(cpu->planes));
+    hash = HashBytes(hash, cpu->rpl, sizeof(cpu->rpl));
+    hash = HashBytes(hash, mem->ptr_8, mem->memory_size);
+    hash = HashBytes(hash, mem->screen_buffer, mem->screen_words * sizeof(uint64_t));
+    hash = HashBytes(hash, &sched->timer_accumulator, sizeof(sched->timer_accumulator));
+    return hash;
+}
+
+bool RecordFrame(Chip8_Recording* rec, uint16_t keys)
+{
+    if(rec->num_frames == rec->capacity) {
+        size_t    capacity = rec->capacity ? rec->capacity * 2 : 4096;
+        uint16_t* grown    = (uint16_t*) realloc(rec->keys, capacity * sizeof(uint16_t));
+        if(grown == NULL)
+            return false;
+        rec->keys     = grown;
+        rec->capacity = capacity;
+    }
+    rec->keys[rec->num_frames++] = keys;
+    return true;
+}
+
+void FreeRecording(Chip8_Recording* rec)
+{
+    free(rec->keys);
+    rec->keys       = NULL;
+    rec->num_frames = 0;
+    rec->capacity   = 0;
+}
+
+static void PutU32(uint8_t* out, uint32_t v) { for(int b = 0; b < 4; b++) out[b] = (uint8_t)(v >> (8 * b)); }
+static void PutU64(uint8_t* out, uint64_t v) { for(int b = 0; b < 8; b++) out[b] = (uint8_t)(v >> (8 * b)); }
+
+static uint32_t GetU32(const uint8_t* in)
+{
+    uint32_t v = 0;
+    for(int b = 0; b < 4; b++) v |= (uint32_t) in[b] << (8 * b);
+    return v;
+}
+
+static uint64_t GetU64(const uint8_t* in)
+{
+    uint64_t v = 0;
+    for(int b = 0; b < 8; b++) v |= (uint64_t) in[b] << (8 * b);
+    return v;
+}
+
+bool SaveRecording(const char* path, const Chip8_Recording* rec)
+{
+    FILE* file = fopen(path, "wb");
+    if(file == NULL)
+        return false;
+
+    uint8_t header[44];
+    memcpy(header, "C8RC", 4);
+    PutU32(header + 4,  RECORDING_VERSION);
+    PutU32(header + 8,  (uint32_t) rec->variant);
+    PutU32(header + 12, rec->seed);
+    PutU32(header + 16, rec->instructions_per_second);
+    PutU64(header + 20, rec->rom_hash);
+    PutU64(header + 28, rec->num_frames);
+    PutU64(header + 36, rec->final_hash);
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+
+    for(size_t frame = 0; ok && frame < rec->num_frames; ) {
+        size_t run = 1;
+        while(frame + run < rec->num_frames && rec->keys[frame + run] == rec->keys[frame])
+            run++;
+
+        uint8_t  buffer[12];
+        uint8_t* out = buffer;
+        for(size_t length = run; ; length >>= 7) {
+            *out++ = (uint8_t)(length & 0x7F) | (length >= 0x80 ? 0x80 : 0);
+            if(length < 0x80) break;
+        }
+        *out++ = (uint8_t)(rec->keys[frame]);
+        *out++ = (uint8_t)(rec->keys[frame] >> 8);
+
+        ok     = fwrite(buffer, out - buffer, 1, file) == 1;
+        frame += run;
+    }
+
+    return fclose(file) == 0 && ok;
+}
+
+bool LoadRecording(const char* path, Chip8_Recording* rec)
+{
+    size_t   size = 0;
+    uint8_t* data = LoadROM(path, &size);
+    if(data == NULL)
+        return false;
+
+    memset(rec, 0x00, sizeof(Chip8_Recording));
+    if(size < 44 || memcmp(data, "C8RC", 4) != 0 || GetU32(data + 4) != RECORDING_VERSION ||
+       GetU32(data + 8) > CHIP8_VARIANT_XOCHIP) {
+        free(data);
+        return false;
+    }
+
+    rec->variant                 = (Chip8_Variant) GetU32(data + 8);
+    rec->seed                    = GetU32(data + 12);
+    rec->instructions_per_second = GetU32(data + 16);
+    rec->rom_hash                = GetU64(data + 20);
+    rec->final_hash              = GetU64(data + 36);
+
+    uint64_t frames = GetU64(data + 28);
+    size_t   pos    = 44;
+    while(rec->num_frames < frames) {
+        uint64_t run   = 0;
+        int      shift = 0;
+        do {
+            if(pos >= size || shift > 56) {
+                free(data);
+                FreeRecording(rec);
+                return false;
+            }
+            run   |= (uint64_t)(data[pos] & 0x7F) << shift;
+            shift += 7;
+        } while(data[pos++] & 0x80);
+
+        if(pos + 2 > size || run > frames - rec->num_frames) {
+            free(data);
+            FreeRecording(rec);
+            return false;
+        }
+        uint16_t keys = data[pos] | (uint16_t) data[pos + 1] << 8;
+        pos += 2;
+
+        while(run-- > 0) {
+            if(!RecordFrame(rec, keys)) {
+                free(data);
+                FreeRecording(rec);
+                return false;
+            }
+        }
+    }
+
+    free(data);
+    return true;
+}
+
+// Feeds the recorded keys to an instance that was just initialized with the recording's ROM,
+// variant, rate and seed, frame by frame, and returns the hash of the state it ends in
+uint64_t ReplayRecording(const Chip8_Recording* rec, Chip8_Scheduler* sched, Chip8_CPU* cpu, Chip8_Memory* mem)
+{
+    for(size_t frame = 0; frame < rec->num_frames; frame++) {
+        mem->key_states = rec->keys[frame];
+        RunFrames(sched, cpu, mem, 1);
+    }
+    return HashState(cpu, mem, sched);
+}
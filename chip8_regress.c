@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Chip8_Core.h"
+#include "Chip8_Pool.h"
+
+// Runs a corpus of ROMs side by side on a work-stealing thread pool, one independent
+// interpreter instance per ROM, and checks every one of them against its golden file.
+//
+//   chip8_regress [-threads N] [-scaling] [-frames F] [-ips N] [-engine interp|cached|jit]
+//                 [-seed S] [-golden DIR] [-update] <rom | @list>...
+//
+// Each ROM runs for F emulated 60hz frames without any input. The screen is hashed after
+// every frame and the hashes are compared against DIR/<rom name>.golden, one hash per line;
+// -update writes the golden files instead. @list reads ROM paths from a file, one per line.
+// -scaling runs the corpus with 1, 2, 4... up to N threads and reports the speedup of each
+
+typedef enum {
+    RESULT_PASS,
+    RESULT_FAIL,
+    RESULT_NEW,         // No golden file yet
+    RESULT_ERROR,
+} Regress_Status;
+
+typedef struct REGRESSROM {
+    const char*    path;
+    uint8_t*       program;
+    size_t         size;
+    uint64_t*      hashes;          // One per frame
+    uint64_t       instructions;
+    double         seconds;
+    Regress_Status status;
+    uint64_t       first_mismatch;
+} Regress_Rom;
+
+typedef struct REGRESSRUN {
+    Regress_Rom* roms;
+    size_t       num_roms;
+    uint64_t     frames;
+    uint32_t     ips;
+    uint32_t     seed;
+    Chip8_Engine engine;
+} Regress_Run;
+
+static double GetSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void PrintUsage(const char* exe)
+{
+    fprintf(stderr, "usage: %s [-threads N] [-scaling] [-frames F] [-ips N] [-engine interp|cached|jit]\n"
+                    "       %*s [-seed S] [-golden DIR] [-update] <rom | @list>...\n", exe, (int) strlen(exe), "");
+}
+
+// Pool task: runs one ROM on a fresh instance owned entirely by the calling worker
+static void RunRom(void* arg, size_t index, size_t worker)
+{
+    (void) worker;
+    Regress_Run* run = (Regress_Run*) arg;
+    Regress_Rom* rom = &run->roms[index];
+
+    Chip8_CPU       cpu    = {};
+    Chip8_Memory    memory = {};
+    Chip8_Scheduler sched;
+    uint8_t         ram[4096];
+    uint64_t        screen[CHIP8_SCREEN_HEIGHT];
+
+    memory.ptr_8         = ram;
+    memory.screen_buffer = screen;
+
+    double t_start = GetSeconds();
+
+    Initialize(rom->program, rom->size, &cpu, &memory);
+    SeedRandom(&cpu, run->seed);
+    InitializeScheduler(&sched, run->ips);
+    if(!SetEngine(&sched, run->engine)) {
+        rom->status = RESULT_ERROR;     // Checked up front, only fails for want of memory
+        FreeScheduler(&sched);
+        return;
+    }
+
+    for(uint64_t frame = 0; frame < run->frames; frame++) {
+        RunFrames(&sched, &cpu, &memory, 1);
+        rom->hashes[frame] = HashScreen(&memory);
+    }
+
+    rom->seconds      = GetSeconds() - t_start;
+    rom->instructions = sched.instruction_count;
+    FreeScheduler(&sched);
+}
+
+// Golden files live next to each other in one directory, named after the ROM file
+static void GoldenPath(char* out, size_t n, const char* dir, const char* rom_path)
+{
+    const char* name = strrchr(rom_path, '/');
+    name = name ? name + 1 : rom_path;
+    snprintf(out, n, "%s/%s.golden", dir, name);
+}
+
+static void CheckGolden(Regress_Rom* rom, const char* dir, uint64_t frames, bool update)
+{
+    char  path[4096];
+    FILE* file;
+
+    GoldenPath(path, sizeof(path), dir, rom->path);
+
+    if(update) {
+        if((file = fopen(path, "w")) == NULL) {
+            rom->status = RESULT_ERROR;
+            return;
+        }
+        for(uint64_t frame = 0; frame < frames; frame++)
+            fprintf(file, "%016llx\n", (unsigned long long) rom->hashes[frame]);
+        fclose(file);
+        rom->status = RESULT_NEW;
+        return;
+    }
+
+    if((file = fopen(path, "r")) == NULL) {
+        rom->status = RESULT_NEW;
+        return;
+    }
+
+    unsigned long long golden;
+    uint64_t           frame = 0;
+    rom->status = RESULT_PASS;
+    while(frame < frames && fscanf(file, "%llx", &golden) == 1) {
+        if(golden != rom->hashes[frame]) {
+            rom->status         = RESULT_FAIL;
+            rom->first_mismatch = frame;
+            break;
+        }
+        frame++;
+    }
+    // A golden file covering fewer frames than were run only checks those it has
+    if(frame == 0 && rom->status == RESULT_PASS)
+        rom->status = RESULT_NEW;
+    fclose(file);
+}
+
+static bool AddRom(Regress_Run* run, size_t* capacity, const char* path)
+{
+    if(run->num_roms == *capacity) {
+        size_t       grown = *capacity ? *capacity * 2 : 64;
+        Regress_Rom* roms  = (Regress_Rom*) realloc(run->roms, grown * sizeof(Regress_Rom));
+        if(roms == NULL)
+            return false;
+        run->roms = roms;
+        *capacity = grown;
+    }
+
+    Regress_Rom* rom = &run->roms[run->num_roms++];
+    memset(rom, 0x00, sizeof(Regress_Rom));
+    rom->path    = strdup(path);
+    rom->program = LoadROM(path, &rom->size);
+    rom->status  = rom->program ? RESULT_PASS : RESULT_ERROR;
+    return true;
+}
+
+static bool AddRomList(Regress_Run* run, size_t* capacity, const char* list_path)
+{
+    FILE* list = fopen(list_path, "r");
+    char  line[4096];
+
+    if(list == NULL)
+        return false;
+    while(fgets(line, sizeof(line), list) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] != '\0' && line[0] != '#' && !AddRom(run, capacity, line))
+            break;
+    }
+    fclose(list);
+    return true;
+}
+
+// Runs the whole corpus once on the pool, returns the wall clock time it took
+static double RunCorpus(Regress_Run* run, Chip8_Pool* pool)
+{
+    double t_start = GetSeconds();
+    RunPool(pool, run->num_roms, RunRom, run);
+    return GetSeconds() - t_start;
+}
+
+int main(int argc, char** argv)
+{
+    Regress_Run run      = {};
+    size_t      capacity = 0;
+    size_t      threads  = CountCores();
+    bool        scaling  = false;
+    bool        update   = false;
+    const char* golden   = "golden";
+
+    run.frames = 600;
+    run.ips    = CHIP8_DEFAULT_IPS;
+    run.seed   = CHIP8_DEFAULT_SEED;
+    run.engine = CHIP8_ENGINE_INTERPRETER;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            threads = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-scaling") == 0)
+            scaling = true;
+        else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+            run.frames = strtoull(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-ips") == 0 && i + 1 < argc)
+            run.ips = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+            run.seed = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-golden") == 0 && i + 1 < argc)
+            golden = argv[++i];
+        else if(strcmp(argv[i], "-update") == 0)
+            update = true;
+        else if(strcmp(argv[i], "-engine") == 0 && i + 1 < argc) {
+            if(!ParseEngineName(argv[++i], &run.engine)) {
+                fprintf(stderr, "Unknown engine: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(argv[i][0] == '@') {
+            if(!AddRomList(&run, &capacity, argv[i] + 1)) {
+                fprintf(stderr, "Failed to open the ROM list: %s\n", argv[i] + 1);
+                return -1;
+            }
+        }
+        else if(!AddRom(&run, &capacity, argv[i])) {
+            fprintf(stderr, "Out of memory\n");
+            return -1;
+        }
+    }
+
+    if(run.num_roms == 0 || run.frames == 0 || threads == 0) {
+        PrintUsage(argv[0]);
+        return -1;
+    }
+
+    // Every instance runs the same engine, one this host lacks is replaced for all of them
+    Chip8_Scheduler probe;
+    InitializeScheduler(&probe, run.ips);
+    if(!SetEngine(&probe, run.engine)) {
+        fprintf(stderr, "The selected engine is not available, falling back to the interpreter\n");
+        run.engine = CHIP8_ENGINE_INTERPRETER;
+    }
+    FreeScheduler(&probe);
+
+    // Unreadable ROMs are reported but not run, the rest keep their original order
+    Regress_Run runnable = run;
+    runnable.roms     = (Regress_Rom*) malloc(run.num_roms * sizeof(Regress_Rom));
+    runnable.num_roms = 0;
+    if(runnable.roms == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    for(size_t idx = 0; idx < run.num_roms; idx++) {
+        if(run.roms[idx].program == NULL)
+            continue;
+        run.roms[idx].hashes = (uint64_t*) calloc(run.frames, sizeof(uint64_t));
+        if(run.roms[idx].hashes == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return -1;
+        }
+        runnable.roms[runnable.num_roms++] = run.roms[idx];
+    }
+
+    double wall = 0.0;
+    if(scaling) {
+        printf("%8s %10s %14s %8s %8s\n", "threads", "time", "IPS", "speedup", "steals");
+
+        double   base        = 0.0;
+        uint64_t reference   = 0;
+        bool     determinism = true;
+        for(size_t count = 1; ; count = count * 2 < threads ? count * 2 : threads) {
+            Chip8_Pool* pool = CreatePool(count);
+            if(pool == NULL) {
+                fprintf(stderr, "Failed to create the thread pool\n");
+                return -1;
+            }
+            wall = RunCorpus(&runnable, pool);
+
+            uint64_t instructions = 0, digest = 0;
+            for(size_t idx = 0; idx < runnable.num_roms; idx++) {
+                instructions += runnable.roms[idx].instructions;
+                for(uint64_t frame = 0; frame < run.frames; frame++)
+                    digest = digest * 31 + runnable.roms[idx].hashes[frame];
+            }
+            if(count == 1) {
+                base      = wall;
+                reference = digest;
+            }
+            determinism &= digest == reference;
+
+            printf("%8zu %9.3fs %14.0f %7.2fx %8llu\n", PoolSize(pool), wall, instructions / wall,
+                   base / wall, (unsigned long long) PoolSteals(pool));
+            DestroyPool(pool);
+
+            if(count == threads)
+                break;
+        }
+        if(!determinism)
+            printf("Results differ between thread counts!\n");
+        printf("\n");
+    } else {
+        Chip8_Pool* pool = CreatePool(threads);
+        if(pool == NULL) {
+            fprintf(stderr, "Failed to create the thread pool\n");
+            return -1;
+        }
+        wall = RunCorpus(&runnable, pool);
+        DestroyPool(pool);
+    }
+
+    static const char* status_names[] = { "PASS", "FAIL", "NEW", "ERROR" };
+    size_t   failures     = 0;
+    uint64_t instructions = 0;
+
+    for(size_t idx = 0, next = 0; idx < run.num_roms; idx++) {
+        Regress_Rom* rom = &run.roms[idx];
+
+        if(rom->program != NULL) {
+            *rom = runnable.roms[next++];
+            if(rom->status != RESULT_ERROR)
+                CheckGolden(rom, golden, run.frames, update);
+        }
+        failures     += rom->status == RESULT_FAIL || rom->status == RESULT_ERROR;
+        instructions += rom->instructions;
+
+        printf("%-5s %-40s %12llu instructions %14.0f IPS", status_names[rom->status], rom->path,
+               (unsigned long long) rom->instructions, rom->seconds > 0 ? rom->instructions / rom->seconds : 0.0);
+        if(rom->status == RESULT_FAIL)
+            printf("  (first mismatch at frame %llu)", (unsigned long long) rom->first_mismatch);
+        printf("\n");
+
+        free(rom->hashes);
+        free(rom->program);
+        free((void*) rom->path);
+    }
+
+    printf("\n%zu ROMs, %zu failed, %llu instructions in %.3fs (%.0f IPS)\n", run.num_roms, failures,
+           (unsigned long long) instructions, wall, wall > 0 ? instructions / wall : 0.0);
+
+    free(runnable.roms);
+    free(run.roms);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,261 @@
+#include "Chip8_Core.h"
+
+// Rewind history.
+//
+// Every pushed state is stored as the XOR of its image (SaveState) against the image of the
+// newest keyframe, run-length encoded: consecutive frames differ in a handful of bytes, so
+// a delta is mostly zero runs. Keyframes are themselves encoded against an all-zero image,
+// where the same encoding squeezes out the unused parts of memory. A keyframe is taken every
+// keyframe_interval states, any delta can be decoded from its keyframe alone.
+//
+// Encoded states live in a circular byte buffer and their descriptors in a ring of entries.
+// Pushing evicts the oldest states when either one is full, always a keyframe together with
+// the deltas that depend on it. Popping removes the newest state, which is what rewinding does.
+
+struct CHIP8REWINDENTRY {
+    size_t   offset;        // Into data
+    uint32_t size;
+    uint64_t keyframe;      // Sequence number of the keyframe the state is encoded against
+};
+
+// Encoded stream: pairs of (run of unchanged bytes, run of changed bytes) as LEB128 lengths,
+// each followed by the changed bytes XORed with the base image
+
+static uint8_t* PutLength(uint8_t* out, size_t length)
+{
+    while(length >= 0x80) {
+        *out++ = (uint8_t)(length | 0x80);
+        length >>= 7;
+    }
+    *out++ = (uint8_t) length;
+    return out;
+}
+
+static const uint8_t* GetLength(const uint8_t* in, size_t* length)
+{
+    size_t value = 0;
+    int    shift = 0;
+    do {
+        value |= (size_t)(*in & 0x7F) << shift;
+        shift += 7;
+    } while(*in++ & 0x80);
+    *length = value;
+    return in;
+}
+
+// Returns the encoded size, base == NULL encodes against zeros
+static size_t EncodeState(const uint8_t* state, const uint8_t* base, size_t size, uint8_t* out)
+{
+    uint8_t* start = out;
+    size_t   pos   = 0;
+
+    #define BASE(i) (base ? base[i] : 0)
+
+    while(pos < size) {
+        size_t same = pos;
+        while(same + 8 <= size) {
+            uint64_t a, b = 0;
+            memcpy(&a, state + same, 8);
+            if(base) memcpy(&b, base + same, 8);
+            if(a != b) break;
+            same += 8;
+        }
+        while(same < size && state[same] == BASE(same))
+            same++;
+
+        // A changed run ends at the first 4 unchanged bytes in a row, shorter gaps are cheaper
+        // to carry along as literals than to start a new pair for
+        size_t changed = same, gap = 0;
+        while(changed + gap < size && gap < 4) {
+            if(state[changed + gap] == BASE(changed + gap))
+                gap++;
+            else {
+                changed += gap + 1;
+                gap = 0;
+            }
+        }
+
+        out = PutLength(out, same - pos);
+        out = PutLength(out, changed - same);
+        for(size_t i = same; i < changed; i++)
+            *out++ = state[i] ^ BASE(i);
+        pos = changed;
+    }
+    #undef BASE
+    return out - start;
+}
+
+static void DecodeState(const uint8_t* in, const uint8_t* base, size_t size, uint8_t* state)
+{
+    size_t pos = 0;
+
+    while(pos < size) {
+        size_t same, changed;
+        in = GetLength(in, &same);
+        in = GetLength(in, &changed);
+
+        if(base) memcpy(state + pos, base + pos, same);
+        else     memset(state + pos, 0x00, same);
+        pos += same;
+
+        for(size_t i = 0; i < changed; i++, pos++)
+            state[pos] = *in++ ^ (base ? base[pos] : 0);
+    }
+}
+
+static Chip8_RewindEntry* EntryAt(const Chip8_Rewind* rw, uint64_t seq)
+{
+    return &rw->entries[seq % rw->max_frames];
+}
+
+// Drops the oldest state, along with the following deltas that can no longer be decoded
+static void EvictOldest(Chip8_Rewind* rw)
+{
+    do {
+        rw->bytes -= EntryAt(rw, rw->first)->size;
+        rw->first++;
+        rw->count--;
+    } while(rw->count > 0 && EntryAt(rw, rw->first)->keyframe != rw->first);
+
+    if(rw->count == 0)
+        rw->head = 0;
+}
+
+// Finds room for 'size' bytes in the circular buffer, evicting the oldest states as needed
+static bool AllocateBytes(Chip8_Rewind* rw, size_t size, size_t* offset)
+{
+    if(size > rw->data_size)
+        return false;
+
+    for(;;) {
+        if(rw->count == 0) {
+            *offset = 0;
+            return true;
+        }
+
+        size_t oldest  = EntryAt(rw, rw->first)->offset;
+        size_t newest  = EntryAt(rw, rw->first + rw->count - 1)->offset;
+        bool   wrapped = newest < oldest;
+
+        if(!wrapped) {
+            if(rw->head + size <= rw->data_size) { *offset = rw->head; return true; }
+            if(size <= oldest)                   { *offset = 0;        return true; }
+        } else if(rw->head + size <= oldest)     { *offset = rw->head; return true; }
+
+        EvictOldest(rw);
+    }
+}
+
+Chip8_Rewind* CreateRewind(const Chip8_Memory* mem, size_t max_frames, size_t max_bytes,
+                           uint32_t keyframe_interval)
+{
+    Chip8_Rewind* rw = (Chip8_Rewind*) calloc(1, sizeof(Chip8_Rewind));
+    if(rw == NULL)
+        return NULL;
+
+    rw->state_size        = StateSize(mem);
+    rw->max_frames        = max_frames > 0 ? max_frames : 1;
+    rw->data_size         = max_bytes;
+    rw->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : 1;
+    rw->entries           = (Chip8_RewindEntry*) calloc(rw->max_frames, sizeof(Chip8_RewindEntry));
+    rw->data              = (uint8_t*) malloc(rw->data_size);
+    rw->key_state         = (uint8_t*) malloc(rw->state_size);
+    rw->state             = (uint8_t*) malloc(rw->state_size);
+    rw->encoded           = (uint8_t*) malloc(rw->state_size * 3 + 16);
+    rw->key_seq           = UINT64_MAX;
+
+    if(rw->entries == NULL || rw->data == NULL || rw->key_state == NULL || rw->state == NULL ||
+       rw->encoded == NULL) {
+        DestroyRewind(rw);
+        return NULL;
+    }
+    return rw;
+}
+
+void DestroyRewind(Chip8_Rewind* rw)
+{
+    if(rw == NULL)
+        return;
+    free(rw->entries);
+    free(rw->data);
+    free(rw->key_state);
+    free(rw->state);
+    free(rw->encoded);
+    free(rw);
+}
+
+void PushRewind(Chip8_Rewind* rw, const Chip8_CPU* cpu, const Chip8_Memory* mem, const Chip8_Scheduler* sched)
+{
+    uint64_t seq      = rw->first + rw->count;
+    bool     keyframe = rw->key_seq == UINT64_MAX || rw->key_seq < rw->first ||
+                        seq - rw->key_seq >= rw->keyframe_interval;
+
+    SaveState(cpu, mem, sched, rw->state);
+
+    size_t size = EncodeState(rw->state, keyframe ? NULL : rw->key_state, rw->state_size, rw->encoded);
+    if(rw->count == rw->max_frames)
+        EvictOldest(rw);
+
+    // Evicting may have taken the keyframe this delta was encoded against with it
+    size_t offset;
+    if(!AllocateBytes(rw, size, &offset))
+        return;
+    if(!keyframe && rw->key_seq < rw->first) {
+        keyframe = true;
+        size     = EncodeState(rw->state, NULL, rw->state_size, rw->encoded);
+        if(!AllocateBytes(rw, size, &offset))
+            return;
+    }
+    seq = rw->first + rw->count;
+
+    if(keyframe) {
+        memcpy(rw->key_state, rw->state, rw->state_size);
+        rw->key_seq = seq;
+    }
+
+    Chip8_RewindEntry* entry = EntryAt(rw, seq);
+    entry->offset   = offset;
+    entry->size     = (uint32_t) size;
+    entry->keyframe = rw->key_seq;
+    memcpy(rw->data + offset, rw->encoded, size);
+
+    rw->head   = offset + size;
+    rw->bytes += size;
+    rw->count++;
+}
+
+// Restores the newest state and removes it from the history, returns false once it is empty
+bool PopRewind(Chip8_Rewind* rw, Chip8_CPU* cpu, Chip8_Memory* mem, Chip8_Scheduler* sched)
+{
+    if(rw->count == 0)
+        return false;
+
+    uint64_t           seq   = rw->first + rw->count - 1;
+    Chip8_RewindEntry* entry = EntryAt(rw, seq);
+
+    // The decoded keyframe is kept around, rewinding through its deltas only decodes those
+    if(rw->key_seq != entry->keyframe) {
+        Chip8_RewindEntry* key = EntryAt(rw, entry->keyframe);
+        DecodeState(rw->data + key->offset, NULL, rw->state_size, rw->key_state);
+        rw->key_seq = entry->keyframe;
+    }
+
+    if(entry->keyframe == seq)
+        memcpy(rw->state, rw->key_state, rw->state_size);
+    else
+        DecodeState(rw->data + entry->offset, rw->key_state, rw->state_size, rw->state);
+    LoadState(cpu, mem, sched, rw->state);
+
+    rw->bytes -= entry->size;
+    rw->count--;
+    if(rw->count > 0) {
+        Chip8_RewindEntry* newest = EntryAt(rw, seq - 1);
+        rw->head = newest->offset + newest->size;
+    } else
+        rw->head = 0;
+
+    // With its keyframe gone, the next state pushed has to be a keyframe again
+    if(entry->keyframe == seq)
+        rw->key_seq = UINT64_MAX;
+    return true;
+}
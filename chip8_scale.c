@@ -0,0 +1,264 @@
+#include "Chip8.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Upscaling.
+//
+// The screen is scaled on the CPU, straight from the packed screen buffer into the pixels of a
+// texture as large as the window's screen area, so the renderer only ever copies it 1:1. Rows
+// are first expanded to one color index per pixel, then optionally smoothed by scale2x or
+// scale3x (which only ever compare indices for equality), and what remains of the scale factor
+// is made up by repeating pixels, spread as evenly as it goes when the filter does not divide
+// the scale. Only the rows that changed are scaled, along with their neighbours, whose smoothing
+// depends on them.
+
+#define SCALE_ROW (CHIP8_HIRES_WIDTH + 32)       // An index row and its padding
+#define SCALE_OUT (CHIP8_HIRES_WIDTH * 3 + 32)   // A row scale3x produced
+
+// Output pixels per screen pixel the filter produces by itself
+uint32_t FilterFactor(Chip8_Filter filter)
+{
+    switch(filter) {
+        case CHIP8_FILTER_NONE:    return 1;
+        case CHIP8_FILTER_SCALE2X: return 2;
+        case CHIP8_FILTER_SCALE3X: return 3;
+    }
+    return 1;
+}
+
+// Filter names as accepted by the -filter command line option
+bool ParseFilterName(const char* name, Chip8_Filter* filter)
+{
+    if(strcmp(name, "none")    == 0) { *filter = CHIP8_FILTER_NONE;    return true; }
+    if(strcmp(name, "scale2x") == 0) { *filter = CHIP8_FILTER_SCALE2X; return true; }
+    if(strcmp(name, "scale3x") == 0) { *filter = CHIP8_FILTER_SCALE3X; return true; }
+    return false;
+}
+
+// Color indices of row y, with the edge pixels repeated into index -1 and screen_w
+static void ExpandRow(const Chip8_Memory* mem, int y, uint8_t* out)
+{
+    size_t          planes = mem->variant == CHIP8_VARIANT_XOCHIP ? CHIP8_PLANES : 1;
+    const uint64_t* row    = mem->screen_buffer + y * mem->row_words;
+
+    for(size_t word = 0; word < mem->row_words; word++) {
+        uint8_t* dest = out + word * 64;
+#if defined(__SSE2__)
+        // 16 pixels at a time: every byte of the row's 16 bits is tested against its own bit
+        const __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, (char) 128, 1, 2, 4, 8, 16, 32, 64, (char) 128);
+        for(int group = 0; group < 4; group++) {
+            __m128i color = _mm_setzero_si128();
+            for(size_t plane = 0; plane < planes; plane++) {
+                uint64_t pixels = row[plane * mem->plane_words + word] >> (48 - 16 * group);
+                __m128i  spread = _mm_unpacklo_epi64(_mm_set1_epi8((char)(pixels >> 8)), _mm_set1_epi8((char) pixels));
+                __m128i  lit    = _mm_cmpeq_epi8(_mm_and_si128(spread, bits), bits);
+                color = _mm_or_si128(color, _mm_and_si128(lit, _mm_set1_epi8((char)(1 << plane))));
+            }
+            _mm_storeu_si128((__m128i*)(dest + 16 * group), color);
+        }
+#else
+        for(int x = 0; x < 64; x++) {
+            uint8_t color = 0;
+            for(size_t plane = 0; plane < planes; plane++)
+                color |= ((row[plane * mem->plane_words + word] >> (63 - x)) & 1) << plane;
+            dest[x] = color;
+        }
+#endif
+    }
+    out[-1]            = out[0];
+    out[mem->screen_w] = out[mem->screen_w - 1];
+}
+
+// E0 E1 / E2 E3 for every pixel E of 'mid', B above it, H below it, D and F left and right
+static void Scale2xRow(const uint8_t* up, const uint8_t* mid, const uint8_t* down, size_t width,
+                       uint8_t* top, uint8_t* bottom)
+{
+    size_t x = 0;
+#if defined(__SSE2__)
+    for(; x + 16 <= width; x += 16) {
+        __m128i B = _mm_loadu_si128((const __m128i*)(up + x));
+        __m128i H = _mm_loadu_si128((const __m128i*)(down + x));
+        __m128i D = _mm_loadu_si128((const __m128i*)(mid + x - 1));
+        __m128i E = _mm_loadu_si128((const __m128i*)(mid + x));
+        __m128i F = _mm_loadu_si128((const __m128i*)(mid + x + 1));
+
+        __m128i db = _mm_cmpeq_epi8(D, B), bf = _mm_cmpeq_epi8(B, F);
+        __m128i dh = _mm_cmpeq_epi8(D, H), hf = _mm_cmpeq_epi8(H, F);
+
+        // andnot(a, b) is b & ~a
+        __m128i c0 = _mm_andnot_si128(_mm_or_si128(bf, dh), db);
+        __m128i c1 = _mm_andnot_si128(_mm_or_si128(db, hf), bf);
+        __m128i c2 = _mm_andnot_si128(_mm_or_si128(db, hf), dh);
+        __m128i c3 = _mm_andnot_si128(_mm_or_si128(dh, bf), hf);
+
+        __m128i e0 = _mm_or_si128(_mm_and_si128(c0, D), _mm_andnot_si128(c0, E));
+        __m128i e1 = _mm_or_si128(_mm_and_si128(c1, F), _mm_andnot_si128(c1, E));
+        __m128i e2 = _mm_or_si128(_mm_and_si128(c2, D), _mm_andnot_si128(c2, E));
+        __m128i e3 = _mm_or_si128(_mm_and_si128(c3, F), _mm_andnot_si128(c3, E));
+
+        _mm_storeu_si128((__m128i*)(top    + 2 * x),      _mm_unpacklo_epi8(e0, e1));
+        _mm_storeu_si128((__m128i*)(top    + 2 * x + 16), _mm_unpackhi_epi8(e0, e1));
+        _mm_storeu_si128((__m128i*)(bottom + 2 * x),      _mm_unpacklo_epi8(e2, e3));
+        _mm_storeu_si128((__m128i*)(bottom + 2 * x + 16), _mm_unpackhi_epi8(e2, e3));
+    }
+#endif
+    for(; x < width; x++) {
+        uint8_t B = up[x], D = mid[x - 1], E = mid[x], F = mid[x + 1], H = down[x];
+        top[2 * x]        = D == B && B != F && D != H ? D : E;
+        top[2 * x + 1]    = B == F && B != D && F != H ? F : E;
+        bottom[2 * x]     = D == H && D != B && H != F ? D : E;
+        bottom[2 * x + 1] = H == F && D != H && B != F ? F : E;
+    }
+}
+
+// The 3x3 block of every pixel E, with A B C above it and G H I below it
+static void Scale3xRow(const uint8_t* up, const uint8_t* mid, const uint8_t* down, size_t width,
+                       uint8_t* out[3])
+{
+    size_t x = 0;
+#if defined(__SSE2__)
+    // The conditions are worked out 16 pixels at a time, the interleaving of the nine results
+    // into three rows is done a pixel at a time
+    for(; x + 16 <= width; x += 16) {
+        __m128i A = _mm_loadu_si128((const __m128i*)(up + x - 1));
+        __m128i B = _mm_loadu_si128((const __m128i*)(up + x));
+        __m128i C = _mm_loadu_si128((const __m128i*)(up + x + 1));
+        __m128i D = _mm_loadu_si128((const __m128i*)(mid + x - 1));
+        __m128i E = _mm_loadu_si128((const __m128i*)(mid + x));
+        __m128i F = _mm_loadu_si128((const __m128i*)(mid + x + 1));
+        __m128i G = _mm_loadu_si128((const __m128i*)(down + x - 1));
+        __m128i H = _mm_loadu_si128((const __m128i*)(down + x));
+        __m128i I = _mm_loadu_si128((const __m128i*)(down + x + 1));
+
+        __m128i db = _mm_cmpeq_epi8(D, B), bf = _mm_cmpeq_epi8(B, F);
+        __m128i dh = _mm_cmpeq_epi8(D, H), hf = _mm_cmpeq_epi8(H, F);
+        __m128i ea = _mm_cmpeq_epi8(E, A), ec = _mm_cmpeq_epi8(E, C);
+        __m128i eg = _mm_cmpeq_epi8(E, G), ei = _mm_cmpeq_epi8(E, I);
+
+        // Only pixels with B != H and D != F are smoothed at all
+        __m128i on = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(B, H), _mm_cmpeq_epi8(D, F)), _mm_set1_epi8(-1));
+
+        __m128i c[9], v[9];
+        c[0] = db;                                                          v[0] = D;
+        c[1] = _mm_or_si128(_mm_andnot_si128(ec, db), _mm_andnot_si128(ea, bf)); v[1] = B;
+        c[2] = bf;                                                          v[2] = F;
+        c[3] = _mm_or_si128(_mm_andnot_si128(eg, db), _mm_andnot_si128(ea, dh)); v[3] = D;
+        c[4] = _mm_setzero_si128();                                         v[4] = E;
+        c[5] = _mm_or_si128(_mm_andnot_si128(ei, bf), _mm_andnot_si128(ec, hf)); v[5] = F;
+        c[6] = dh;                                                          v[6] = D;
+        c[7] = _mm_or_si128(_mm_andnot_si128(ei, dh), _mm_andnot_si128(eg, hf)); v[7] = H;
+        c[8] = hf;                                                          v[8] = F;
+
+        uint8_t block[9][16];
+        for(int k = 0; k < 9; k++) {
+            __m128i cond = _mm_and_si128(c[k], on);
+            _mm_storeu_si128((__m128i*) block[k], _mm_or_si128(_mm_and_si128(cond, v[k]), _mm_andnot_si128(cond, E)));
+        }
+        for(int p = 0; p < 16; p++) {
+            for(int r = 0; r < 3; r++) {
+                out[r][3 * (x + p)]     = block[3 * r][p];
+                out[r][3 * (x + p) + 1] = block[3 * r + 1][p];
+                out[r][3 * (x + p) + 2] = block[3 * r + 2][p];
+            }
+        }
+    }
+#endif
+    for(; x < width; x++) {
+        uint8_t A = up[x - 1],   B = up[x],   C = up[x + 1];
+        uint8_t D = mid[x - 1],  E = mid[x],  F = mid[x + 1];
+        uint8_t G = down[x - 1], H = down[x], I = down[x + 1];
+        uint8_t block[9] = { E, E, E, E, E, E, E, E, E };
+
+        if(B != H && D != F) {
+            block[0] = D == B ? D : E;
+            block[1] = (D == B && E != C) || (B == F && E != A) ? B : E;
+            block[2] = B == F ? F : E;
+            block[3] = (D == B && E != G) || (D == H && E != A) ? D : E;
+            block[5] = (B == F && E != I) || (H == F && E != C) ? F : E;
+            block[6] = D == H ? D : E;
+            block[7] = (D == H && E != I) || (H == F && E != G) ? H : E;
+            block[8] = H == F ? F : E;
+        }
+        for(int r = 0; r < 3; r++) {
+            out[r][3 * x]     = block[3 * r];
+            out[r][3 * x + 1] = block[3 * r + 1];
+            out[r][3 * x + 2] = block[3 * r + 2];
+        }
+    }
+}
+
+// Colors a row of indices into 'dest', the k-th of every 'factor' indices repeat[k] pixels wide
+static void ColorRow(const uint8_t* indices, size_t width, uint32_t factor, const uint32_t repeat[3],
+                     const uint32_t palette[4], uint32_t* dest)
+{
+    uint32_t sub = 0;
+    for(size_t x = 0; x < width; x++) {
+        uint32_t color = palette[indices[x]];
+        uint32_t count = repeat[sub];
+        uint32_t k     = 0;
+#if defined(__SSE2__)
+        __m128i  quad  = _mm_set1_epi32((int) color);
+        for(; k + 4 <= count; k += 4)
+            _mm_storeu_si128((__m128i*)(dest + k), quad);
+#endif
+        for(; k < count; k++)
+            dest[k] = color;
+        dest += count;
+        if(++sub == factor)
+            sub = 0;
+    }
+}
+
+// Scales screen rows [first, last] by 'scale' into 'pixels', the output of row first. The filter
+// is applied once whenever the scale is at least its factor, and each of the pixels it produces
+// is repeated scale / factor or one more times, so that they add up to the scale
+void ScaleScreen(const Chip8_Memory* mem, Chip8_Filter filter, uint32_t scale, int first, int last,
+                 const uint32_t palette[4], uint32_t* pixels, int pitch)
+{
+    uint32_t factor = FilterFactor(filter);
+    if(scale < factor)
+        factor = 1;
+    uint32_t repeat[3], offset[3];
+    for(uint32_t k = 0; k < factor; k++) {
+        offset[k] = k * scale / factor;
+        repeat[k] = (k + 1) * scale / factor - offset[k];
+    }
+    size_t   width  = mem->screen_w;
+    int      height = (int) mem->screen_h;
+
+    // Three index rows around the one being scaled, 16 bytes in so SIMD loads at x - 1 stay inside
+    uint8_t  rows[3][SCALE_ROW];
+    uint8_t  filtered[3][SCALE_OUT];
+    uint8_t* up   = rows[0] + 16;
+    uint8_t* mid  = rows[1] + 16;
+    uint8_t* down = rows[2] + 16;
+
+    ExpandRow(mem, first > 0 ? first - 1 : first, up);
+    ExpandRow(mem, first, mid);
+    for(int y = first; y <= last; y++) {
+        ExpandRow(mem, y + 1 < height ? y + 1 : y, down);
+
+        uint8_t* out[3] = { filtered[0], filtered[1], filtered[2] };
+        if(factor == 2)
+            Scale2xRow(up, mid, down, width, out[0], out[1]);
+        else if(factor == 3)
+            Scale3xRow(up, mid, down, width, out);
+        else
+            out[0] = mid;
+
+        // Each filtered row is colored once, its repeats are copies of it
+        for(uint32_t r = 0; r < factor; r++) {
+            uint32_t* dest = (uint32_t*)((uint8_t*) pixels + (size_t)((y - first) * scale + offset[r]) * pitch);
+            ColorRow(out[r], width * factor, factor, repeat, palette, dest);
+            for(uint32_t k = 1; k < repeat[r]; k++)
+                memcpy((uint8_t*) dest + (size_t) k * pitch, dest, width * scale * sizeof(uint32_t));
+        }
+
+        uint8_t* recycled = up;
+        up   = mid;
+        mid  = down;
+        down = recycled;
+    }
+}
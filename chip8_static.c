@@ -0,0 +1,114 @@
+#include "Chip8_Core.h"
+
+// Ahead-of-time recompiled code.
+//
+// chip8_aot translates a ROM into C, one function per basic block, and the program it
+// generates is handed to the scheduler with UseStaticProgram. A translation is only right as
+// long as memory still holds the bytes it was made from, so a block goes stale as soon as
+// anything writes over it: the blocks report their own Fx33/Fx55 writes, and InvalidateEngine
+// the writes made from outside. Stale blocks, and addresses no block starts at (code only
+// reached through a computed Bnnn jump, or loaded at run time), are interpreted.
+
+struct CHIP8STATIC {
+    const Chip8_StaticProgram* program;
+    const uint8_t*             memory;  // The memory the stale flags were last checked against
+    bool code[CHIP8_DECODE_SLOTS];      // The byte is part of at least one block
+    bool stale[CHIP8_DECODE_SLOTS];
+};
+
+Chip8_Static* CreateStatic(const Chip8_StaticProgram* program)
+{
+    Chip8_Static* st = (Chip8_Static*) calloc(1, sizeof(Chip8_Static));
+    if(st == NULL)
+        return NULL;
+
+    st->program = program;
+    for(uint32_t addr = 0; addr < CHIP8_DECODE_SLOTS; addr++) {
+        if(program->blocks[addr] == NULL)
+            continue;
+        for(uint32_t byte = addr; byte < addr + 2u * program->lengths[addr] && byte < CHIP8_DECODE_SLOTS; byte++)
+            st->code[byte] = true;
+    }
+    return st;
+}
+
+void DestroyStatic(Chip8_Static* st)
+{
+    free(st);
+}
+
+// Memory may have changed in any way, every block is compared with the ROM before it next runs
+void FlushStatic(Chip8_Static* st)
+{
+    st->memory = NULL;
+}
+
+static void CheckBlocks(Chip8_Static* st, const Chip8_Memory* mem)
+{
+    const Chip8_StaticProgram* program = st->program;
+
+    for(uint32_t addr = 0; addr < CHIP8_DECODE_SLOTS; addr++) {
+        if(program->blocks[addr] == NULL)
+            continue;
+        size_t size     = 2u * program->lengths[addr];
+        st->stale[addr] = addr < 0x200 || addr - 0x200 + size > program->rom_size ||
+                          memcmp(mem->ptr_8 + addr, program->rom + (addr - 0x200), size) != 0;
+    }
+    st->memory = mem->ptr_8;
+}
+
+bool InvalidateStatic(Chip8_Static* st, uint16_t addr, uint16_t len)
+{
+    const Chip8_StaticProgram* program = st->program;
+    bool                       hit     = false;
+
+    for(uint32_t k = 0; k < len; k++) {
+        uint32_t byte = (addr + k) & (CHIP8_DECODE_SLOTS - 1);  // As Fx33 and Fx55 wrap
+        if(!st->code[byte])
+            continue;
+
+        // Only blocks starting at most one block length before the byte can cover it
+        uint32_t first = byte >= 2 * CHIP8_STATIC_BLOCK ? byte - 2 * CHIP8_STATIC_BLOCK + 1 : 0;
+        for(uint32_t start = first; start <= byte; start++) {
+            if(program->blocks[start] != NULL && !st->stale[start] && start + 2u * program->lengths[start] > byte) {
+                st->stale[start] = true;
+                hit              = true;
+            }
+        }
+    }
+    return hit;
+}
+
+uint32_t ExecCyclesStatic(Chip8_Static* st, Chip8_CPU* cpu, Chip8_Memory* mem, uint32_t cycles)
+{
+    const Chip8_StaticProgram* program = st->program;
+    if(mem->variant != program->variant)
+        return ExecCycles(cpu, mem, cycles);
+    if(st->memory != mem->ptr_8)
+        CheckBlocks(st, mem);
+
+    uint32_t remaining = cycles;
+    while(remaining > 0 && cpu->wait_key_reg == 0xFF) {
+        uint16_t pc = cpu->PC;
+        if(pc < CHIP8_DECODE_SLOTS && program->blocks[pc] != NULL && !st->stale[pc] &&
+           program->lengths[pc] <= remaining) {
+            remaining -= program->blocks[pc](st, cpu, mem);
+            continue;
+        }
+
+        // Everything else is interpreted, noting what it writes
+        FetchInstruction(cpu, mem);
+        uint8_t signal = ExecInstruction(cpu, mem);
+        remaining--;
+
+        if((cpu->CIR & 0xF0FF) == 0xF033)
+            InvalidateStatic(st, cpu->I, 3);
+        if((cpu->CIR & 0xF0FF) == 0xF055)
+            InvalidateStatic(st, cpu->I, ((cpu->CIR & 0x0F00) >> 8) + 1);
+        if(signal != 0xFF) {
+            cpu->wait_key_reg  = signal;
+            cpu->wait_key_prev = ReadKeys(mem);
+        }
+    }
+    return cycles - remaining;
+}